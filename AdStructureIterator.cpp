@@ -0,0 +1,27 @@
+#include "AdStructureIterator.h"
+
+AdStructureIterator::AdStructureIterator(const uint8_t* payload, const size_t length)
+: _payload(payload),
+  _length(length)
+{}
+
+bool AdStructureIterator::next(uint8_t& type, const uint8_t*& data, size_t& dataLength)
+{
+    if(_index + 1 >= _length)
+    {
+        return false;
+    }
+
+    uint8_t adLength = _payload[_index];
+    if(adLength == 0 || _index + 1 + adLength > _length)
+    {
+        _index = _length;
+        return false;
+    }
+
+    type = _payload[_index + 1];
+    data = &_payload[_index + 2];
+    dataLength = adLength - 1;
+    _index += 1 + adLength;
+    return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <NimBLEDevice.h>
+#include <stdint.h>
+#include <stddef.h>
+
+// Walks the AD structures of a raw advertisement payload: length (including type), type, data.
+// Types are NimBLE's BLE_HS_ADV_TYPE_* values. Stops at a zero length or truncated structure.
+class AdStructureIterator
+{
+public:
+    AdStructureIterator(const uint8_t* payload, const size_t length);
+
+    // Returns false after the last complete structure
+    bool next(uint8_t& type, const uint8_t*& data, size_t& dataLength);
+
+private:
+    const uint8_t* _payload;
+    size_t _length;
+    size_t _index = 0;
+};
@@ -0,0 +1,255 @@
+#include "BeaconDecoder.h"
+#include "AdStructureIterator.h"
+#include <algorithm>
+
+static const char* eddystoneSchemes[] = { "http://www.", "https://www.", "http://", "https://" };
+static const char* eddystoneExpansions[] = { ".com/", ".org/", ".edu/", ".net/", ".info/", ".biz/", ".gov/",
+                                             ".com", ".org", ".edu", ".net", ".info", ".biz", ".gov" };
+
+int8_t Beacon::measuredPower() const
+{
+    // Eddystone advertises the power at 0 m, about 41 dB above the power received at 1 m
+    return type == BeaconType::IBeacon ? txPower : txPower - 41;
+}
+
+size_t Beacon::formatIdentity(char* out, const size_t maxLength) const
+{
+    int length = 0;
+    switch(type)
+    {
+        case BeaconType::IBeacon:
+            length = snprintf(out, maxLength, "ib:%02x%02x%02x%02x:%u:%u", id[0], id[1], id[2], id[3], major, minor);
+            break;
+        case BeaconType::EddystoneUid:
+            length = snprintf(out, maxLength, "es:%02x%02x%02x%02x%02x%02x", id[10], id[11], id[12], id[13], id[14], id[15]);
+            break;
+        default:
+            break;
+    }
+
+    if(length <= 0)
+    {
+        return 0;
+    }
+    return (size_t)length < maxLength ? length : maxLength - 1;
+}
+
+BeaconDecoder::BeaconDecoder(BleScanner::Scanner* scanner)
+: _scanner(scanner)
+{
+    _scanner->subscribe(this);
+}
+
+BeaconDecoder::~BeaconDecoder()
+{
+    _scanner->unsubscribe(this);
+    _scanner = nullptr;
+}
+
+void BeaconDecoder::subscribe(BeaconSubscriber* subscriber)
+{
+    if(std::find(_subscribers.begin(), _subscribers.end(), subscriber) != _subscribers.end())
+    {
+        return;
+    }
+    _subscribers.push_back(subscriber);
+}
+
+void BeaconDecoder::unsubscribe(BeaconSubscriber* subscriber)
+{
+    auto it = std::find(_subscribers.begin(), _subscribers.end(), subscriber);
+    if(it != _subscribers.end())
+    {
+        _subscribers.erase(it);
+    }
+}
+
+void BeaconDecoder::onResult(NimBLEAdvertisedDevice* advertisedDevice)
+{
+    Beacon beacon;
+    bool isBeacon = decode(advertisedDevice->getPayload(), advertisedDevice->getPayloadLength(), beacon);
+
+    if(isBeacon)
+    {
+        const uint8_t* native = advertisedDevice->getAddress().getNative();
+        long long address = 0;
+        for(int i = 5; i >= 0; i--)
+        {
+            address = (address << 8) | native[i];
+        }
+        beacon.identity = lookupIdentity(address, beacon.identity);
+    }
+
+    for(const auto& subscriber : _subscribers)
+    {
+        subscriber->onResult(advertisedDevice, isBeacon ? &beacon : nullptr);
+    }
+}
+
+bool BeaconDecoder::decode(const uint8_t* payload, const size_t length, Beacon& beacon)
+{
+    AdStructureIterator structures(payload, length);
+    uint8_t adType;
+    const uint8_t* data;
+    size_t dataLength;
+
+    while(structures.next(adType, data, dataLength))
+    {
+        if(adType == BLE_HS_ADV_TYPE_MFG_DATA && decodeIBeacon(data, dataLength, beacon))
+        {
+            return true;
+        }
+        if(adType == BLE_HS_ADV_TYPE_SVC_DATA_UUID16 && decodeEddystone(data, dataLength, beacon))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool BeaconDecoder::decodeIBeacon(const uint8_t* data, const size_t length, Beacon& beacon)
+{
+    // company 0x004C (little endian), type 0x02, length 0x15, uuid, major, minor, measured power
+    if(length != 25 || data[0] != 0x4C || data[1] != 0x00 || data[2] != 0x02 || data[3] != 0x15)
+    {
+        return false;
+    }
+
+    beacon.type = BeaconType::IBeacon;
+    memcpy(beacon.id, &data[4], 16);
+    beacon.major = (data[20] << 8) | data[21];
+    beacon.minor = (data[22] << 8) | data[23];
+    beacon.txPower = (int8_t)data[24];
+    beacon.hasTxPower = true;
+    beacon.identity = identityAddress(beacon);
+    return true;
+}
+
+bool BeaconDecoder::decodeEddystone(const uint8_t* data, const size_t length, Beacon& beacon)
+{
+    // service uuid 0xFEAA (little endian), frame type, frame
+    if(length < 4 || data[0] != 0xAA || data[1] != 0xFE)
+    {
+        return false;
+    }
+
+    const uint8_t* frame = &data[3];
+    size_t frameLength = length - 3;
+
+    switch(data[2])
+    {
+        case 0x00:
+            // tx power, namespace (10), instance (6), 2 reserved bytes that are often left out
+            if(frameLength < 17)
+            {
+                return false;
+            }
+            beacon.type = BeaconType::EddystoneUid;
+            beacon.txPower = (int8_t)frame[0];
+            beacon.hasTxPower = true;
+            memcpy(beacon.id, &frame[1], 16);
+            beacon.identity = identityAddress(beacon);
+            return true;
+        case 0x10:
+            // tx power, scheme, encoded url
+            if(frameLength < 2)
+            {
+                return false;
+            }
+            beacon.type = BeaconType::EddystoneUrl;
+            beacon.txPower = (int8_t)frame[0];
+            beacon.hasTxPower = true;
+            decodeEddystoneUrl(&frame[1], frameLength - 1, beacon.url);
+            return true;
+        case 0x20:
+            // version, battery mV, temperature (8.8 fixed point), advertisement count, uptime, all big endian
+            if(frameLength < 13 || frame[0] != 0x00)
+            {
+                return false;
+            }
+            beacon.type = BeaconType::EddystoneTlm;
+            beacon.batteryMv = (frame[1] << 8) | frame[2];
+            if(frame[3] != 0x80 || frame[4] != 0x00)
+            {
+                beacon.hasTemperature = true;
+                beacon.temperature = (int16_t)((frame[3] << 8) | frame[4]) / 256.0f;
+            }
+            beacon.advertisementCount = ((uint32_t)frame[5] << 24) | ((uint32_t)frame[6] << 16) | (frame[7] << 8) | frame[8];
+            beacon.uptime = ((uint32_t)frame[9] << 24) | ((uint32_t)frame[10] << 16) | (frame[11] << 8) | frame[12];
+            return true;
+        default:
+            return false;
+    }
+}
+
+void BeaconDecoder::decodeEddystoneUrl(const uint8_t* data, const size_t length, char* out)
+{
+    size_t index = 0;
+
+    auto append = [&](const char* text)
+    {
+        while(*text != 0x00 && index < beacon_max_url_length)
+        {
+            out[index++] = *text++;
+        }
+    };
+
+    if(data[0] < sizeof(eddystoneSchemes) / sizeof(eddystoneSchemes[0]))
+    {
+        append(eddystoneSchemes[data[0]]);
+    }
+
+    for(size_t i = 1; i < length; i++)
+    {
+        if(data[i] < sizeof(eddystoneExpansions) / sizeof(eddystoneExpansions[0]))
+        {
+            append(eddystoneExpansions[data[i]]);
+        }
+        else if(data[i] > 0x20 && data[i] < 0x7F && index < beacon_max_url_length)
+        {
+            out[index++] = data[i];
+        }
+    }
+
+    out[index] = 0x00;
+}
+
+long long BeaconDecoder::identityAddress(const Beacon& beacon)
+{
+    // FNV-1a over type and id, as static random address (two most significant bits set)
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&](const uint8_t value)
+    {
+        hash ^= value;
+        hash *= 1099511628211ULL;
+    };
+
+    add((uint8_t)beacon.type);
+    for(int i = 0; i < 16; i++)
+    {
+        add(beacon.id[i]);
+    }
+    if(beacon.type == BeaconType::IBeacon)
+    {
+        add(beacon.major >> 8);
+        add(beacon.major & 0xFF);
+        add(beacon.minor >> 8);
+        add(beacon.minor & 0xFF);
+    }
+
+    return (long long)((hash & 0x3FFFFFFFFFFFULL) | 0xC00000000000ULL);
+}
+
+long long BeaconDecoder::lookupIdentity(const long long address, const long long identity)
+{
+    // Eddystone beacons interleave UID frames with URL and TLM frames from the same address
+    IdentityCacheEntry& entry = _identityCache[(address ^ (address >> 24)) % beacon_identity_cache_size];
+    if(identity != 0)
+    {
+        entry.address = address;
+        entry.identity = identity;
+        return identity;
+    }
+    return entry.address == address ? entry.identity : 0;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "BleScanner.h"
+#include "BleInterfaces.h"
+#include <vector>
+
+// Longest expanded Eddystone URL: scheme + 17 encoded bytes, each expanding to up to 7 characters
+#define beacon_max_url_length 128
+// Remembers which identity an address sent, so telemetry frames can be attributed to it
+#define beacon_identity_cache_size 32
+
+enum class BeaconType : uint8_t
+{
+    None = 0,
+    IBeacon = 1,
+    EddystoneUid = 2,
+    EddystoneUrl = 3,
+    EddystoneTlm = 4
+};
+
+// Decoded beacon frame, only valid during the onResult() call
+struct Beacon
+{
+    BeaconType type = BeaconType::None;
+    long long identity = 0; // static random address derived from the beacon id, 0 if unknown
+    bool hasTxPower = false;
+    int8_t txPower = 0; // as advertised: at 1 m for iBeacon, at 0 m for Eddystone
+    uint8_t id[16] = {0}; // iBeacon proximity UUID, or Eddystone namespace (10 bytes) and instance (6 bytes)
+    uint16_t major = 0;
+    uint16_t minor = 0;
+    char url[beacon_max_url_length + 1] = {0};
+    uint16_t batteryMv = 0; // 0 if not reported
+    bool hasTemperature = false;
+    float temperature = 0; // °C
+    uint32_t advertisementCount = 0;
+    uint32_t uptime = 0; // 0.1 s since power on
+
+    // Calibrated RSSI at 1 m, only valid if hasTxPower
+    int8_t measuredPower() const;
+    // Short readable id, e.g. "ib:e2c56db5:1:2" or "es:0123456789ab", returns the length
+    size_t formatIdentity(char* out, const size_t maxLength) const;
+};
+
+class BeaconSubscriber
+{
+public:
+    // beacon is nullptr for advertisements without a beacon frame
+    virtual void onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) = 0;
+};
+
+// Pipeline stage between the scanner and its subscribers. Recognises iBeacon and Eddystone UID, URL and TLM
+// frames straight from the raw advertisement payload without heap allocation, and passes the decoded frame on.
+class BeaconDecoder : public BleScanner::Subscriber
+{
+public:
+    explicit BeaconDecoder(BleScanner::Scanner* scanner);
+    virtual ~BeaconDecoder();
+
+    void subscribe(BeaconSubscriber* subscriber);
+    void unsubscribe(BeaconSubscriber* subscriber);
+
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice) override;
+
+    // Decodes the first beacon frame found in an advertisement payload (AD structures)
+    static bool decode(const uint8_t* payload, const size_t length, Beacon& beacon);
+
+private:
+    static bool decodeIBeacon(const uint8_t* data, const size_t length, Beacon& beacon);
+    static bool decodeEddystone(const uint8_t* data, const size_t length, Beacon& beacon);
+    static void decodeEddystoneUrl(const uint8_t* data, const size_t length, char* out);
+    static long long identityAddress(const Beacon& beacon);
+
+    long long lookupIdentity(const long long address, const long long identity);
+
+    struct IdentityCacheEntry
+    {
+        long long address = 0;
+        long long identity = 0;
+    };
+
+    BleScanner::Scanner* _scanner;
+    std::vector<BeaconSubscriber*> _subscribers;
+    IdentityCacheEntry _identityCache[beacon_identity_cache_size];
+};
@@ -0,0 +1,259 @@
+#include "CrowdCounter.h"
+#include "MqttTopics.h"
+#include <math.h>
+
+static const char* crowdWindowNames[crowd_window_count] = { "minute", "hour", "day" };
+static const unsigned long crowdSlotDuration[crowd_window_count] =
+{
+    60000 / crowd_window_slots,
+    3600000 / crowd_window_slots,
+    86400000 / crowd_window_slots
+};
+static const char* crowdTierNames[crowd_tier_count] = { "all", "near" };
+
+void DistinctSketch::add(const uint64_t hash)
+{
+    // The first bits select the register, it keeps the longest run of leading zeros seen in the rest (+1)
+    uint32_t index = hash >> (64 - crowd_sketch_precision);
+    uint64_t rest = hash << crowd_sketch_precision;
+    uint8_t rank = 1;
+    while(rank <= 64 - crowd_sketch_precision && !(rest & 0x8000000000000000ULL))
+    {
+        rest <<= 1;
+        ++rank;
+    }
+
+    if(rank > _registers[index])
+    {
+        _registers[index] = rank;
+    }
+}
+
+void DistinctSketch::merge(const DistinctSketch& other)
+{
+    for(int i = 0; i < crowd_sketch_registers; i++)
+    {
+        if(other._registers[i] > _registers[i])
+        {
+            _registers[i] = other._registers[i];
+        }
+    }
+}
+
+void DistinctSketch::clear()
+{
+    memset(_registers, 0, sizeof(_registers));
+}
+
+float DistinctSketch::estimate() const
+{
+    const float m = crowd_sketch_registers;
+    float sum = 0;
+    int zeros = 0;
+
+    for(int i = 0; i < crowd_sketch_registers; i++)
+    {
+        sum += ldexpf(1.0f, -_registers[i]);
+        if(_registers[i] == 0)
+        {
+            ++zeros;
+        }
+    }
+
+    float alpha = 0.7213f / (1.0f + 1.079f / m);
+    float estimate = alpha * m * m / sum;
+
+    // Linear counting is more accurate while many registers are still empty
+    if(estimate <= 2.5f * m && zeros > 0)
+    {
+        estimate = m * logf(m / zeros);
+    }
+
+    return estimate;
+}
+
+size_t DistinctSketch::toHex(char* out) const
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    size_t index = 0;
+
+    auto put = [&](const uint8_t value)
+    {
+        out[index++] = hexDigits[value >> 4];
+        out[index++] = hexDigits[value & 0x0F];
+    };
+
+    put(crowd_sketch_version);
+    put(crowd_sketch_precision);
+    for(int i = 0; i < crowd_sketch_registers; i++)
+    {
+        put(_registers[i]);
+    }
+    out[index] = 0;
+
+    return index;
+}
+
+CrowdCounter::CrowdCounter(BeaconDecoder* beaconDecoder, Network* network, const int nearRssi, const unsigned long publishInterval)
+: _beaconDecoder(beaconDecoder),
+  _network(network),
+  _nearRssi(nearRssi),
+  _publishInterval(publishInterval)
+{
+    _sketchMutex = xSemaphoreCreateMutex();
+
+    // <prefix>/crowd/<window>/<tier> is the estimate, .../sketch the registers for merging on the host
+    char topic[40];
+    for(int window = 0; window < crowd_window_count; window++)
+    {
+        for(int tier = 0; tier < crowd_tier_count; tier++)
+        {
+            snprintf(topic, sizeof(topic), "%s/%s/%s", mqtt_topic_crowd, crowdWindowNames[window], crowdTierNames[tier]);
+            _estimateTopics[window][tier] = _network->registerTopic(topic);
+
+            strncat(topic, "/sketch", sizeof(topic) - strlen(topic) - 1);
+            _sketchTopics[window][tier] = _network->registerTopic(topic);
+        }
+    }
+
+    _beaconDecoder->subscribe(this);
+}
+
+CrowdCounter::~CrowdCounter()
+{
+    _beaconDecoder->unsubscribe(this);
+    _beaconDecoder = nullptr;
+    _network = nullptr;
+    vSemaphoreDelete(_sketchMutex);
+}
+
+uint64_t CrowdCounter::hashAddress(const long long address)
+{
+    // 64 bit finalizer of MurmurHash3. All nodes have to use the same hash for their sketches to merge.
+    uint64_t hash = (uint64_t)address;
+    hash ^= hash >> 33;
+    hash *= 0xFF51AFD7ED558CCDULL;
+    hash ^= hash >> 33;
+    hash *= 0xC4CEB9FE1A85EC53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+void CrowdCounter::onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon)
+{
+    long long address = 0;
+    const uint8_t* native = advertisedDevice->getAddress().getNative();
+    for(int i = 5; i >= 0; i--)
+    {
+        address = (address << 8) | native[i];
+    }
+
+    uint64_t hash = hashAddress(address);
+    bool near = advertisedDevice->haveRSSI() && advertisedDevice->getRSSI() >= _nearRssi;
+
+    xSemaphoreTake(_sketchMutex, portMAX_DELAY);
+    advance(millis());
+    for(int window = 0; window < crowd_window_count; window++)
+    {
+        uint8_t slot = _currentSlot[window] % crowd_window_slots;
+        _sketches[window][slot][(int)CrowdTier::All].add(hash);
+        if(near)
+        {
+            _sketches[window][slot][(int)CrowdTier::Near].add(hash);
+        }
+    }
+    xSemaphoreGive(_sketchMutex);
+}
+
+void CrowdCounter::advance(const unsigned long ts)
+{
+    // Clears the slots that were skipped since the last advertisement, at most the whole window
+    for(int window = 0; window < crowd_window_count; window++)
+    {
+        uint32_t slot = ts / crowdSlotDuration[window];
+        uint32_t steps = slot - _currentSlot[window];
+        if(steps > crowd_window_slots)
+        {
+            steps = crowd_window_slots;
+        }
+
+        for(uint32_t i = 1; i <= steps; i++)
+        {
+            for(int tier = 0; tier < crowd_tier_count; tier++)
+            {
+                _sketches[window][(slot - steps + i) % crowd_window_slots][tier].clear();
+            }
+        }
+        _currentSlot[window] = slot;
+    }
+}
+
+void CrowdCounter::collect(const uint8_t window, const CrowdTier tier, DistinctSketch& sketch) const
+{
+    sketch.clear();
+    for(int slot = 0; slot < crowd_window_slots; slot++)
+    {
+        sketch.merge(_sketches[window][slot][(int)tier]);
+    }
+}
+
+void CrowdCounter::update()
+{
+    unsigned long ts = millis();
+    if(_network->mqttConnectionState() == 0)
+    {
+        return;
+    }
+
+    if(_nextSketch < crowd_window_count * crowd_tier_count && ts - _lastSketchTs >= crowd_sketch_spacing)
+    {
+        _lastSketchTs = ts;
+        publishSketch(_nextSketch / crowd_tier_count, (CrowdTier)(_nextSketch % crowd_tier_count));
+        ++_nextSketch;
+    }
+
+    if(ts - _lastPublishTs < _publishInterval)
+    {
+        return;
+    }
+    _lastPublishTs = ts;
+
+    publishEstimates();
+
+    if(_publishCount++ % crowd_sketch_interval_factor == 0)
+    {
+        _nextSketch = 0;
+    }
+}
+
+void CrowdCounter::publishEstimates()
+{
+    DistinctSketch sketch;
+
+    for(int window = 0; window < crowd_window_count; window++)
+    {
+        for(int tier = 0; tier < crowd_tier_count; tier++)
+        {
+            xSemaphoreTake(_sketchMutex, portMAX_DELAY);
+            advance(millis());
+            collect(window, (CrowdTier)tier, sketch);
+            xSemaphoreGive(_sketchMutex);
+
+            _network->publishInt(_estimateTopics[window][tier], lroundf(sketch.estimate()));
+        }
+    }
+}
+
+void CrowdCounter::publishSketch(const uint8_t window, const CrowdTier tier)
+{
+    char hex[crowd_sketch_hex_length + 1];
+    DistinctSketch sketch;
+
+    xSemaphoreTake(_sketchMutex, portMAX_DELAY);
+    advance(millis());
+    collect(window, tier, sketch);
+    xSemaphoreGive(_sketchMutex);
+
+    sketch.toHex(hex);
+    _network->publishString(_sketchTopics[window][(int)tier], hex);
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include "BeaconDecoder.h"
+#include "Network.h"
+
+// 2^8 registers per sketch, about 6.5 % standard error
+#define crowd_sketch_precision 8
+#define crowd_sketch_registers (1 << crowd_sketch_precision)
+#define crowd_sketch_version 1
+// Each window is covered by this many sub-buckets, the oldest one is dropped when a new one starts
+#define crowd_window_slots 4
+#define crowd_window_count 3
+#define crowd_tier_count 2
+// version + precision + registers, hex encoded
+#define crowd_sketch_hex_length ((2 + crowd_sketch_registers) * 2)
+// A set of sketches is about 3.3 KB, as much as the telemetry queue holds. They are published with every
+// 10th set of estimates, one sketch per second so the telemetry bucket (1 KB/s) drains them as they come.
+#define crowd_sketch_interval_factor 10
+#define crowd_sketch_spacing 1000
+
+enum class CrowdTier : uint8_t
+{
+    All = 0,
+    Near = 1 // RSSI at or above the configured threshold
+};
+
+// HyperLogLog distinct counter. Registers of sketches built with the same precision and hash can be merged by maximum,
+// so the sketches of several nodes give a site-wide count (tools/crowd_merge.py).
+class DistinctSketch
+{
+public:
+    void add(const uint64_t hash);
+    void merge(const DistinctSketch& other);
+    void clear();
+    float estimate() const;
+    size_t toHex(char* out) const;
+
+private:
+    uint8_t _registers[crowd_sketch_registers] = {0};
+};
+
+// Counts distinct advertising addresses per minute, hour and day in fixed memory
+// (crowd_window_count * crowd_window_slots * crowd_tier_count sketches, 6 KB). A window is the union of its slots,
+// so the count covers between (slots - 1) / slots and all of the window. Private addresses that rotate are counted
+// once per address, like any other device.
+class CrowdCounter : public BeaconSubscriber
+{
+public:
+    CrowdCounter(BeaconDecoder* beaconDecoder, Network* network, const int nearRssi, const unsigned long publishInterval);
+    virtual ~CrowdCounter();
+
+    // Publishes the estimates and the next sketch when due, called from the network task
+    void update();
+
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) override;
+
+    static uint64_t hashAddress(const long long address);
+
+private:
+    void advance(const unsigned long ts);
+    void collect(const uint8_t window, const CrowdTier tier, DistinctSketch& sketch) const;
+    void publishEstimates();
+    void publishSketch(const uint8_t window, const CrowdTier tier);
+
+    BeaconDecoder* _beaconDecoder;
+    Network* _network;
+    TopicHandle _estimateTopics[crowd_window_count][crowd_tier_count];
+    TopicHandle _sketchTopics[crowd_window_count][crowd_tier_count];
+    const int _nearRssi;
+    const unsigned long _publishInterval; // ms
+    unsigned long _lastPublishTs = 0;
+    unsigned long _lastSketchTs = 0;
+    uint32_t _publishCount = 0;
+    uint8_t _nextSketch = crowd_window_count * crowd_tier_count; // window * tier count + tier, none pending
+    SemaphoreHandle_t _sketchMutex;
+
+    DistinctSketch _sketches[crowd_window_count][crowd_window_slots][crowd_tier_count];
+    uint32_t _currentSlot[crowd_window_count] = {0}; // number of the slot since boot, per window
+};
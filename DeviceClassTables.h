@@ -0,0 +1,97 @@
+#pragma once
+
+// Generated by tools/device_classes.py from tools/device_classes/*.csv, don't edit.
+// Only included by DeviceClassifier.cpp. const arrays stay in flash.
+
+static const char* const deviceVendorNames[] =
+{
+    "",
+    "Amazon",
+    "Apple",
+    "Bose",
+    "Broadcom",
+    "Cypress",
+    "Espressif",
+    "Estimote",
+    "Garmin",
+    "Google",
+    "Huami",
+    "Intel",
+    "LG Electronics",
+    "Logitech",
+    "Microsoft",
+    "Nordic Semiconductor",
+    "Qingping",
+    "Qualcomm",
+    "Raspberry Pi",
+    "Ruuvi",
+    "Samsung",
+    "Sonos",
+    "Sony",
+    "SwitchBot",
+    "Telink",
+    "Texas Instruments",
+    "Tile",
+    "Xiaomi",
+};
+
+static const DeviceClassEntry companyClasses[] =
+{
+    { 0x000002, 11, 7 }, // Intel computer
+    { 0x000006, 14, 7 }, // Microsoft computer
+    { 0x00000A, 17, 0 }, // Qualcomm -
+    { 0x00000D, 25, 0 }, // Texas Instruments -
+    { 0x00000F, 4, 0 }, // Broadcom -
+    { 0x00004C, 2, 1 }, // Apple phone
+    { 0x000059, 15, 0 }, // Nordic Semiconductor -
+    { 0x000075, 20, 1 }, // Samsung phone
+    { 0x000087, 8, 2 }, // Garmin watch
+    { 0x00009E, 3, 6 }, // Bose audio
+    { 0x0000C4, 12, 5 }, // LG Electronics tv
+    { 0x0000E0, 9, 1 }, // Google phone
+    { 0x00012D, 22, 6 }, // Sony audio
+    { 0x000131, 5, 0 }, // Cypress -
+    { 0x000157, 10, 2 }, // Huami watch
+    { 0x000171, 1, 6 }, // Amazon audio
+    { 0x0001DA, 13, 8 }, // Logitech peripheral
+    { 0x0002E5, 6, 4 }, // Espressif sensor
+    { 0x00038F, 27, 4 }, // Xiaomi sensor
+    { 0x000499, 19, 4 }, // Ruuvi sensor
+    { 0x000969, 23, 4 }, // SwitchBot sensor
+};
+
+static const DeviceClassEntry serviceClasses[] =
+{
+    { 0x00180D, 0, 2 }, // - watch
+    { 0x001812, 0, 8 }, // - peripheral
+    { 0x00181A, 0, 4 }, // - sensor
+    { 0x00FCD2, 0, 4 }, // - sensor
+    { 0x00FD5A, 20, 3 }, // Samsung tag
+    { 0x00FD6F, 0, 1 }, // - phone
+    { 0x00FE03, 1, 6 }, // Amazon audio
+    { 0x00FE07, 21, 6 }, // Sonos audio
+    { 0x00FE2C, 9, 6 }, // Google audio
+    { 0x00FE95, 27, 4 }, // Xiaomi sensor
+    { 0x00FE9A, 7, 3 }, // Estimote tag
+    { 0x00FE9F, 9, 1 }, // Google phone
+    { 0x00FEAA, 0, 3 }, // - tag
+    { 0x00FEEC, 26, 3 }, // Tile tag
+    { 0x00FEED, 26, 3 }, // Tile tag
+};
+
+static const DeviceClassEntry ouiClasses[] =
+{
+    { 0x240AC4, 6, 4 }, // Espressif sensor
+    { 0x246F28, 6, 4 }, // Espressif sensor
+    { 0x30AEA4, 6, 4 }, // Espressif sensor
+    { 0x3C71BF, 6, 4 }, // Espressif sensor
+    { 0x582D34, 16, 4 }, // Qingping sensor
+    { 0x7C9EBD, 6, 4 }, // Espressif sensor
+    { 0x84CCA8, 6, 4 }, // Espressif sensor
+    { 0xA4C138, 24, 4 }, // Telink sensor
+    { 0xA4CF12, 6, 4 }, // Espressif sensor
+    { 0xB827EB, 18, 7 }, // Raspberry Pi computer
+    { 0xC47C8D, 27, 4 }, // Xiaomi sensor
+    { 0xDCA632, 18, 7 }, // Raspberry Pi computer
+    { 0xE45F01, 18, 7 }, // Raspberry Pi computer
+};
@@ -0,0 +1,139 @@
+#include "DeviceClassifier.h"
+#include "DeviceClassTables.h"
+#include "AdStructureIterator.h"
+
+#define company_id_apple 0x004C
+
+#define table_size(table) (sizeof(table) / sizeof(table[0]))
+
+static const char* deviceClassNames[] = { "", "phone", "watch", "tag", "sensor", "tv", "audio", "computer", "peripheral" };
+
+bool DeviceClassifier::classify(const uint8_t* payload, const size_t length, const long long address, const bool publicAddress,
+                                uint8_t& vendor, DeviceClass& deviceClass)
+{
+    const DeviceClassEntry* service = nullptr;
+    const DeviceClassEntry* company = nullptr;
+    DeviceClass companyClass = DeviceClass::Unknown;
+    AdStructureIterator structures(payload, length);
+    uint8_t adType;
+    const uint8_t* data;
+    size_t dataLength;
+
+    while(structures.next(adType, data, dataLength))
+    {
+        switch(adType)
+        {
+            case BLE_HS_ADV_TYPE_INCOMP_UUIDS16:
+            case BLE_HS_ADV_TYPE_COMP_UUIDS16:
+                for(size_t i = 0; i + 1 < dataLength && service == nullptr; i += 2)
+                {
+                    service = find(serviceClasses, table_size(serviceClasses), data[i] | (data[i + 1] << 8));
+                }
+                break;
+            case BLE_HS_ADV_TYPE_SVC_DATA_UUID16:
+                if(dataLength >= 2 && service == nullptr)
+                {
+                    service = find(serviceClasses, table_size(serviceClasses), data[0] | (data[1] << 8));
+                }
+                break;
+            case BLE_HS_ADV_TYPE_MFG_DATA:
+                if(dataLength >= 2 && company == nullptr)
+                {
+                    uint16_t companyId = data[0] | (data[1] << 8);
+                    company = find(companyClasses, table_size(companyClasses), companyId);
+                    if(companyId == company_id_apple)
+                    {
+                        companyClass = appleClass(&data[2], dataLength - 2);
+                    }
+                }
+                break;
+        }
+    }
+
+    const DeviceClassEntry* oui = nullptr;
+    if(publicAddress)
+    {
+        oui = find(ouiClasses, table_size(ouiClasses), (address >> 24) & 0xFFFFFF);
+    }
+
+    // The company id names the vendor most reliably, the service UUID says most about what the device is
+    const DeviceClassEntry* vendorOrder[] = { company, service, oui };
+    const DeviceClassEntry* classOrder[] = { service, company, oui };
+
+    vendor = 0;
+    for(const DeviceClassEntry* entry : vendorOrder)
+    {
+        if(entry != nullptr && entry->vendor != 0)
+        {
+            vendor = entry->vendor;
+            break;
+        }
+    }
+
+    deviceClass = companyClass;
+    for(const DeviceClassEntry* entry : classOrder)
+    {
+        if(deviceClass != DeviceClass::Unknown)
+        {
+            break;
+        }
+        if(entry != nullptr)
+        {
+            deviceClass = (DeviceClass)entry->deviceClass;
+        }
+    }
+
+    return vendor != 0 || deviceClass != DeviceClass::Unknown;
+}
+
+const char* DeviceClassifier::vendorName(const uint8_t vendor)
+{
+    return vendor < table_size(deviceVendorNames) ? deviceVendorNames[vendor] : "";
+}
+
+const char* DeviceClassifier::className(const DeviceClass deviceClass)
+{
+    uint8_t index = (uint8_t)deviceClass;
+    return index < table_size(deviceClassNames) ? deviceClassNames[index] : "";
+}
+
+const DeviceClassEntry* DeviceClassifier::find(const DeviceClassEntry* table, const size_t count, const uint32_t key)
+{
+    size_t low = 0;
+    size_t high = count;
+
+    while(low < high)
+    {
+        size_t middle = (low + high) / 2;
+        if(table[middle].key < key)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+
+    return low < count && table[low].key == key ? &table[low] : nullptr;
+}
+
+DeviceClass DeviceClassifier::appleClass(const uint8_t* data, const size_t length)
+{
+    // Apple manufacturer data carries Continuity messages: type, length, data
+    if(length < 1)
+    {
+        return DeviceClass::Unknown;
+    }
+
+    switch(data[0])
+    {
+        case 0x02: // iBeacon
+        case 0x12: // Find My, AirTags and lost devices
+            return DeviceClass::Tag;
+        case 0x07: // proximity pairing, AirPods and Beats
+            return DeviceClass::Audio;
+        default:
+            return DeviceClass::Unknown;
+    }
+}
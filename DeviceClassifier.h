@@ -0,0 +1,45 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define device_class_count 9
+
+enum class DeviceClass : uint8_t
+{
+    Unknown = 0,
+    Phone = 1,
+    Watch = 2,
+    Tag = 3,
+    Sensor = 4,
+    Tv = 5,
+    Audio = 6,
+    Computer = 7,
+    Peripheral = 8
+};
+
+// Row of the generated lookup tables in DeviceClassTables.h, sorted by key
+struct DeviceClassEntry
+{
+    uint32_t key; // company id, 16 bit service UUID or OUI
+    uint8_t vendor; // index into the vendor names, 0 if unknown
+    uint8_t deviceClass;
+};
+
+// Derives vendor and device class from an advertisement. The tables are generated from
+// tools/device_classes/*.csv by tools/device_classes.py and stay in flash, lookups are binary searches.
+class DeviceClassifier
+{
+public:
+    // Service UUIDs are the most specific hint, then the company id of the manufacturer data, then the OUI.
+    // The OUI is only meaningful for public addresses. Returns false if nothing matched.
+    static bool classify(const uint8_t* payload, const size_t length, const long long address, const bool publicAddress,
+                         uint8_t& vendor, DeviceClass& deviceClass);
+
+    static const char* vendorName(const uint8_t vendor);
+    static const char* className(const DeviceClass deviceClass);
+
+private:
+    static const DeviceClassEntry* find(const DeviceClassEntry* table, const size_t count, const uint32_t key);
+    static DeviceClass appleClass(const uint8_t* data, const size_t length);
+};
@@ -0,0 +1,55 @@
+#include "DeviceMap.h"
+#include <algorithm>
+
+DeviceMap::iterator DeviceMap::begin()
+{
+    return _entries.begin();
+}
+
+DeviceMap::iterator DeviceMap::end()
+{
+    return _entries.end();
+}
+
+size_t DeviceMap::size() const
+{
+    return _entries.size();
+}
+
+DeviceMap::iterator DeviceMap::find(const long long address)
+{
+    auto it = lower_bound(address);
+    return it != _entries.end() && it->first == address ? it : _entries.end();
+}
+
+DeviceMap::iterator DeviceMap::lower_bound(const long long address)
+{
+    return std::lower_bound(_entries.begin(), _entries.end(), address,
+                            [](const DeviceEntry& entry, const long long value) { return entry.first < value; });
+}
+
+PdDevice& DeviceMap::operator[](const long long address)
+{
+    auto it = lower_bound(address);
+    if(it != _entries.end() && it->first == address)
+    {
+        return it->second;
+    }
+
+    // Grows in small steps, doubling would leave up to half of a large map unused
+    if(_entries.size() == _entries.capacity())
+    {
+        size_t index = it - _entries.begin();
+        _entries.reserve(_entries.size() + device_map_growth);
+        it = _entries.begin() + index;
+    }
+
+    DeviceEntry entry;
+    entry.first = address;
+    return _entries.insert(it, entry)->second;
+}
+
+DeviceMap::iterator DeviceMap::erase(iterator it)
+{
+    return _entries.erase(it);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include "PdDevice.h"
+
+// Entries added at once when the map is full, instead of doubling its capacity
+#define device_map_growth 32
+
+struct DeviceEntry
+{
+    long long first; // 48 bit address
+    PdDevice second;
+};
+
+// The presence devices sorted by address in one array, so reports can walk address ranges.
+// An entry takes 48 bytes on ESP32 (address, 36 byte record, padding) and at most device_map_growth
+// entries are unused. A std::map node took about 72 bytes: tree pointers, key, record and heap header.
+// Adding and removing devices moves the entries behind them, iterators and references are only valid
+// until the map changes.
+class DeviceMap
+{
+public:
+    typedef std::vector<DeviceEntry>::iterator iterator;
+
+    iterator begin();
+    iterator end();
+    size_t size() const;
+
+    iterator find(const long long address);
+    // First device at or above address
+    iterator lower_bound(const long long address);
+    // Adds a default device if address is unknown
+    PdDevice& operator[](const long long address);
+    iterator erase(iterator it);
+
+private:
+    std::vector<DeviceEntry> _entries;
+};
@@ -6,6 +6,9 @@
 #include "Logger.h"
 
 Network* Gpio::_network = nullptr;
+TopicHandle Gpio::_inputTopics[3] = { topic_handle_invalid, topic_handle_invalid, topic_handle_invalid };
+
+static const uint8_t outputPins[] = { OUTPUT_PIN_A, OUTPUT_PIN_B, OUTPUT_PIN_C, OUTPUT_PIN_D, OUTPUT_PIN_E, OUTPUT_PIN_F };
 
 Gpio::Gpio(Network* network)
 {
@@ -25,63 +28,70 @@ Gpio::Gpio(Network* network)
     attachInterrupt(INPUT_PIN_B, input_b, CHANGE);
     attachInterrupt(INPUT_PIN_C, input_c, CHANGE);
 
-    _network->publishPin(mqtt_topic_input_pin_a, 0);
-    _network->publishPin(mqtt_topic_input_pin_b, 0);
-    _network->publishPin(mqtt_topic_input_pin_c, 0);
+    _inputTopics[0] = _network->registerTopic(mqtt_topic_input_pin_a);
+    _inputTopics[1] = _network->registerTopic(mqtt_topic_input_pin_b);
+    _inputTopics[2] = _network->registerTopic(mqtt_topic_input_pin_c);
 
-    _network->subscribe(mqtt_topic_output_pin_a);
-    _network->subscribe(mqtt_topic_output_pin_b);
-    _network->subscribe(mqtt_topic_output_pin_c);
-    _network->subscribe(mqtt_topic_output_pin_d);
-    _network->subscribe(mqtt_topic_output_pin_e);
-    _network->subscribe(mqtt_topic_output_pin_f);
+    _outputTopics[0] = _network->registerTopic(mqtt_topic_output_pin_a);
+    _outputTopics[1] = _network->registerTopic(mqtt_topic_output_pin_b);
+    _outputTopics[2] = _network->registerTopic(mqtt_topic_output_pin_c);
+    _outputTopics[3] = _network->registerTopic(mqtt_topic_output_pin_d);
+    _outputTopics[4] = _network->registerTopic(mqtt_topic_output_pin_e);
+    _outputTopics[5] = _network->registerTopic(mqtt_topic_output_pin_f);
 
-    _network->registerMqttReceiver(this);
+    for(const TopicHandle topic : _inputTopics)
+    {
+        _network->publishPin(topic, 0);
+    }
+
+    for(const TopicHandle topic : _outputTopics)
+    {
+        _network->subscribe(topic, this);
+    }
 }
 
-void Gpio::onMqttDataReceived(const char* topic, byte* payload, const unsigned int length)
+void Gpio::onMqttDataReceived(const TopicHandle subscription, const char* topic, byte* payload, const unsigned int length)
 {
     char* value = (char*)payload;
 
-    if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_a))
-    {
-        digitalWrite(OUTPUT_PIN_A, strcmp(value, "1") == 0 ? HIGH : LOW);
-    }
-    else if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_b))
+    for(size_t i = 0; i < sizeof(outputPins) / sizeof(outputPins[0]); i++)
     {
-        digitalWrite(OUTPUT_PIN_B, strcmp(value, "1") == 0 ? HIGH : LOW);
+        if(subscription == _outputTopics[i])
+        {
+            digitalWrite(outputPins[i], strcmp(value, "1") == 0 ? HIGH : LOW);
+            return;
+        }
     }
-    else if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_c))
-    {
-        digitalWrite(OUTPUT_PIN_C, strcmp(value, "1") == 0 ? HIGH : LOW);
-    }
-    else if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_d))
-    {
-        digitalWrite(OUTPUT_PIN_D, strcmp(value, "1") == 0 ? HIGH : LOW);
-    }
-    else if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_e))
-    {
-        digitalWrite(OUTPUT_PIN_E, strcmp(value, "1") == 0 ? HIGH : LOW);
-    }
-    else if(_network->comparePrefixedPath(topic, mqtt_topic_output_pin_f))
+}
+
+bool Gpio::setOutput(const uint8_t pin, const bool active)
+{
+    switch(pin)
     {
-        Serial.println(value);
-        Serial.println(strcmp(value, "1") == 0 ? "HIGH" : "LOW");
-        digitalWrite(OUTPUT_PIN_F, strcmp(value, "1") == 0 ? HIGH : LOW);
+        case OUTPUT_PIN_A:
+        case OUTPUT_PIN_B:
+        case OUTPUT_PIN_C:
+        case OUTPUT_PIN_D:
+        case OUTPUT_PIN_E:
+        case OUTPUT_PIN_F:
+            digitalWrite(pin, active ? HIGH : LOW);
+            return true;
+        default:
+            return false;
     }
 }
 
 void Gpio::input_a()
 {
-    _network->publishPin(mqtt_topic_input_pin_a, digitalRead(INPUT_PIN_A) == 0 ? 1 : 0);
+    _network->publishPin(_inputTopics[0], digitalRead(INPUT_PIN_A) == 0 ? 1 : 0);
 }
 
 void Gpio::input_b()
 {
-    _network->publishPin(mqtt_topic_input_pin_b, digitalRead(INPUT_PIN_B) == 0 ? 1 : 0);
+    _network->publishPin(_inputTopics[1], digitalRead(INPUT_PIN_B) == 0 ? 1 : 0);
 }
 
 void Gpio::input_c()
 {
-    _network->publishPin(mqtt_topic_input_pin_c, digitalRead(INPUT_PIN_C) == 0 ? 1 : 0);
+    _network->publishPin(_inputTopics[2], digitalRead(INPUT_PIN_C) == 0 ? 1 : 0);
 }
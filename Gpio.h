@@ -8,7 +8,10 @@ class Gpio : public MqttReceiver
 public:
     Gpio(Network* network);
 
-    virtual void onMqttDataReceived(const char* topic, byte* payload, const unsigned int length) override;
+    virtual void onMqttDataReceived(const TopicHandle subscription, const char* topic, byte* payload, const unsigned int length) override;
+
+    // Switches one of the output pins from the node itself, returns false if pin isn't an output
+    bool setOutput(const uint8_t pin, const bool active);
 
 private:
     static void IRAM_ATTR input_a();
@@ -16,4 +19,6 @@ private:
     static void IRAM_ATTR input_c();
 
     static Network* _network;
+    static TopicHandle _inputTopics[3];
+    TopicHandle _outputTopics[6];
 };
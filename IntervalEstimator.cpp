@@ -0,0 +1,45 @@
+#include "IntervalEstimator.h"
+
+void IntervalEstimator::update(PdDevice& device, const unsigned long elapsed)
+{
+    long sample = elapsed < 1 ? 1 : (elapsed > 0xFFFF ? 0xFFFF : elapsed);
+
+    if(device.interval == 0)
+    {
+        device.interval = sample;
+        device.intervalStep = 0;
+        device.jitter = 0;
+        return;
+    }
+
+    long median = device.interval;
+    long step = device.intervalStep; // the sign is the direction of the last move
+
+    if(sample > median)
+    {
+        step = step > 0 ? step * 2 : 1;
+        median += step;
+        if(median > sample)
+        {
+            // Overshooting means the median is close, start over with small steps
+            step = sample - device.interval;
+            median = sample;
+        }
+    }
+    else if(sample < median)
+    {
+        step = step < 0 ? step * 2 : -1;
+        median += step;
+        if(median < sample)
+        {
+            step = sample - device.interval;
+            median = sample;
+        }
+    }
+
+    device.interval = median < 1 ? 1 : (median > 0xFFFF ? 0xFFFF : median);
+    device.intervalStep = step < -0x7FFF ? -0x7FFF : (step > 0x7FFF ? 0x7FFF : step);
+
+    long deviation = sample > median ? sample - median : median - sample;
+    device.jitter = (device.jitter * (interval_jitter_weight - 1) + deviation) / interval_jitter_weight;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <Arduino.h>
+#include "PdDevice.h"
+
+// Jitter is the running mean absolute deviation from the median, weight of a new sample
+#define interval_jitter_weight 8
+
+// Tracks the advertising interval of a device with O(1) work and 6 bytes per device: the median
+// is a streaming quantile estimate (Frugal-2U), which moves towards each sample by a step that doubles
+// while the samples keep pulling in the same direction. Outliers like scan pauses or scan responses
+// right after their advertisement only move it by one step.
+class IntervalEstimator
+{
+public:
+    // elapsed is the time since the previous advertisement of the device in ms
+    static void update(PdDevice& device, const unsigned long elapsed);
+};
@@ -1,9 +1,11 @@
 #pragma once
 
 #include <Arduino.h>
+#include "TopicRegistry.h"
 
 class MqttReceiver
 {
 public:
-    virtual void onMqttDataReceived(const char* topic, byte* payload, const unsigned int length) = 0;
-};
\ No newline at end of file
+    // subscription is the handle the receiver subscribed with, topic the full topic of the message
+    virtual void onMqttDataReceived(const TopicHandle subscription, const char* topic, byte* payload, const unsigned int length) = 0;
+};
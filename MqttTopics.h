@@ -1,6 +1,13 @@
 #pragma once
 
 #define mqtt_topic_presence "/presence/devices"
+#define mqtt_topic_presence_pages "/presence/pages"
+#define mqtt_topic_presence_zones "/presence/zones"
+#define mqtt_topic_presence_rate_alert "/presence/alerts/rate"
+#define mqtt_topic_presence_query "/presence/query"
+#define mqtt_topic_presence_answers "/presence/answers"
+#define mqtt_topic_sensors "/sensors"
+#define mqtt_topic_crowd "/crowd"
 #define mqtt_topic_reset "/maintenance/reset"
 #define mqtt_topic_uptime "/maintenance/uptime"
 #define mqtt_topic_freeheap "/maintenance/freeHeap"
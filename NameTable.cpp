@@ -0,0 +1,139 @@
+#include "NameTable.h"
+
+NameTable::~NameTable()
+{
+    for(auto& entry : _entries)
+    {
+        delete[] entry.name;
+    }
+}
+
+uint16_t NameTable::intern(const char* name, size_t length)
+{
+    if(length > name_table_max_length)
+    {
+        length = name_table_max_length;
+    }
+    if(length == 0)
+    {
+        return name_table_no_name;
+    }
+
+    // Names are only interned when a device is new or renames itself, so a linear scan over
+    // the distinct names is cheap. The hash just avoids most of the string compares.
+    uint16_t nameHash = hash(name, length);
+    size_t freeIndex = _entries.size();
+
+    for(size_t i = 0; i < _entries.size(); i++)
+    {
+        Entry& entry = _entries[i];
+        if(entry.references == 0)
+        {
+            if(freeIndex == _entries.size())
+            {
+                freeIndex = i;
+            }
+            continue;
+        }
+        if(entry.hash == nameHash && entry.length == length && memcmp(entry.name, name, length) == 0)
+        {
+            ++entry.references;
+            return i + 1;
+        }
+    }
+
+    if(freeIndex == _entries.size())
+    {
+        if(_entries.size() >= UINT16_MAX)
+        {
+            return name_table_no_name;
+        }
+        _entries.emplace_back();
+    }
+
+    Entry& entry = _entries[freeIndex];
+    entry.name = new char[length];
+    memcpy(entry.name, name, length);
+    entry.hash = nameHash;
+    entry.length = length;
+    entry.references = 1;
+    ++_count;
+
+    return freeIndex + 1;
+}
+
+uint16_t NameTable::retain(const uint16_t id)
+{
+    if(id == name_table_no_name || id > _entries.size() || _entries[id - 1].references == 0)
+    {
+        return name_table_no_name;
+    }
+
+    ++_entries[id - 1].references;
+    return id;
+}
+
+void NameTable::release(const uint16_t id)
+{
+    if(id == name_table_no_name || id > _entries.size())
+    {
+        return;
+    }
+
+    Entry& entry = _entries[id - 1];
+    if(entry.references == 0)
+    {
+        return;
+    }
+
+    --entry.references;
+    if(entry.references == 0)
+    {
+        delete[] entry.name;
+        entry.name = nullptr;
+        entry.length = 0;
+        --_count;
+    }
+}
+
+const char* NameTable::get(const uint16_t id, size_t& length) const
+{
+    if(id == name_table_no_name || id > _entries.size() || _entries[id - 1].references == 0)
+    {
+        length = 0;
+        return nullptr;
+    }
+
+    const Entry& entry = _entries[id - 1];
+    length = entry.length;
+    return entry.name;
+}
+
+bool NameTable::equals(const uint16_t id, const char* name, size_t length) const
+{
+    if(length > name_table_max_length)
+    {
+        length = name_table_max_length;
+    }
+
+    size_t internedLength;
+    const char* interned = get(id, internedLength);
+    return internedLength == length && (length == 0 || memcmp(interned, name, length) == 0);
+}
+
+size_t NameTable::count() const
+{
+    return _count;
+}
+
+uint16_t NameTable::hash(const char* name, const size_t length) const
+{
+    // FNV-1a, folded to 16 bit
+    uint32_t hash = 2166136261u;
+    for(size_t i = 0; i < length; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+    return (hash >> 16) ^ (hash & 0xFFFF);
+}
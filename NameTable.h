@@ -0,0 +1,47 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+// Id of devices that didn't advertise a name (yet)
+#define name_table_no_name 0
+// Longest local name that fits into a legacy advertisement
+#define name_table_max_length 29
+
+// Interns device names, so all devices advertising e.g. "Tile" share one copy.
+// Ids are reference counted and reused once the last device using a name released it.
+// Not thread safe, PresenceDetection only uses it while holding the devices mutex.
+class NameTable
+{
+public:
+    NameTable() = default;
+    NameTable(const NameTable&) = delete;
+    NameTable& operator=(const NameTable&) = delete;
+    virtual ~NameTable();
+
+    // Returns the id of name with one more reference, or name_table_no_name if name is empty or the table is full
+    uint16_t intern(const char* name, size_t length);
+    // Adds a reference to an interned name
+    uint16_t retain(const uint16_t id);
+    void release(const uint16_t id);
+
+    // Returns nullptr for name_table_no_name. The name is not null terminated.
+    const char* get(const uint16_t id, size_t& length) const;
+    bool equals(const uint16_t id, const char* name, size_t length) const;
+
+    size_t count() const;
+
+private:
+    struct Entry
+    {
+        char* name = nullptr;
+        uint16_t hash = 0;
+        uint8_t length = 0;
+        uint16_t references = 0;
+    };
+
+    uint16_t hash(const char* name, const size_t length) const;
+
+    std::vector<Entry> _entries;
+    size_t _count = 0;
+};
@@ -1,4 +1,5 @@
 #include "Network.h"
+#include <algorithm>
 #include "PreferencesKeys.h"
 #include "MqttTopics.h"
 #include "networkDevices/W5500Device.h"
@@ -28,8 +29,15 @@ Network::Network(Preferences *preferences)
         _preferences->putString(preference_mqtt_path, mqttPath);
     }
 
-    memset(_mqttPath, 0, sizeof(_mqttPath));
-    strcpy(_mqttPath, mqttPath.c_str());
+    _topics.setPrefix(mqttPath.c_str());
+    _topicPresence = _topics.add(mqtt_topic_presence);
+    _topicPresenceAnswers = _topics.add(mqtt_topic_presence_answers);
+    _topicPresencePages = _topics.add(mqtt_topic_presence_pages);
+    _topicWifiRssi = _topics.add(mqtt_topic_wifi_rssi);
+    _topicUptime = _topics.add(mqtt_topic_uptime);
+    _topicFreeHeap = _topics.add(mqtt_topic_freeheap);
+    _topicRestartReasonFw = _topics.add(mqtt_topic_restart_reason_fw);
+    _topicRestartReasonEsp = _topics.add(mqtt_topic_restart_reason_esp);
 
     setupDevice();
 }
@@ -63,6 +71,8 @@ void Network::setupDevice()
             break;
     }
 
+    _scheduler.setDevice(_device);
+
     _device->mqttOnConnect([&](bool sessionPresent)
         {
             onMqttConnect(sessionPresent);
@@ -71,6 +81,10 @@ void Network::setupDevice()
         {
             onMqttDisconnect(reason);
         });
+    _device->mqttOnSubscribe([&](uint16_t packetId, const espMqttClientTypes::SubscribeReturncode* returncodes, size_t len)
+        {
+            onMqttSubscribe(packetId, returncodes, len);
+        });
 }
 
 void Network::initialize()
@@ -134,6 +148,7 @@ void Network::initialize()
 
     _device->mqttSetClientId(_hostnameArr);
     _device->mqttSetCleanSession(MQTT_CLEAN_SESSIONS);
+    _device->mqttSetProtocolVersion(_preferences->getBool(preference_mqtt_v5) ? espMqttClientTypes::ProtocolVersion::V5 : espMqttClientTypes::ProtocolVersion::V3_1_1);
 
     _networkTimeout = _preferences->getInt(preference_network_timeout);
     if(_networkTimeout == 0)
@@ -180,7 +195,7 @@ bool Network::update()
 
     }
 
-    if(!_device->mqttConnected())
+    if(!updateMqttConnection(ts))
     {
         if(_networkTimeout > 0 && (ts - _lastConnectedTs > _networkTimeout * 1000) && ts > 60000)
         {
@@ -188,32 +203,18 @@ bool Network::update()
             delay(200);
             restartEsp(RestartReason::NetworkTimeoutWatchdog);
         }
-
-        bool success = reconnect();
-        if(!success)
-        {
-            return false;
-        }
+        return false;
     }
 
     _lastConnectedTs = ts;
 
-    if(_presenceCsv != nullptr && strlen(_presenceCsv) > 0)
-    {
-        bool success = publishString(mqtt_topic_presence, _presenceCsv);
-        if(!success)
-        {
-            Log->println(F("Failed to publish presence CSV data."));
-            Log->println(_presenceCsv);
-        }
-        _presenceCsv = nullptr;
-    }
-
     for(const auto& pin : _pinStates)
     {
         if(pin.second != -1)
         {
-            publishInt(pin.first, pin.second);
+            char str[30];
+            itoa(pin.second, str, 10);
+            publish(pin.first, str, PublishClass::Control);
         }
         _pinStates[pin.first] = -1;
     }
@@ -225,29 +226,32 @@ bool Network::update()
 
         if(rssi != _lastRssi)
         {
-            publishInt(mqtt_topic_wifi_rssi, _device->signalStrength());
+            publishInt(_topicWifiRssi, _device->signalStrength());
             _lastRssi = rssi;
         }
     }
 
     if(_lastMaintenanceTs == 0 || (ts - _lastMaintenanceTs) > 30000)
     {
-        publishULong(mqtt_topic_uptime, ts / 1000 / 60);
+        publishULong(_topicUptime, ts / 1000 / 60);
         if(_publishDebugInfo)
         {
-            publishUInt(mqtt_topic_freeheap, esp_get_free_heap_size());
-            publishString(mqtt_topic_restart_reason_fw, getRestartReason().c_str());
-            publishString(mqtt_topic_restart_reason_esp, getEspRestartReason().c_str());
+            publishUInt(_topicFreeHeap, esp_get_free_heap_size());
+            publishString(_topicRestartReasonFw, getRestartReason().c_str());
+            publishString(_topicRestartReasonEsp, getEspRestartReason().c_str());
         }
         _lastMaintenanceTs = ts;
     }
 
+    _scheduler.update();
+
     return true;
 }
 
 
 void Network::onMqttConnect(const bool &sessionPresent)
 {
+    _sessionPresent = sessionPresent;
     _connectReplyReceived = true;
 }
 
@@ -288,147 +292,274 @@ void Network::onMqttDisconnect(const espMqttClientTypes::DisconnectReason &reaso
     }
 }
 
-bool Network::reconnect()
+void Network::onMqttSubscribe(const uint16_t packetId, const espMqttClientTypes::SubscribeReturncode* returncodes, const size_t len)
 {
-    _mqttConnectionState = 0;
-    int port = _preferences->getInt(preference_mqtt_broker_port);
-
-    while (!_device->mqttConnected() && millis() > _nextReconnect)
+    for(size_t i = 0; i < len; i++)
     {
-        if(strcmp(_mqttBrokerAddr, "") == 0)
-        {
-            Log->println(F("MQTT Broker not configured, aborting connection attempt."));
-            _nextReconnect = millis() + 5000;
-            return false;
-        }
-
-        Log->println(F("Attempting MQTT connection"));
-
-        _connectReplyReceived = false;
-        if(strlen(_mqttUser) == 0)
-        {
-            Log->println(F("MQTT: Connecting without credentials"));
-            _device->mqttSetServer(_mqttBrokerAddr, port);
-            _device->mqttConnect();
-        }
-        else
+        if(returncodes[i] == espMqttClientTypes::SubscribeReturncode::FAIL)
         {
-            Log->print(F("MQTT: Connecting with user: ")); Log->println(_mqttUser);
-            _device->mqttSetCredentials(_mqttUser, _mqttPass);
-            _device->mqttSetServer(_mqttBrokerAddr, port);
-            _device->mqttConnect();
+            Log->print(F("MQTT subscription rejected, packet "));
+            Log->println(packetId);
         }
+    }
+    _lastSubAckPacketId = packetId;
+}
 
-        unsigned long timeout = millis() + 60000;
-
-        while(!_connectReplyReceived && millis() < timeout)
-        {
-            delay(200);
-            if(_keepAliveCallback != nullptr)
+bool Network::updateMqttConnection(const unsigned long ts)
+{
+    switch(_mqttConnectState)
+    {
+        case MqttConnectState::Idle:
+            if((long)(ts - _nextReconnect) >= 0)
             {
-                _keepAliveCallback();
+                startMqttConnect(ts);
             }
-        }
-
-        if (_device->mqttConnected())
-        {
-            Log->println(F("MQTT connected"));
-            _mqttConnectionState = 1;
-            delay(100);
-
-            _device->mqttOnMessage(Network::onMqttDataReceivedCallback);
-            for(const String& topic : _subscribedTopics)
+            return false;
+        case MqttConnectState::Connecting:
+            if(_connectReplyReceived && _device->mqttConnected())
             {
-                _device->mqttSubscribe(topic.c_str(), MQTT_QOS_LEVEL);
+                onMqttConnected(ts);
+                return true;
             }
-            if(_firstConnect)
+            if(!_connectReplyReceived && ts - _connectStateTs < mqtt_connect_timeout)
             {
-                _firstConnect = false;
-                for(const auto& it : _initTopics)
-                {
-                    _device->mqttPublish(it.first.c_str(), MQTT_QOS_LEVEL, true, it.second.c_str());
-                }
+                return false;
             }
-            delay(1000);
-            _mqttConnectionState = 2;
-            for(const auto& callback : _reconnectedCallbacks)
+            Log->print(F("MQTT connect failed, rc="));
+            _device->printError();
+            _device->mqttDisonnect(true);
+            ++_mqttConnectFailures;
+            scheduleReconnect(ts);
+            return false;
+        case MqttConnectState::Settling:
+        case MqttConnectState::Connected:
+            if(!_device->mqttConnected())
             {
-                callback();
+                Log->println(F("MQTT connection lost"));
+                scheduleReconnect(ts);
+                return false;
+            }
+            if(_mqttConnectState == MqttConnectState::Settling)
+            {
+                if(_lastSubscribePacketId != 0 && _lastSubAckPacketId != _lastSubscribePacketId)
+                {
+                    if(ts - _connectStateTs < mqtt_subscribe_timeout)
+                    {
+                        return true;
+                    }
+                    Log->println(F("MQTT subscriptions not acknowledged"));
+                }
+                else
+                {
+                    _sessionSubscribedCount = _pendingSubscribedCount;
+                }
+                _mqttConnectState = MqttConnectState::Connected;
+                for(const auto& callback : _reconnectedCallbacks)
+                {
+                    callback();
+                }
             }
+            return true;
+    }
+    return false;
+}
+
+void Network::startMqttConnect(const unsigned long ts)
+{
+    if(strcmp(_mqttBrokerAddr, "") == 0)
+    {
+        Log->println(F("MQTT Broker not configured, aborting connection attempt."));
+        _nextReconnect = ts + 5000;
+        return;
+    }
+
+    Log->print(F("Attempting MQTT connection, attempt "));
+    Log->println(_mqttConnectFailures + 1);
+
+    int port = _preferences->getInt(preference_mqtt_broker_port);
+    _connectReplyReceived = false;
+    if(strlen(_mqttUser) == 0)
+    {
+        Log->println(F("MQTT: Connecting without credentials"));
+    }
+    else
+    {
+        Log->print(F("MQTT: Connecting with user: ")); Log->println(_mqttUser);
+        _device->mqttSetCredentials(_mqttUser, _mqttPass);
+    }
+    _device->mqttSetServer(_mqttBrokerAddr, port);
+    _device->mqttConnect();
+
+    _connectStateTs = ts;
+    _mqttConnectState = MqttConnectState::Connecting;
+}
+
+void Network::onMqttConnected(const unsigned long ts)
+{
+    Log->println(F("MQTT connected"));
+    _mqttConnectFailures = 0;
+    ++_mqttReconnectCount;
+
+    _device->mqttOnMessage(Network::onMqttDataReceivedCallback);
+    // A session kept by the broker still holds the subscriptions. After booting they are sent anyway,
+    // the session may be from a firmware or configuration with different topics.
+    if(_sessionPresent && !_firstConnect)
+    {
+        Log->println(F("MQTT session present"));
+        subscribeTopics(_sessionSubscribedCount);
+    }
+    else
+    {
+        _sessionSubscribedCount = 0;
+        subscribeTopics(0);
+    }
+
+    if(_firstConnect)
+    {
+        _firstConnect = false;
+        for(const auto& it : _initTopics)
+        {
+            _device->mqttPublish(it.first.c_str(), MQTT_QOS_LEVEL, true, it.second.c_str());
         }
-        else
+    }
+
+    // The reconnected callbacks run once the broker acknowledged the subscriptions
+    _connectStateTs = ts;
+    _mqttConnectState = MqttConnectState::Settling;
+}
+
+void Network::subscribeTopics(const size_t first)
+{
+    // All SUBSCRIBE packets are queued at once, the broker acknowledges them within one round trip
+    _lastSubAckPacketId = 0;
+    _lastSubscribePacketId = 0;
+    _pendingSubscribedCount = first;
+
+    espMqttClientTypes::SubscribeItem batch[mqtt_subscribe_batch_size];
+    size_t count = 0;
+    for(size_t i = first; i < _subscribedTopics.size(); i++)
+    {
+        batch[count].topic = _topics.get(_subscribedTopics[i]);
+        batch[count].qos = MQTT_QOS_LEVEL;
+        count++;
+
+        if(count == mqtt_subscribe_batch_size || i == _subscribedTopics.size() - 1)
         {
-            Log->print(F("MQTT connect failed, rc="));
-            _device->printError();
-            _mqttConnectionState = 0;
-            _nextReconnect = millis() + 5000;
-            _device->mqttDisonnect(true);
+            uint16_t packetId = _device->mqttSubscribe(batch, count);
+            if(packetId == 0)
+            {
+                Log->println(F("MQTT subscribe failed"));
+                return;
+            }
+            _lastSubscribePacketId = packetId;
+            _pendingSubscribedCount = i + 1;
+            count = 0;
         }
     }
-    return _mqttConnectionState > 0;
 }
 
-void Network::subscribe(const char *path)
+void Network::scheduleReconnect(const unsigned long ts)
+{
+    // Exponential backoff with jitter, so scanners that lost the same broker don't reconnect in lockstep
+    unsigned long backoff = mqtt_reconnect_max_delay;
+    if(_mqttConnectFailures < 16 && (mqtt_reconnect_min_delay << _mqttConnectFailures) < mqtt_reconnect_max_delay)
+    {
+        backoff = mqtt_reconnect_min_delay << _mqttConnectFailures;
+    }
+    backoff = backoff / 2 + random(backoff / 2 + 1);
+
+    Log->print(F("Next MQTT connection attempt in "));
+    Log->print(backoff);
+    Log->println(F(" ms"));
+
+    _nextReconnect = ts + backoff;
+    _mqttConnectState = MqttConnectState::Idle;
+}
+
+TopicHandle Network::registerTopic(const char* suffix)
+{
+    return _topics.add(suffix);
+}
+
+void Network::subscribe(const TopicHandle topic, MqttReceiver* receiver)
 {
-    char prefixedPath[500];
-    buildMqttPath(path, prefixedPath);
-    _subscribedTopics.push_back(prefixedPath);
+    const char* filter = _topics.suffix(topic);
+    if(filter == nullptr)
+    {
+        return;
+    }
+
+    _dispatcher.add(filter, topic, receiver);
+    if(std::find(_subscribedTopics.begin(), _subscribedTopics.end(), topic) == _subscribedTopics.end())
+    {
+        _subscribedTopics.push_back(topic);
+    }
 }
 
 void Network::initTopic(const char *path, const char *value)
 {
-    char prefixedPath[500];
-    buildMqttPath(path, prefixedPath);
+    char prefixedPath[topic_registry_max_prefix_length + 100];
+    _topics.build(path, prefixedPath, sizeof(prefixedPath));
     String pathStr = prefixedPath;
     String valueStr = value;
     _initTopics[pathStr] = valueStr;
 }
 
-void Network::buildMqttPath(const char* path, char* outPath)
+void Network::buildPresencePagePath(const int page, char* outPath)
 {
-    int offset = 0;
-    int i=0;
-    while(_mqttPath[i] != 0x00)
-    {
-        outPath[offset] = _mqttPath[i];
-        ++offset;
-        ++i;
-    }
+    size_t offset = _topics.length(_topicPresence);
+    memcpy(outPath, _topics.get(_topicPresence), offset + 1);
 
-    i=0;
-    while(path[i] != 0x00)
+    // The first page keeps the original topic, so single page reports look the same as before
+    if(page > 0)
     {
-        outPath[offset] = path[i];
-        ++i;
-        ++offset;
+        outPath[offset] = '/';
+        itoa(page, &outPath[offset + 1], 10);
     }
-
-    outPath[offset] = 0x00;
 }
 
-void Network::registerMqttReceiver(MqttReceiver* receiver)
+void Network::buildQueryAnswerPath(const char* id, const char* page, char* outPath)
 {
-    _mqttReceivers.push_back(receiver);
+    // <prefix>/presence/answers/<id>/<page>, the query validated the id to be safe as topic level
+    size_t offset = _topics.length(_topicPresenceAnswers);
+    memcpy(outPath, _topics.get(_topicPresenceAnswers), offset);
+    outPath[offset] = '/';
+    strcpy(&outPath[offset + 1], id);
+    offset = strlen(outPath);
+    outPath[offset] = '/';
+    strcpy(&outPath[offset + 1], page);
 }
 
 void Network::onMqttDataReceivedCallback(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total)
 {
-    uint8_t value[50] = {0};
-    size_t l = min(len, sizeof(value)-1);
-
-    for(int i=0; i<l; i++)
+    // Receivers expect the whole payload, a cut off command or query could be valid but mean something else
+    if(index != 0 || len != total || len > mqtt_max_inbound_payload_length)
     {
-        value[i] = payload[i];
+        Log->print(F("MQTT payload too long, dropped message on "));
+        Log->println(topic);
+        return;
     }
 
+    uint8_t value[mqtt_max_inbound_payload_length + 1] = {0};
+    memcpy(value, payload, len);
+
     _inst->onMqttDataReceived(properties, topic, value, len, index, total);
 }
 
 void Network::onMqttDataReceived(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total)
 {
-    for(auto receiver : _mqttReceivers)
+    const char* suffix = _topics.stripPrefix(topic);
+    if(suffix == nullptr)
+    {
+        return;
+    }
+
+    TopicSubscription subscriptions[topic_dispatcher_max_matches];
+    size_t count = _dispatcher.match(suffix, subscriptions, topic_dispatcher_max_matches);
+
+    for(size_t i = 0; i < count; i++)
     {
-        receiver->onMqttDataReceived(topic, (byte*)payload, index);
+        subscriptions[i].receiver->onMqttDataReceived(subscriptions[i].topic, topic, (byte*)payload, len);
     }
 }
 
@@ -449,9 +580,47 @@ void Network::disableAutoRestarts()
     _restartOnDisconnect = false;
 }
 
+const PublishClassStats Network::publishStats(const PublishClass publishClass)
+{
+    return _scheduler.stats(publishClass);
+}
+
 int Network::mqttConnectionState()
 {
-    return _mqttConnectionState;
+    switch(_mqttConnectState)
+    {
+        case MqttConnectState::Settling:
+            return 1;
+        case MqttConnectState::Connected:
+            return 2;
+        default:
+            return 0;
+    }
+}
+
+const MqttConnectState Network::mqttConnectState() const
+{
+    return _mqttConnectState;
+}
+
+unsigned int Network::mqttConnectFailures() const
+{
+    return _mqttConnectFailures;
+}
+
+unsigned int Network::mqttReconnectCount() const
+{
+    return _mqttReconnectCount;
+}
+
+unsigned long Network::mqttNextReconnectIn() const
+{
+    long remaining = (long)(_nextReconnect - millis());
+    if(_mqttConnectState != MqttConnectState::Idle || remaining < 0)
+    {
+        return 0;
+    }
+    return remaining;
 }
 
 bool Network::encryptionSupported()
@@ -464,66 +633,136 @@ const String Network::networkDeviceName() const
     return _device->deviceName();
 }
 
-void Network::publishFloat(const char* topic, const float value, const uint8_t precision)
+bool Network::publish(const TopicHandle topic, const char* value, const PublishClass publishClass)
+{
+    // Retained state, a value still queued when the next one arrives is replaced instead of sent
+    const char* path = _topics.get(topic);
+    return path != nullptr && _scheduler.publish(publishClass, path, value, true, true);
+}
+
+bool Network::publishEvent(const TopicHandle topic, const char* value)
+{
+    const char* path = _topics.get(topic);
+    return path != nullptr && _scheduler.publish(PublishClass::Control, path, value, true, false);
+}
+
+void Network::publishFloat(const TopicHandle topic, const float value, const uint8_t precision)
 {
     char str[30];
     dtostrf(value, 0, precision, str);
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    _device->mqttPublish(path, MQTT_QOS_LEVEL, true, str);
+    publish(topic, str);
 }
 
-void Network::publishInt(const char *topic, const int value)
+void Network::publishInt(const TopicHandle topic, const int value)
 {
     char str[30];
     itoa(value, str, 10);
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    _device->mqttPublish(path, MQTT_QOS_LEVEL, true, str);
+    publish(topic, str);
 }
 
-void Network::publishUInt(const char *topic, const unsigned int value)
+void Network::publishUInt(const TopicHandle topic, const unsigned int value)
 {
     char str[30];
     utoa(value, str, 10);
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    _device->mqttPublish(path, MQTT_QOS_LEVEL, true, str);
+    publish(topic, str);
 }
 
-void Network::publishULong(const char *topic, const unsigned long value)
+void Network::publishULong(const TopicHandle topic, const unsigned long value)
 {
     char str[30];
     utoa(value, str, 10);
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    _device->mqttPublish(path, MQTT_QOS_LEVEL, true, str);
+    publish(topic, str);
 }
 
-void Network::publishBool(const char *topic, const bool value)
+void Network::publishBool(const TopicHandle topic, const bool value)
 {
     char str[2] = {0};
     str[0] = value ? '1' : '0';
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    _device->mqttPublish(path, MQTT_QOS_LEVEL, true, str);
+    publish(topic, str);
 }
 
-bool Network::publishString(const char *topic, const char *value)
+bool Network::publishString(const TopicHandle topic, const char *value)
 {
-    char path[200] = {0};
-    buildMqttPath(topic, path);
-    return _device->mqttPublish(path, MQTT_QOS_LEVEL, true, value) > 0;
+    return publish(topic, value);
 }
 
-void Network::publishPin(const char *topic, int value)
+void Network::publishPin(const TopicHandle topic, int value)
 {
     _pinStates[topic] = value;
 }
 
-void Network::publishPresenceDetection(char *csv)
+void Network::publishFloat(const char* topic, const float value, const uint8_t precision)
+{
+    char str[30];
+    dtostrf(value, 0, precision, str);
+    publishString(topic, str);
+}
+
+bool Network::publishString(const char *topic, const char *value, const PublishClass publishClass)
+{
+    char path[topic_registry_max_prefix_length + 100];
+    if(_topics.build(topic, path, sizeof(path)) == 0)
+    {
+        return false;
+    }
+    return _scheduler.publish(publishClass, path, value, true, true);
+}
+
+bool Network::publishPresencePage(const int page, espMqttClientTypes::SharedPayload* payload, uint32_t messageExpiry)
+{
+    if(!_device->mqttConnected())
+    {
+        return false;
+    }
+
+    char path[topic_registry_max_prefix_length + 100];
+    buildPresencePagePath(page, path);
+    return _scheduler.publish(PublishClass::Presence, path, payload, true, true, messageExpiry, mqtt_page_queue_wait);
+}
+
+void Network::publishPresencePageCount(const int count)
+{
+    // Clear retained pages left over from a previous, larger report
+    for(int page = count; page < _presencePageCount; page++)
+    {
+        char path[topic_registry_max_prefix_length + 100];
+        buildPresencePagePath(page, path);
+        _scheduler.publish(PublishClass::Presence, path, "", true, true, mqtt_page_queue_wait);
+    }
+    _presencePageCount = count;
+
+    // The page count completes the report, it waits for the pages like they did
+    char str[12];
+    itoa(count, str, 10);
+    const char* path = _topics.get(_topicPresencePages);
+    if(path != nullptr)
+    {
+        _scheduler.publish(PublishClass::Presence, path, str, true, true, mqtt_page_queue_wait);
+    }
+}
+
+bool Network::publishQueryAnswer(const char* id, const int page, espMqttClientTypes::SharedPayload* payload)
 {
-    _presenceCsv = csv;
+    if(!_device->mqttConnected())
+    {
+        return false;
+    }
+
+    char pageStr[12];
+    itoa(page, pageStr, 10);
+    char path[topic_registry_max_prefix_length + 100];
+    buildQueryAnswerPath(id, pageStr, path);
+    return _scheduler.publish(PublishClass::Presence, path, payload, false, false, 0, mqtt_page_queue_wait);
+}
+
+void Network::publishQueryAnswerPageCount(const char* id, const int count)
+{
+    // Published after the pages, so the answer is complete once the page count arrives
+    char str[12];
+    itoa(count, str, 10);
+    char path[topic_registry_max_prefix_length + 100];
+    buildQueryAnswerPath(id, "pages", path);
+    _scheduler.publish(PublishClass::Presence, path, str, false, false, mqtt_page_queue_wait);
 }
 
 const NetworkDeviceType Network::networkDeviceType()
@@ -536,19 +775,12 @@ uint16_t Network::subscribe(const char *topic, uint8_t qos)
     return _device->mqttSubscribe(topic, qos);
 }
 
-void Network::setKeepAliveCallback(std::function<void()> reconnectTick)
-{
-    _keepAliveCallback = reconnectTick;
-}
-
 void Network::addReconnectedCallback(std::function<void()> reconnectedCallback)
 {
     _reconnectedCallbacks.push_back(reconnectedCallback);
 }
 
-bool Network::comparePrefixedPath(const char *fullPath, const char *subPath)
+bool Network::comparePrefixedPath(const char *fullPath, const TopicHandle topic)
 {
-    char prefixedPath[500];
-    buildMqttPath(subPath, prefixedPath);
-    return strcmp(fullPath, prefixedPath) == 0;
+    return _topics.matches(topic, fullPath);
 }
\ No newline at end of file
@@ -6,6 +6,24 @@
 #include "networkDevices/NetworkDevice.h"
 #include "MqttReceiver.h"
 #include "networkDevices/IPConfiguration.h"
+#include "TopicRegistry.h"
+#include "TopicDispatcher.h"
+#include "PublishScheduler.h"
+
+// Longest inbound payload delivered to receivers, longer messages are dropped instead of truncated
+#define mqtt_max_inbound_payload_length 63
+
+// Delay before the first MQTT reconnect attempt (ms), doubled after every failed attempt
+#define mqtt_reconnect_min_delay 1000
+#define mqtt_reconnect_max_delay 60000
+// Time the broker has to answer a CONNECT (ms)
+#define mqtt_connect_timeout 60000
+// Time the broker has to acknowledge the subscriptions after connecting (ms)
+#define mqtt_subscribe_timeout 10000
+// Topics per SUBSCRIBE, the SUBACK has to fit the client's payload buffer
+#define mqtt_subscribe_batch_size (EMC_PAYLOAD_BUFFER_SIZE - 1)
+// Time a report page waits for room in the presence queue (ms), reports larger than the queue are sent as it drains
+#define mqtt_page_queue_wait 5000
 
 enum class NetworkDeviceType
 {
@@ -13,6 +31,14 @@ enum class NetworkDeviceType
     W5500
 };
 
+enum class MqttConnectState : uint8_t
+{
+    Idle = 0, // not connected, waiting for the next attempt
+    Connecting = 1, // CONNECT sent, waiting for the broker
+    Settling = 2, // connected, waiting for the subscriptions to be acknowledged
+    Connected = 3
+};
+
 class Network
 {
 public:
@@ -20,24 +46,44 @@ public:
 
     void initialize();
     bool update();
-    void registerMqttReceiver(MqttReceiver* receiver);
     void reconfigureDevice();
     void setMqttPresencePath(char* path);
     void disableAutoRestarts(); // disable on OTA start
 
-    void subscribe(const char* path);
+    // Resolves a topic suffix (mqtt_topic_*) to the prefixed topic once, call during setup
+    TopicHandle registerTopic(const char* suffix);
+
+    // Messages on the topic are only delivered to receiver. The topic may contain the wildcards + and #.
+    void subscribe(const TopicHandle topic, MqttReceiver* receiver);
     void initTopic(const char* path, const char* value);
+    // Retained state, while the broker is slow or unreachable only the latest value per topic stays queued
+    void publishFloat(const TopicHandle topic, const float value, const uint8_t precision = 2);
+    void publishInt(const TopicHandle topic, const int value);
+    void publishUInt(const TopicHandle topic, const unsigned int value);
+    void publishULong(const TopicHandle topic, const unsigned long value);
+    void publishBool(const TopicHandle topic, const bool value);
+    bool publishString(const TopicHandle topic, const char* value);
+    void publishPin(const TopicHandle topic, int value);
+    // Every message is queued, e.g. alerts that share a topic
+    bool publishEvent(const TopicHandle topic, const char* value);
+
+    // For topics containing an address or id, they are prefixed on every call
     void publishFloat(const char* topic, const float value, const uint8_t precision = 2);
-    void publishInt(const char* topic, const int value);
-    void publishUInt(const char* topic, const unsigned int value);
-    void publishULong(const char* topic, const unsigned long value);
-    void publishBool(const char* topic, const bool value);
-    bool publishString(const char* topic, const char* value);
-    void publishPin(const char* topic, int value);
+    bool publishString(const char* topic, const char* value, const PublishClass publishClass = PublishClass::Telemetry);
+
+    bool publishPresencePage(const int page, espMqttClientTypes::SharedPayload* payload, uint32_t messageExpiry);
+    void publishPresencePageCount(const int count);
+    // Answers to presence queries aren't retained, they are only meant for whoever asked
+    bool publishQueryAnswer(const char* id, const int page, espMqttClientTypes::SharedPayload* payload);
+    void publishQueryAnswerPageCount(const char* id, const int count);
 
-    void publishPresenceDetection(char* csv);
+    const PublishClassStats publishStats(const PublishClass publishClass);
 
     int mqttConnectionState(); // 0 = not connected; 1 = connected; 2 = connected and mqtt processed
+    const MqttConnectState mqttConnectState() const;
+    unsigned int mqttConnectFailures() const; // failed attempts since the last successful connect
+    unsigned int mqttReconnectCount() const; // successful connects since boot
+    unsigned long mqttNextReconnectIn() const; // ms until the next attempt, 0 when connected or due
     bool encryptionSupported();
     const String networkDeviceName() const;
 
@@ -45,54 +91,76 @@ public:
 
     uint16_t subscribe(const char* topic, uint8_t qos);
 
-    void setKeepAliveCallback(std::function<void()> reconnectTick);
     void addReconnectedCallback(std::function<void()> reconnectedCallback);
 
-    bool comparePrefixedPath(const char* fullPath, const char* subPath);
+    bool comparePrefixedPath(const char* fullPath, const TopicHandle topic);
 
 private:
     static void onMqttDataReceivedCallback(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total);
     void onMqttDataReceived(const espMqttClientTypes::MessageProperties& properties, const char* topic, const uint8_t* payload, size_t len, size_t index, size_t total);
     void setupDevice();
-    bool reconnect();
+    // Advances the MQTT connection without blocking, returns true while connected
+    bool updateMqttConnection(const unsigned long ts);
+    void startMqttConnect(const unsigned long ts);
+    void onMqttConnected(const unsigned long ts);
+    void subscribeTopics(const size_t first);
+    void scheduleReconnect(const unsigned long ts);
 
     void onMqttConnect(const bool& sessionPresent);
     void onMqttDisconnect(const espMqttClientTypes::DisconnectReason& reason);
+    void onMqttSubscribe(const uint16_t packetId, const espMqttClientTypes::SubscribeReturncode* returncodes, const size_t len);
 
-    void buildMqttPath(const char* path, char* outPath);
+    bool publish(const TopicHandle topic, const char* value, const PublishClass publishClass = PublishClass::Telemetry);
+    void buildPresencePagePath(const int page, char* outPath);
+    void buildQueryAnswerPath(const char* id, const char* page, char* outPath);
 
     static Network* _inst;
     Preferences* _preferences;
     String _hostname;
     char _hostnameArr[101] = {0};
     NetworkDevice* _device = nullptr;
-    int _mqttConnectionState = 0;
-    bool _connectReplyReceived = false;
-
+    MqttConnectState _mqttConnectState = MqttConnectState::Idle;
+    volatile bool _connectReplyReceived = false;
+    volatile bool _sessionPresent = false;
+    volatile uint16_t _lastSubAckPacketId = 0;
+    uint16_t _lastSubscribePacketId = 0; // 0 if nothing waits for a SUBACK
+    size_t _sessionSubscribedCount = 0; // entries of _subscribedTopics the broker session holds
+    size_t _pendingSubscribedCount = 0;
+    unsigned long _connectStateTs = 0;
     unsigned long _nextReconnect = 0;
+    unsigned int _mqttConnectFailures = 0;
+    unsigned int _mqttReconnectCount = 0;
     char _mqttBrokerAddr[101] = {0};
     char _mqttUser[31] = {0};
     char _mqttPass[31] = {0};
     char _mqttPresencePrefix[181] = {0};
-    char _mqttPath[181] = {0};
+    TopicRegistry _topics;
+    TopicHandle _topicPresence;
+    TopicHandle _topicPresenceAnswers;
+    TopicHandle _topicPresencePages;
+    TopicHandle _topicWifiRssi;
+    TopicHandle _topicUptime;
+    TopicHandle _topicFreeHeap;
+    TopicHandle _topicRestartReasonFw;
+    TopicHandle _topicRestartReasonEsp;
     int _networkTimeout = 0;
-    std::vector<MqttReceiver*> _mqttReceivers;
-    char* _presenceCsv = nullptr;
+    TopicDispatcher _dispatcher;
+    PublishScheduler _scheduler;
+    int _presencePageCount = 0;
     bool _restartOnDisconnect = false;
     bool _firstConnect = true;
     bool _publishDebugInfo = false;
-    std::vector<String> _subscribedTopics;
+    std::vector<TopicHandle> _subscribedTopics;
     std::map<String, String> _initTopics;
 
     unsigned long _lastConnectedTs = 0;
     unsigned long _lastMaintenanceTs = 0;
     unsigned long _lastRssiTs = 0;
     long _rssiPublishInterval = 0;
-    std::function<void()> _keepAliveCallback = nullptr;
     std::vector<std::function<void()>> _reconnectedCallbacks;
     const IPConfiguration _ipConfiguration;
 
-    std::map<const char*, int> _pinStates;
+    std::map<TopicHandle, int> _pinStates;
 
     NetworkDeviceType _networkDeviceType  = (NetworkDeviceType)-1;
 
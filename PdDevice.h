@@ -0,0 +1,54 @@
+#pragma once
+
+#include <stdint.h>
+
+#define rssi_median_window 5
+
+#define pd_device_flag_rssi 0x01
+#define pd_device_flag_classified 0x02
+// ProximityZone of the device
+#define pd_device_zone_mask 0x0C
+#define pd_device_zone_shift 2
+// Generation of the pending PresenceStateMachine deadline, older entries are stale
+#define pd_device_schedule_mask 0xF0
+#define pd_device_schedule_step 0x10
+
+// Only one filter runs per node, so its states can share memory
+union RssiFilterState
+{
+    struct
+    {
+        float value;
+        float variance; // Kalman
+    } estimate; // EMA, Kalman
+
+    struct
+    {
+        int8_t ring[rssi_median_window];
+        uint8_t index;
+        uint8_t count;
+    } median;
+};
+
+// Kept small so the heap can hold many devices. The address is the key of the DeviceMap
+// and the name lives in the NameTable. 36 bytes on ESP32, 48 per DeviceMap entry: about half
+// the 96 bytes a device took when the record held its address and name text in a std::map node.
+struct PdDevice
+{
+    uint32_t timestamp = 0; // millis() of the last advertisement
+    uint32_t nameReport = 0; // number of the first report that carried the name (CBOR format)
+    uint32_t stateTs = 0; // millis() of the last presence state change
+    RssiFilterState filter = {};
+    uint16_t nameId = 0; // NameTable id, name_table_no_name until a name was received
+    uint16_t interval = 0; // median ms between advertisements, 0 if unknown
+    int16_t intervalStep = 0; // IntervalEstimator state
+    uint16_t jitter = 0; // mean absolute deviation of the interval in ms
+    int8_t rssi = 0;
+    int8_t smoothedRssi = 0;
+    int8_t measuredPower = 0; // calibrated RSSI at 1 m, 0 if unknown
+    uint8_t flags = 0;
+    uint8_t vendor = 0; // DeviceClassifier vendor id, 0 if unknown
+    uint8_t deviceClass = 0; // DeviceClass
+    uint8_t state = 0; // PresenceState
+    uint8_t profile = 0; // PresenceStateMachine profile
+};
@@ -9,6 +9,7 @@
 #define preference_mqtt_ca "mqttca"
 #define preference_mqtt_crt "mqttcrt"
 #define preference_mqtt_key "mqttkey"
+#define preference_mqtt_v5 "mqttv5"
 #define preference_hostname "hostname"
 #define preference_network_timeout "nettmout"
 #define preference_restart_on_disconnect "restdisc"
@@ -17,6 +18,29 @@
 #define preference_cred_password "crdpass"
 #define preference_gpio_enabled "gpioena"
 #define preference_presence_detection_timeout "prdtimeout"
+#define preference_presence_format_cbor "prdcbor"
+#define preference_presence_latency_budget "prdlatency"
+#define preference_presence_min_interval "prdminint"
+#define preference_presence_max_interval "prdmaxint"
+#define preference_presence_dirty_threshold "prddirty"
+#define preference_presence_snapshot "prdsnap"
+#define preference_presence_snapshot_interval "prdsnapint"
+#define preference_presence_irks "prdirks"
+#define preference_presence_beacon_identity "prdbcnid"
+#define preference_presence_classify "prdclass"
+#define preference_presence_grace_intervals "prdgrace"
+#define preference_presence_profiles "prdprof"
+#define preference_presence_zones "prdzones"
+#define preference_presence_max_rate "prdmaxrate"
+#define preference_presence_report_intervals "prdrepint"
+#define preference_presence_broadcast_disabled "prdnobcast"
+#define preference_rssi_filter "rssifilter"
+#define preference_sensors_enabled "sensorsena"
+#define preference_crowd_enabled "crowdena"
+#define preference_crowd_near_rssi "crowdnear"
+#define preference_crowd_publish_interval "crowdint"
+#define preference_rssi_measured_power "rssipower"
+#define preference_rssi_path_loss_exponent "rssiplexp"
 #define preference_has_mac_saved "hasmac"
 #define preference_has_mac_byte_0 "macb0"
 #define preference_has_mac_byte_1 "macb1"
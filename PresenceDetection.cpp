@@ -1,12 +1,32 @@
 #include "PresenceDetection.h"
 #include "PreferencesKeys.h"
+#include "MqttTopics.h"
+#include "Logger.h"
+#include "esp_system.h"
+#include "IntervalEstimator.h"
 
-PresenceDetection::PresenceDetection(Preferences* preferences, BleScanner::Scanner *bleScanner, Network* network)
+static_assert(presence_query_max_length <= mqtt_max_inbound_payload_length, "Presence queries have to fit the MQTT receive buffer");
+
+static PresenceDetection* shutdownInstance = nullptr;
+
+static void onShutdown()
+{
+    // Runs from esp_restart(), which all controlled restarts go through
+    if(shutdownInstance != nullptr)
+    {
+        shutdownInstance->saveSnapshot();
+    }
+}
+
+PresenceDetection::PresenceDetection(Preferences* preferences, BeaconDecoder* beaconDecoder, Network* network, Gpio* gpio)
 : _preferences(preferences),
-  _bleScanner(bleScanner),
+  _beaconDecoder(beaconDecoder),
   _network(network)
 {
-    _csv = new char[presence_detection_buffer_size];
+    _devicesMutex = xSemaphoreCreateMutex();
+
+    _rateAlertTopic = _network->registerTopic(mqtt_topic_presence_rate_alert);
+    _queryTopic = _network->registerTopic(mqtt_topic_presence_query);
 
     _timeout = _preferences->getInt(preference_presence_detection_timeout) * 1000;
     if(_timeout == 0)
@@ -17,17 +37,154 @@ PresenceDetection::PresenceDetection(Preferences* preferences, BleScanner::Scann
 
     Serial.print(F("Presence detection timeout (ms): "));
     Serial.println(_timeout);
+
+    _latencyBudget = _preferences->getInt(preference_presence_latency_budget);
+    if(_latencyBudget <= 0)
+    {
+        _latencyBudget = 20;
+        _preferences->putInt(preference_presence_latency_budget, _latencyBudget);
+    }
+
+    _minInterval = _preferences->getInt(preference_presence_min_interval);
+    if(_minInterval <= 0)
+    {
+        _minInterval = 100;
+        _preferences->putInt(preference_presence_min_interval, _minInterval);
+    }
+
+    _maxInterval = _preferences->getInt(preference_presence_max_interval);
+    if(_maxInterval <= 0)
+    {
+        _maxInterval = 2000;
+        _preferences->putInt(preference_presence_max_interval, _maxInterval);
+    }
+
+    _dirtyThreshold = _preferences->getInt(preference_presence_dirty_threshold);
+    if(_dirtyThreshold == 0)
+    {
+        _dirtyThreshold = 50;
+        _preferences->putInt(preference_presence_dirty_threshold, _dirtyThreshold);
+    }
+
+    int measuredPower = _preferences->getInt(preference_rssi_measured_power);
+    if(measuredPower == 0)
+    {
+        measuredPower = rssi_default_measured_power;
+        _preferences->putInt(preference_rssi_measured_power, measuredPower);
+    }
+
+    int pathLossExponent = _preferences->getInt(preference_rssi_path_loss_exponent);
+    if(pathLossExponent <= 0)
+    {
+        pathLossExponent = 20;
+        _preferences->putInt(preference_rssi_path_loss_exponent, pathLossExponent);
+    }
+
+    RssiFilterType filterType = (RssiFilterType)_preferences->getInt(preference_rssi_filter);
+    _rssiEstimator = new RssiEstimator(filterType, measuredPower, pathLossExponent / 10.0f);
+
+    _broadcast = !_preferences->getBool(preference_presence_broadcast_disabled);
+    _trackBeaconIdentity = _preferences->getBool(preference_presence_beacon_identity);
+    _classify = _preferences->getBool(preference_presence_classify);
+
+    _rpaResolver = new RpaResolver();
+    int irkCount = _rpaResolver->loadKeys(_preferences->getString(preference_presence_irks).c_str());
+    if(irkCount > 0)
+    {
+        Serial.print(F("Identity resolving keys: "));
+        Serial.println(irkCount);
+    }
+
+    int graceIntervals = _preferences->getInt(preference_presence_grace_intervals);
+    if(graceIntervals == 0)
+    {
+        graceIntervals = 10;
+        _preferences->putInt(preference_presence_grace_intervals, graceIntervals);
+    }
+    _stateMachine = new PresenceStateMachine(&_devices, _timeout, graceIntervals > 0 ? (graceIntervals > 255 ? 255 : graceIntervals) : 0);
+    int profileCount = _stateMachine->loadProfiles(_preferences->getString(preference_presence_profiles).c_str());
+    if(profileCount > 0)
+    {
+        Serial.print(F("Presence profiles: "));
+        Serial.println(profileCount);
+    }
+
+    _zones = new ProximityZones(gpio);
+
+    // Devices that are away for long are dropped, private addresses rotate and would be kept forever otherwise
+    _stateMachine->setEvictCallback([this](const long long address, PdDevice& device)
+    {
+        _zones->remove(address);
+        _names.release(device.nameId);
+        _snapshotDirty = true;
+    });
+    int zoneRuleCount = _zones->loadRules(_preferences->getString(preference_presence_zones).c_str());
+    if(zoneRuleCount > 0)
+    {
+        Serial.print(F("Proximity zone rules: "));
+        Serial.println(zoneRuleCount);
+
+        // Devices that leave are out of every zone
+        _stateMachine->setStateCallback([this](const long long address, PdDevice& device)
+        {
+            _zones->update(address, device);
+        });
+    }
+
+    int maxRate = _preferences->getInt(preference_presence_max_rate);
+    if(maxRate == 0)
+    {
+        maxRate = 20;
+        _preferences->putInt(preference_presence_max_rate, maxRate);
+    }
+    _minAdvertisingInterval = maxRate > 0 ? 1000 / maxRate : 0;
+
+    bool reportIntervals = _preferences->getBool(preference_presence_report_intervals);
+    PresenceFormat format = _preferences->getBool(preference_presence_format_cbor) ? PresenceFormat::Cbor : PresenceFormat::Csv;
+    _serializer = new PresenceSerializer(&_devices, &_names, _rssiEstimator, _classify, reportIntervals, presence_detection_page_size, format);
+
+    int snapshotInterval = _preferences->getInt(preference_presence_snapshot_interval);
+    if(snapshotInterval == 0)
+    {
+        snapshotInterval = 15;
+        _preferences->putInt(preference_presence_snapshot_interval, snapshotInterval);
+    }
+    _snapshotInterval = snapshotInterval > 0 ? snapshotInterval * 60000 : 0;
+    _snapshot = new PresenceSnapshot(&_devices, &_names, _timeout);
 }
 
 PresenceDetection::~PresenceDetection()
 {
-    _bleScanner->unsubscribe(this);
-    _bleScanner = nullptr;
+    _beaconDecoder->unsubscribe(this);
+    _beaconDecoder = nullptr;
 
     _network = nullptr;
 
-    delete _csv;
-    _csv = nullptr;
+    if(shutdownInstance == this)
+    {
+        esp_unregister_shutdown_handler(onShutdown);
+        shutdownInstance = nullptr;
+    }
+
+    delete _serializer;
+    _serializer = nullptr;
+
+    delete _snapshot;
+    _snapshot = nullptr;
+
+    delete _rssiEstimator;
+    _rssiEstimator = nullptr;
+
+    delete _rpaResolver;
+    _rpaResolver = nullptr;
+
+    delete _stateMachine;
+    _stateMachine = nullptr;
+
+    delete _zones;
+    _zones = nullptr;
+
+    vSemaphoreDelete(_devicesMutex);
 }
 
 void PresenceDetection::initialize()
@@ -40,12 +197,31 @@ void PresenceDetection::initialize()
         _preferences->putInt(preference_restart_ble_beacon_lost, _restartBeaconTimeout);
     }
 
-    _bleScanner->subscribe(this);
+    if(_timeout >= 0 && _snapshotInterval > 0)
+    {
+        restoreSnapshot();
+
+        shutdownInstance = this;
+        esp_register_shutdown_handler(onShutdown);
+    }
+
+    if(_timeout >= 0)
+    {
+        _network->subscribe(_queryTopic, this);
+    }
+
+    _beaconDecoder->subscribe(this);
 }
 
 void PresenceDetection::update()
 {
-    delay(2000);
+    if(_taskHandle == nullptr)
+    {
+        _taskHandle = xTaskGetCurrentTaskHandle();
+    }
+
+    // Sleep until the scan path signals an arrival or the dirty threshold, or until the next deadline
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(nextWakeDelay(millis())));
 
     unsigned long ts = millis();
 
@@ -62,75 +238,397 @@ void PresenceDetection::update()
     }
 
     if(_timeout < 0) return;
-    memset(_csv, 0, presence_detection_buffer_size);
 
-    if(_devices.size() == 0)
+    publishZoneEvents();
+    publishRateAlerts();
+    publishQueryAnswers();
+
+    if(_snapshotInterval > 0 && _snapshotDirty && ts - _lastSnapshotTs >= _snapshotInterval)
+    {
+        writeSnapshot(false, portMAX_DELAY);
+    }
+
+    if(!isReportDue(ts))
     {
-        strcpy(_csv, ";;");
-        _network->publishPresenceDetection(_csv);
         return;
     }
 
-    _csvIndex = 0;
-    for(auto it : _devices)
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+    _pendingEventTs = 0;
+    _dirtyCount = 0;
+    xSemaphoreGive(_devicesMutex);
+
+    _lastReportTs = ts;
+    if(_broadcast)
+    {
+        publishReport();
+    }
+}
+
+bool PresenceDetection::isReportDue(const unsigned long ts)
+{
+    bool maxIntervalElapsed = ts - _lastReportTs >= _maxInterval;
+    if(!maxIntervalElapsed && ts - _lastReportTs < _minInterval)
+    {
+        return false;
+    }
+
+    bool due = maxIntervalElapsed;
+
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+    if(_pendingEventTs != 0 && ts - _pendingEventTs >= _latencyBudget)
+    {
+        due = true;
+    }
+    if(_dirtyThreshold > 0 && _dirtyCount >= _dirtyThreshold)
+    {
+        due = true;
+    }
+    // Also when the maximum interval forces a report, so it doesn't list devices that have timed out
+    unsigned long deadline;
+    if(_stateMachine->nextDeadline(deadline) && (long)(ts - deadline) >= 0 && _stateMachine->processDeadlines(ts))
+    {
+        due = true;
+    }
+    xSemaphoreGive(_devicesMutex);
+
+    return due;
+}
+
+uint32_t PresenceDetection::nextWakeDelay(const unsigned long ts)
+{
+    unsigned long earliest = _lastReportTs + _minInterval;
+    unsigned long wakeTs = _lastReportTs + _maxInterval;
+
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+    if(_pendingEventTs != 0 && (long)(_pendingEventTs + _latencyBudget - wakeTs) < 0)
+    {
+        wakeTs = _pendingEventTs + _latencyBudget;
+    }
+    unsigned long deadline;
+    if(_stateMachine->nextDeadline(deadline) && (long)(deadline - wakeTs) < 0)
+    {
+        wakeTs = deadline;
+    }
+    if(_dirtyThreshold > 0 && _dirtyCount >= _dirtyThreshold)
+    {
+        wakeTs = ts;
+    }
+    xSemaphoreGive(_devicesMutex);
+
+    if((long)(wakeTs - earliest) < 0)
+    {
+        wakeTs = earliest;
+    }
+
+    long waitMs = (long)(wakeTs - ts);
+    return waitMs > 0 ? waitMs : 1;
+}
+
+void PresenceDetection::signalUpdate()
+{
+    if(_taskHandle != nullptr && _timeout >= 0)
+    {
+        xTaskNotifyGive(_taskHandle);
+    }
+}
+
+void PresenceDetection::publishReport()
+{
+    publishPages(PresenceQuery(), nextReportNumber());
+}
+
+void PresenceDetection::publishQueryAnswers()
+{
+    PresenceQuery query;
+
+    while(true)
+    {
+        xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+        if(_queryCount == 0)
+        {
+            xSemaphoreGive(_devicesMutex);
+            return;
+        }
+        query = _queries[0];
+        --_queryCount;
+        for(int i = 0; i < _queryCount; i++)
+        {
+            _queries[i] = _queries[i + 1];
+        }
+        xSemaphoreGive(_devicesMutex);
+
+        publishPages(query, 0);
+    }
+}
+
+void PresenceDetection::publishPages(const PresenceQuery& query, const uint32_t report)
+{
+    // Pages are measured and rendered from the live table in one go, neither reports nor answers copy the devices.
+    // The rendered page is handed to the MQTT client by reference, it's freed once the broker acknowledged it.
+    int page = 0;
+    long long startAddress = query.firstAddress();
+
+    while(startAddress >= 0)
     {
-        if(ts - _timeout < it.second.timestamp)
+        long long endAddress = 0;
+        long long nextAddress = -1;
+        espMqttClientTypes::SharedPayload* payload = nullptr;
+
+        xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+        unsigned long ts = millis();
+        size_t length = _serializer->measurePage(query, startAddress, ts, report, endAddress, nextAddress);
+        if(length > 0)
+        {
+            payload = espMqttClientTypes::SharedPayload::create(length);
+            if(payload != nullptr)
+            {
+                payload->setLength(_serializer->renderPage(payload->data(), length, query, startAddress, endAddress, ts, report));
+            }
+        }
+        else if(page == 0)
+        {
+            payload = espMqttClientTypes::SharedPayload::create(_serializer->emptyReportLength());
+            if(payload != nullptr)
+            {
+                payload->setLength(_serializer->buildEmptyReport(payload->data(), report));
+            }
+        }
+        xSemaphoreGive(_devicesMutex);
+
+        if(length == 0 && page > 0)
+        {
+            break;
+        }
+
+        bool success = payload != nullptr && publishPage(query, page, payload);
+        if(payload != nullptr)
         {
-            buildCsv(it.second);
+            payload->release();
         }
 
-        // Prevent csv buffer overflow
-        if(_csvIndex > presence_detection_buffer_size - (sizeof(it.second.name) + sizeof(it.second.address) + 10))
+        if(!success)
+        {
+            Log->print(F("Failed to publish presence page "));
+            Log->println(page);
+            return;
+        }
+
+        ++page;
+        if(length == 0)
         {
             break;
         }
+        startAddress = nextAddress;
     }
 
-    _csv[_csvIndex-1] = 0x00;
-    _network->publishPresenceDetection(_csv);
+    if(query.id()[0] != 0x00)
+    {
+        _network->publishQueryAnswerPageCount(query.id(), page);
+    }
+    else
+    {
+        _network->publishPresencePageCount(page);
+    }
+}
+
+bool PresenceDetection::publishPage(const PresenceQuery& query, const int page, espMqttClientTypes::SharedPayload* payload)
+{
+    if(query.id()[0] != 0x00)
+    {
+        return _network->publishQueryAnswer(query.id(), page, payload);
+    }
+    uint32_t messageExpiry = 3 * _maxInterval / 1000;
+    if(messageExpiry < presence_page_min_expiry)
+    {
+        messageExpiry = presence_page_min_expiry;
+    }
+    return _network->publishPresencePage(page, payload, messageExpiry);
+}
+
+void PresenceDetection::publishZoneEvents()
+{
+    if(!_zones->enabled())
+    {
+        return;
+    }
+
+    // <prefix>/presence/zones/<address> keeps the current zone of each device, retained
+    char topic[40];
+    ProximityEvent event;
+
+    while(true)
+    {
+        xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+        bool haveEvent = _zones->popEvent(event);
+        xSemaphoreGive(_devicesMutex);
+
+        if(!haveEvent)
+        {
+            return;
+        }
+
+        snprintf(topic, sizeof(topic), "%s/%012llx", mqtt_topic_presence_zones, event.address);
+        _network->publishString(topic, ProximityZones::zoneName(event.zone), PublishClass::Presence);
+    }
 }
 
+bool PresenceDetection::queueRateAlert(const long long address, const PdDevice& device, const uint16_t previousInterval)
+{
+    // Only crossing the limit raises an alert, not every advertisement of a device that keeps flooding
+    bool wasFlooding = previousInterval != 0 && previousInterval < _minAdvertisingInterval;
+    bool flooding = device.interval != 0 && device.interval < _minAdvertisingInterval;
+    if(!flooding || wasFlooding || _rateAlertCount == presence_rate_alert_queue_size)
+    {
+        return false;
+    }
+
+    _rateAlerts[_rateAlertCount] = { address, device.interval };
+    ++_rateAlertCount;
+    return true;
+}
 
-void PresenceDetection::buildCsv(const PdDevice &device)
+void PresenceDetection::publishRateAlerts()
 {
-    for(int i = 0; i < 17; i++)
+    // <prefix>/presence/alerts/rate: address;advertisements per second
+    char payload[30];
+    RateAlert alert;
+
+    while(true)
     {
-        _csv[_csvIndex] = device.address[i];
-        ++_csvIndex;
+        xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+        if(_rateAlertCount == 0)
+        {
+            xSemaphoreGive(_devicesMutex);
+            return;
+        }
+        alert = _rateAlerts[--_rateAlertCount];
+        xSemaphoreGive(_devicesMutex);
+
+        int length = snprintf(payload, sizeof(payload), "%012llx;", alert.address);
+        dtostrf(1000.0f / alert.interval, 0, 1, &payload[length]);
+        _network->publishEvent(_rateAlertTopic, payload);
     }
-    _csv[_csvIndex] = ';';
-    ++_csvIndex;
+}
 
-    int i=0;
-    while(device.name[i] != 0x00 && i < 30)
+uint32_t PresenceDetection::nextReportNumber()
+{
+    // 0 is reserved for "name not reported yet"
+    ++_reportNumber;
+    if(_reportNumber == 0)
     {
-        _csv[_csvIndex] = device.name[i];
-        ++_csvIndex;
-        ++i;
+        _reportNumber = 1;
     }
+    return _reportNumber;
+}
 
-    _csv[_csvIndex] = ';';
-    ++_csvIndex;
+void PresenceDetection::saveSnapshot()
+{
+    // Don't hold up the restart if the scan callback is stuck with the lock
+    writeSnapshot(true, pdMS_TO_TICKS(200));
+}
 
-    if(device.hasRssi)
+void PresenceDetection::restoreSnapshot()
+{
+    size_t length = _preferences->getBytesLength(preference_presence_snapshot);
+    if(length == 0 || length > presence_snapshot_max_size)
     {
-        char rssiStr[20] = {0};
-        itoa(device.rssi, rssiStr, 10);
+        return;
+    }
+
+    uint8_t* data = new uint8_t[length];
+    _preferences->getBytes(preference_presence_snapshot, data, length);
 
-        int i=0;
-        while(rssiStr[i] != 0x00 && i < 20)
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+    unsigned long ts = millis();
+    int restored = _snapshot->restore(data, length, ts);
+    if(restored > 0)
+    {
+        // Devices restored as present are published with the first report and leave after their grace period if not seen
+        for(auto& it : _devices)
         {
-            _csv[_csvIndex] = rssiStr[i];
-            ++_csvIndex;
-            ++i;
+            _stateMachine->assignProfile(it.first, it.second);
+            _stateMachine->track(it.first, it.second);
         }
+        _pendingEventTs = ts;
+    }
+    xSemaphoreGive(_devicesMutex);
+
+    if(restored < 0)
+    {
+        Log->println(F("Presence snapshot invalid, discarded"));
+    }
+    else
+    {
+        Log->print(F("Restored devices from presence snapshot: "));
+        Log->println(restored);
+        _snapshotChecksum = (data[length - 2] << 8) | data[length - 1];
+    }
+
+    delete[] data;
+
+    // Replace a snapshot taken before a controlled restart, so it isn't restored as present again after a crash
+    if(restored > 0)
+    {
+        writeSnapshot(false, portMAX_DELAY);
+    }
+}
+
+void PresenceDetection::writeSnapshot(const bool clean, const TickType_t lockTimeout)
+{
+    uint8_t* data = new uint8_t[presence_snapshot_max_size];
+
+    if(xSemaphoreTake(_devicesMutex, lockTimeout) != pdTRUE)
+    {
+        delete[] data;
+        return;
+    }
+    unsigned long ts = millis();
+    size_t length = _snapshot->build(data, presence_snapshot_max_size, clean);
+    _snapshotDirty = false;
+    xSemaphoreGive(_devicesMutex);
+
+    _lastSnapshotTs = ts;
+
+    // Flash only wears when the known devices actually changed, NVS spreads the writes over its pages
+    uint16_t checksum = (data[length - 2] << 8) | data[length - 1];
+    if(checksum != _snapshotChecksum)
+    {
+        _preferences->putBytes(preference_presence_snapshot, data, length);
+        _snapshotChecksum = checksum;
     }
 
-    _csv[_csvIndex] = '\n';
-    _csvIndex++;
+    delete[] data;
 }
 
-void PresenceDetection::onResult(NimBLEAdvertisedDevice *device)
+bool PresenceDetection::updateName(PdDevice& pdDevice, const std::string& name)
+{
+    if(_names.equals(pdDevice.nameId, name.c_str(), name.length()))
+    {
+        return false;
+    }
+
+    _names.release(pdDevice.nameId);
+    pdDevice.nameId = _names.intern(name.c_str(), name.length());
+    pdDevice.nameReport = 0;
+    return true;
+}
+
+void PresenceDetection::classify(PdDevice& pdDevice, NimBLEAdvertisedDevice* device, const long long address)
+{
+    // Cached in the device record, so the tables aren't searched for every advertisement
+    uint8_t vendor = 0;
+    DeviceClass deviceClass = DeviceClass::Unknown;
+    bool publicAddress = device->getAddress().getType() == BLE_ADDR_PUBLIC;
+
+    DeviceClassifier::classify(device->getPayload(), device->getPayloadLength(), address, publicAddress, vendor, deviceClass);
+
+    pdDevice.vendor = vendor;
+    pdDevice.deviceClass = (uint8_t)deviceClass;
+    pdDevice.flags |= pd_device_flag_classified;
+}
+
+void PresenceDetection::onResult(NimBLEAdvertisedDevice *device, const Beacon* beacon)
 {
     std::string addressStr = device->getAddress().toString();
     char addrArrComp[13] = {0};
@@ -138,6 +636,8 @@ void PresenceDetection::onResult(NimBLEAdvertisedDevice *device)
     _lastBeaconTs = millis();
 //    Serial.println(addressStr.c_str());
 
+    if(_timeout < 0) return;
+
     addrArrComp[0] = addressStr.at(0);
     addrArrComp[1] = addressStr.at(1);
     addrArrComp[2] = addressStr.at(3);
@@ -152,52 +652,171 @@ void PresenceDetection::onResult(NimBLEAdvertisedDevice *device)
     addrArrComp[11] = addressStr.at(16);
 
     long long addr = strtoll(addrArrComp, nullptr, 16);
+    long long deviceAddress = addr;
+
+    // Track phones rotating their private address by identity. Resolved (or not) addresses are cached,
+    // so each address costs AES operations only once.
+    if(device->getAddress().getType() == BLE_ADDR_RANDOM)
+    {
+        addr = _rpaResolver->resolve(addr);
+    }
+
+    // Beacons can be tracked by their id instead of their address, they are named after the id then
+    std::string name;
+    bool haveName = false;
+    if(_trackBeaconIdentity && beacon != nullptr && beacon->identity != 0)
+    {
+        addr = beacon->identity;
+
+        char identity[name_table_max_length + 1];
+        size_t identityLength = beacon->formatIdentity(identity, sizeof(identity));
+        if(identityLength > 0)
+        {
+            name.assign(identity, identityLength);
+            haveName = true;
+        }
+    }
+    else if(device->haveName())
+    {
+        name = device->getName();
+        haveName = true;
+    }
+
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+
+    unsigned long ts = millis();
+    bool signal = false;
+    bool eventQueued = false;
 
     auto it = _devices.find(addr);
     if(it == _devices.end())
     {
+        // While every tracked device is present or arriving, new devices aren't tracked
+        if(_devices.size() >= presence_max_devices && !_stateMachine->evictOldest(ts))
+        {
+            xSemaphoreGive(_devicesMutex);
+            return;
+        }
 
         PdDevice pdDevice;
 
-        int i=0;
-        size_t len = addressStr.length();
-        while(i < len)
+        _rssiEstimator->calibrate(pdDevice, device, beacon);
+        if(device->haveRSSI())
         {
-            pdDevice.address[i] = addressStr.at(i);
-            ++i;
+            _rssiEstimator->update(pdDevice, device->getRSSI());
         }
 
-        if(device->haveRSSI())
+        if(haveName)
         {
-            pdDevice.hasRssi = true;
-            pdDevice.rssi = device->getRSSI();
+            updateName(pdDevice, name);
         }
 
-        std::string nameStr = "-";
-        if(device->haveName())
+        if(_classify)
         {
-            std::string nameStr = device->getName();
-
-            i=0;
-            len = nameStr.length();
-            while(i < len && i < sizeof(pdDevice.name)-1)
-            {
-                pdDevice.name[i] = nameStr.at(i);
-                ++i;
-            }
+            classify(pdDevice, device, deviceAddress);
+        }
 
-            pdDevice.timestamp = millis();
+        _stateMachine->assignProfile(addr, pdDevice);
+        bool arrived = _stateMachine->onAdvertisement(addr, pdDevice, ts);
+        eventQueued = _zones->enabled() && _zones->update(addr, pdDevice);
 
-            _devices[addr] = pdDevice;
+        _devices[addr] = pdDevice;
+        _snapshotDirty = true;
+        if(arrived)
+        {
+            signal = onArrival(ts);
         }
     }
     else
     {
-        it->second.timestamp = millis();
+        // The beacon frame or TX power level can arrive after the device was added, e.g. with the scan response
+        if(it->second.measuredPower == 0)
+        {
+            _rssiEstimator->calibrate(it->second, device, beacon);
+        }
         if(device->haveRSSI())
         {
-            it->second.hasRssi = true;
-            it->second.rssi = device->getRSSI();
+            _rssiEstimator->update(it->second, device->getRSSI());
+        }
+
+        // The name often only arrives with the scan response, after the device was added
+        bool renamed = haveName && updateName(it->second, name);
+        if(renamed)
+        {
+            _snapshotDirty = true;
+        }
+
+        // The scan response adds its data to the payload, so it gets a second look. Devices restored
+        // from a snapshot are classified when they are seen for the first time.
+        if(_classify && (renamed || !(it->second.flags & pd_device_flag_classified)))
+        {
+            classify(it->second, device, deviceAddress);
+            _stateMachine->assignProfile(addr, it->second);
+        }
+
+        uint16_t previousInterval = it->second.interval;
+        bool arrived = _stateMachine->onAdvertisement(addr, it->second, ts);
+        eventQueued = _zones->enabled() && _zones->update(addr, it->second);
+        if(_minAdvertisingInterval > 0 && queueRateAlert(addr, it->second, previousInterval))
+        {
+            eventQueued = true;
+        }
+
+        if(arrived || (renamed && PresenceStateMachine::isPresent(it->second)))
+        {
+            signal = onArrival(ts);
+        }
+        else
+        {
+            ++_dirtyCount;
+            signal = _dirtyCount == _dirtyThreshold;
         }
     }
-}
\ No newline at end of file
+
+    xSemaphoreGive(_devicesMutex);
+
+    // Zone changes and rate alerts are published right away, they aren't batched with the reports
+    if(signal || eventQueued)
+    {
+        signalUpdate();
+    }
+}
+
+void PresenceDetection::onMqttDataReceived(const TopicHandle subscription, const char* topic, byte* payload, const unsigned int length)
+{
+    PresenceQuery query;
+    if(!query.parse((const char*)payload))
+    {
+        Log->print(F("Invalid presence query: "));
+        Log->println((const char*)payload);
+        return;
+    }
+
+    xSemaphoreTake(_devicesMutex, portMAX_DELAY);
+    bool queued = _queryCount < presence_query_queue_size;
+    if(queued)
+    {
+        _queries[_queryCount] = query;
+        ++_queryCount;
+    }
+    xSemaphoreGive(_devicesMutex);
+
+    if(!queued)
+    {
+        Log->println(F("Presence query queue full, query dropped"));
+        return;
+    }
+
+    signalUpdate();
+}
+
+bool PresenceDetection::onArrival(const unsigned long ts)
+{
+    // Only the first event opens the batching window, later ones are published with it
+    if(_pendingEventTs == 0)
+    {
+        _pendingEventTs = ts;
+        return true;
+    }
+    return false;
+}
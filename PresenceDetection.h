@@ -1,41 +1,103 @@
 #pragma once
 
-#include "BleScanner.h"
-#include "BleInterfaces.h"
+#include "BeaconDecoder.h"
 #include "Network.h"
+#include "Config.h"
+#include "DeviceMap.h"
+#include "NameTable.h"
+#include "PresenceSerializer.h"
+#include "PresenceSnapshot.h"
+#include "RssiEstimator.h"
+#include "RpaResolver.h"
+#include "PresenceStateMachine.h"
+#include "ProximityZones.h"
+#include "Gpio.h"
 
-struct PdDevice
-{
-    char address[18] = {0};
-    char name[30] = {0};
-    unsigned long timestamp = 0;
-    int rssi = 0;
-    bool hasRssi = false;
-};
+// Each page is held by the MQTT client until the broker acknowledged it, one TCP segment per page keeps that bounded
+#define presence_detection_page_size (EMC_TX_BUFFER_SIZE < EMC_RX_BUFFER_SIZE ? EMC_TX_BUFFER_SIZE : EMC_RX_BUFFER_SIZE)
+// Devices that started advertising faster than allowed, until the presence task publishes them
+#define presence_rate_alert_queue_size 8
+// Minimum seconds retained presence pages outlive the last report on MQTT 5 brokers, three report intervals if longer
+#define presence_page_min_expiry 60
 
-#define presence_detection_buffer_size 4096
-
-class PresenceDetection : public BleScanner::Subscriber
+class PresenceDetection : public BeaconSubscriber, public MqttReceiver
 {
 public:
-    PresenceDetection(Preferences* preferences, BleScanner::Scanner* bleScanner, Network* network);
+    PresenceDetection(Preferences* preferences, BeaconDecoder* beaconDecoder, Network* network, Gpio* gpio);
     virtual ~PresenceDetection();
 
     void initialize();
     void update();
 
-    void onResult(NimBLEAdvertisedDevice* advertisedDevice) override;
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) override;
+    void onMqttDataReceived(const TopicHandle subscription, const char* topic, byte* payload, const unsigned int length) override;
+
+    // Persists the known devices before a controlled restart, they are restored as present after booting
+    void saveSnapshot();
 
 private:
-    void buildCsv(const PdDevice& device);
+    bool isReportDue(const unsigned long ts);
+    uint32_t nextWakeDelay(const unsigned long ts);
+    bool onArrival(const unsigned long ts);
+    void signalUpdate();
+    bool updateName(PdDevice& pdDevice, const std::string& name);
+    void classify(PdDevice& pdDevice, NimBLEAdvertisedDevice* device, const long long address);
+    void restoreSnapshot();
+    void writeSnapshot(const bool clean, const TickType_t lockTimeout);
+    void publishReport();
+    void publishQueryAnswers();
+    void publishPages(const PresenceQuery& query, const uint32_t report);
+    bool publishPage(const PresenceQuery& query, const int page, espMqttClientTypes::SharedPayload* payload);
+    void publishZoneEvents();
+    bool queueRateAlert(const long long address, const PdDevice& device, const uint16_t previousInterval);
+    void publishRateAlerts();
+    uint32_t nextReportNumber();
 
     Preferences* _preferences;
-    BleScanner::Scanner* _bleScanner;
+    BeaconDecoder* _beaconDecoder;
     Network* _network;
+    TopicHandle _rateAlertTopic;
+    TopicHandle _queryTopic;
+    PresenceSerializer* _serializer = nullptr;
+    PresenceSnapshot* _snapshot = nullptr;
+    RssiEstimator* _rssiEstimator = nullptr;
+    RpaResolver* _rpaResolver = nullptr;
+    PresenceStateMachine* _stateMachine = nullptr;
+    ProximityZones* _zones = nullptr;
+    bool _trackBeaconIdentity = false;
+    bool _classify = false;
+    SemaphoreHandle_t _devicesMutex;
+    TaskHandle_t _taskHandle = nullptr;
     int _restartBeaconTimeout = 0; // seconds
     int _lastBeaconTs = 1;
-    char* _csv = {0};
-    std::map<long long, PdDevice> _devices;
+    DeviceMap _devices;
+    NameTable _names;
     int _timeout = 20000;
-    int _csvIndex = 0;
+    uint32_t _reportNumber = 0;
+
+    unsigned long _latencyBudget = 20; // ms an event may wait to be batched with others
+    unsigned long _minInterval = 100;
+    unsigned long _maxInterval = 2000;
+    int _dirtyThreshold = 50; // RSSI updates that trigger a report, -1 to disable
+    bool _broadcast = true; // publish periodic reports, otherwise presence is only published on query
+    unsigned long _lastReportTs = 0;
+    unsigned long _pendingEventTs = 0; // first unreported arrival, 0 if none
+    int _dirtyCount = 0;
+
+    uint16_t _minAdvertisingInterval = 0; // ms, devices advertising faster are reported, 0 if disabled
+    struct RateAlert
+    {
+        long long address;
+        uint16_t interval;
+    };
+    RateAlert _rateAlerts[presence_rate_alert_queue_size];
+    uint8_t _rateAlertCount = 0;
+
+    PresenceQuery _queries[presence_query_queue_size];
+    uint8_t _queryCount = 0;
+
+    unsigned long _snapshotInterval = 0; // ms, 0 if disabled
+    unsigned long _lastSnapshotTs = 0;
+    uint16_t _snapshotChecksum = 0; // of the stored snapshot, unchanged snapshots aren't written again
+    bool _snapshotDirty = false; // devices were added or renamed since the last snapshot
 };
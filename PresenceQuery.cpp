@@ -0,0 +1,135 @@
+#include "PresenceQuery.h"
+#include "PresenceStateMachine.h"
+#include "ProximityZones.h"
+#include <string.h>
+#include <limits.h>
+
+bool PresenceQuery::parse(const char* request)
+{
+    const char* typeStart = strchr(request, ';');
+    if(typeStart == nullptr || typeStart == request || typeStart - request > presence_query_max_id_length)
+    {
+        return false;
+    }
+
+    for(const char* c = request; c < typeStart; c++)
+    {
+        if(!isalnum(*c) && *c != '-' && *c != '_')
+        {
+            return false;
+        }
+    }
+
+    const char* argument = strchr(typeStart + 1, ';');
+    if(argument == nullptr || argument[1] == 0x00)
+    {
+        return false;
+    }
+    ++argument;
+
+    size_t typeLength = argument - 1 - (typeStart + 1);
+    const char* type = typeStart + 1;
+
+    if(typeLength == 3 && strncmp(type, "mac", 3) == 0)
+    {
+        unsigned int a[6];
+        int fields = sscanf(argument, "%2x:%2x:%2x:%2x:%2x:%2x", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5]);
+        if(fields != 6)
+        {
+            fields = sscanf(argument, "%2x%2x%2x%2x%2x%2x", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5]);
+        }
+        if(fields != 6)
+        {
+            return false;
+        }
+
+        _address = 0;
+        for(int i = 0; i < 6; i++)
+        {
+            _address = (_address << 8) | a[i];
+        }
+        _type = PresenceQueryType::Address;
+    }
+    else if(typeLength == 4 && strncmp(type, "name", 4) == 0)
+    {
+        size_t length = strlen(argument);
+        if(length > name_table_max_length)
+        {
+            return false;
+        }
+        memcpy(_namePrefix, argument, length);
+        _namePrefix[length] = 0x00;
+        _type = PresenceQueryType::NamePrefix;
+    }
+    else if(typeLength == 4 && strncmp(type, "zone", 4) == 0)
+    {
+        _zone = 0;
+        for(int i = (int)ProximityZone::Far; i <= (int)ProximityZone::Immediate; i++)
+        {
+            if(strcmp(argument, ProximityZones::zoneName((ProximityZone)i)) == 0)
+            {
+                _zone = i;
+            }
+        }
+        if(_zone == 0)
+        {
+            return false;
+        }
+        _type = PresenceQueryType::Zone;
+    }
+    else if(typeLength == 4 && strncmp(type, "seen", 4) == 0)
+    {
+        long seconds = atol(argument);
+        if(seconds <= 0 || seconds > 86400)
+        {
+            return false;
+        }
+        _seenWithin = seconds * 1000;
+        _type = PresenceQueryType::SeenWithin;
+    }
+    else
+    {
+        return false;
+    }
+
+    memcpy(_id, request, typeStart - request);
+    _id[typeStart - request] = 0x00;
+    return true;
+}
+
+bool PresenceQuery::matches(const long long address, const PdDevice& device, const NameTable* names, const unsigned long ts) const
+{
+    switch(_type)
+    {
+        case PresenceQueryType::Address:
+            return address == _address;
+        case PresenceQueryType::NamePrefix:
+        {
+            size_t nameLength;
+            const char* name = names->get(device.nameId, nameLength);
+            size_t prefixLength = strlen(_namePrefix);
+            return name != nullptr && nameLength >= prefixLength && strncmp(name, _namePrefix, prefixLength) == 0;
+        }
+        case PresenceQueryType::Zone:
+            return (uint8_t)ProximityZones::zone(device) == _zone;
+        case PresenceQueryType::SeenWithin:
+            return device.timestamp != 0 && (int32_t)(ts - device.timestamp) <= (int32_t)_seenWithin;
+        default:
+            return PresenceStateMachine::isPresent(device);
+    }
+}
+
+long long PresenceQuery::firstAddress() const
+{
+    return _type == PresenceQueryType::Address ? _address : 0;
+}
+
+long long PresenceQuery::lastAddress() const
+{
+    return _type == PresenceQueryType::Address ? _address : LLONG_MAX;
+}
+
+const char* PresenceQuery::id() const
+{
+    return _id;
+}
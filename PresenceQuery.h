@@ -0,0 +1,49 @@
+#pragma once
+
+#include <Arduino.h>
+#include "PdDevice.h"
+#include "NameTable.h"
+
+// Correlation ids are part of the answer topic, so they are limited to letters, digits, '-' and '_'
+#define presence_query_max_id_length 16
+// Longest valid request, "<id>;name;<prefix>" with a full length id and prefix
+#define presence_query_max_length (presence_query_max_id_length + 6 + name_table_max_length)
+// Queries wait here until the presence task answers them
+#define presence_query_queue_size 4
+
+enum class PresenceQueryType : uint8_t
+{
+    Present = 0, // the periodic report
+    Address = 1,
+    NamePrefix = 2,
+    Zone = 3,
+    SeenWithin = 4
+};
+
+// Selects the devices of a report or of the answer to an on-demand query. A default constructed
+// query selects the present devices, like the periodic report.
+class PresenceQuery
+{
+public:
+    PresenceQuery() = default;
+
+    // Request format: <id>;mac;<address> | <id>;name;<prefix> | <id>;zone;<far|near|immediate> | <id>;seen;<seconds>,
+    // e.g. "42;seen;30". Address and name queries include devices that already left. Returns false if malformed.
+    bool parse(const char* request);
+
+    bool matches(const long long address, const PdDevice& device, const NameTable* names, const unsigned long ts) const;
+
+    // Range of addresses that can match, so address queries don't walk the whole table
+    long long firstAddress() const;
+    long long lastAddress() const;
+
+    const char* id() const;
+
+private:
+    char _id[presence_query_max_id_length + 1] = {0};
+    PresenceQueryType _type = PresenceQueryType::Present;
+    long long _address = 0;
+    uint8_t _zone = 0;
+    uint32_t _seenWithin = 0; // ms
+    char _namePrefix[name_table_max_length + 1] = {0};
+};
@@ -0,0 +1,391 @@
+#include "PresenceSerializer.h"
+
+PresenceSerializer::PresenceSerializer(DeviceMap* devices, const NameTable* names, const RssiEstimator* rssiEstimator, const bool classification, const bool intervals, const size_t pageSize, const PresenceFormat format)
+: _devices(devices),
+  _names(names),
+  _rssiEstimator(rssiEstimator),
+  _classification(classification),
+  _intervals(intervals),
+  _pageSize(pageSize),
+  _format(format)
+{}
+
+size_t PresenceSerializer::measurePage(const PresenceQuery& query, const long long startAddress, const unsigned long ts, const uint32_t report, long long& endAddress, long long& nextAddress)
+{
+    uint8_t record[presence_record_max_length];
+    size_t length = headerLength();
+    size_t footerLength = _format == PresenceFormat::Cbor ? 1 : 0;
+    size_t records = 0;
+
+    endAddress = startAddress;
+    nextAddress = -1;
+
+    for(auto it = _devices->lower_bound(startAddress); it != _devices->end() && it->first <= query.lastAddress(); ++it)
+    {
+        if(!query.matches(it->first, it->second, _names, ts))
+        {
+            continue;
+        }
+
+        size_t recordLength = buildRecord(it->first, it->second, ts, report, record);
+        size_t separatorLength = (_format == PresenceFormat::Csv && records > 0) ? 1 : 0;
+
+        // Always put at least one device on a page, otherwise paging would never advance
+        if(records > 0 && length + separatorLength + recordLength + footerLength > _pageSize)
+        {
+            nextAddress = it->first;
+            break;
+        }
+
+        if(_format == PresenceFormat::Cbor && report != 0 && it->second.nameReport == 0)
+        {
+            it->second.nameReport = report;
+        }
+
+        length += separatorLength + recordLength;
+        endAddress = it->first;
+        ++records;
+    }
+
+    return records > 0 ? length + footerLength : 0;
+}
+
+size_t PresenceSerializer::renderPage(uint8_t* data, const size_t length, const PresenceQuery& query, const long long startAddress, const long long endAddress, const unsigned long ts, const uint32_t report) const
+{
+    uint8_t record[presence_record_max_length];
+    size_t footerLength = _format == PresenceFormat::Cbor ? 1 : 0;
+    size_t index = buildHeader(data, report);
+    size_t records = 0;
+
+    for(auto it = _devices->lower_bound(startAddress); it != _devices->end() && it->first <= endAddress; ++it)
+    {
+        if(!query.matches(it->first, it->second, _names, ts))
+        {
+            continue;
+        }
+
+        size_t recordLength = buildRecord(it->first, it->second, ts, report, record);
+        size_t separatorLength = (_format == PresenceFormat::Csv && records > 0) ? 1 : 0;
+
+        if(index + separatorLength + recordLength + footerLength > length)
+        {
+            break;
+        }
+
+        if(separatorLength > 0)
+        {
+            data[index] = '\n';
+            ++index;
+        }
+
+        memcpy(&data[index], record, recordLength);
+        index += recordLength;
+        ++records;
+    }
+
+    switch(_format)
+    {
+        case PresenceFormat::Cbor:
+            buildCborFiller(&data[index], length - footerLength - index);
+            data[length - 1] = 0xFF; // break, end of indefinite array
+            break;
+        default:
+            memset(&data[index], '\n', length - index);
+            break;
+    }
+
+    return length;
+}
+
+size_t PresenceSerializer::buildEmptyReport(uint8_t* data, const uint32_t report) const
+{
+    switch(_format)
+    {
+        case PresenceFormat::Cbor:
+        {
+            size_t index = buildHeader(data, report);
+            data[index] = 0xFF;
+            return index + 1;
+        }
+        default:
+            memcpy(data, ";;", 2);
+            return 2;
+    }
+}
+
+size_t PresenceSerializer::emptyReportLength() const
+{
+    return _format == PresenceFormat::Cbor ? headerLength() + 1 : 2;
+}
+
+bool PresenceSerializer::includeName(const PdDevice& device, const uint32_t report) const
+{
+    if(device.nameId == name_table_no_name)
+    {
+        return false;
+    }
+    // Answers (report 0) always carry names, whoever asked may not follow the reports
+    return report % presence_cbor_name_refresh_interval == 0 || device.nameReport == 0 || device.nameReport == report;
+}
+
+size_t PresenceSerializer::headerLength() const
+{
+    // indefinite array + version + 32 bit report number
+    return _format == PresenceFormat::Cbor ? 1 + 1 + 5 : 0;
+}
+
+size_t PresenceSerializer::buildHeader(uint8_t* out, const uint32_t report) const
+{
+    if(_format != PresenceFormat::Cbor)
+    {
+        return 0;
+    }
+
+    out[0] = 0x9F;
+    out[1] = presence_cbor_version;
+    out[2] = 0x1A;
+    out[3] = report >> 24;
+    out[4] = (report >> 16) & 0xFF;
+    out[5] = (report >> 8) & 0xFF;
+    out[6] = report & 0xFF;
+    return 7;
+}
+
+size_t PresenceSerializer::buildRecord(const long long address, const PdDevice& device, const unsigned long ts, const uint32_t report, uint8_t* out) const
+{
+    switch(_format)
+    {
+        case PresenceFormat::Cbor:
+            return buildCbor(address, device, ts, report, out);
+        default:
+            return buildCsv(address, device, (char*)out);
+    }
+}
+
+size_t PresenceSerializer::buildCsv(const long long address, const PdDevice &device, char* out) const
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    size_t index = 0;
+
+    for(int i = 5; i >= 0; i--)
+    {
+        uint8_t addressByte = (address >> (i * 8)) & 0xFF;
+        out[index++] = hexDigits[addressByte >> 4];
+        out[index++] = hexDigits[addressByte & 0x0F];
+        out[index++] = i > 0 ? ':' : ';';
+    }
+
+    size_t nameLength;
+    const char* name = _names->get(device.nameId, nameLength);
+    if(name != nullptr)
+    {
+        memcpy(&out[index], name, nameLength);
+        index += nameLength;
+    }
+
+    out[index] = ';';
+    ++index;
+
+    if(device.flags & pd_device_flag_rssi)
+    {
+        char rssiStr[20] = {0};
+        itoa(device.rssi, rssiStr, 10);
+
+        int i=0;
+        while(rssiStr[i] != 0x00 && i < 20)
+        {
+            out[index] = rssiStr[i];
+            ++index;
+            ++i;
+        }
+    }
+
+    // Smoothed RSSI and distance in meters are only appended when a filter, classification or intervals are configured,
+    // so existing consumers of the three column format keep working
+    if(_rssiEstimator->enabled() || _classification || _intervals)
+    {
+        out[index] = ';';
+        ++index;
+
+        if(device.flags & pd_device_flag_rssi)
+        {
+            itoa(device.smoothedRssi, &out[index], 10);
+            index += strlen(&out[index]);
+        }
+
+        out[index] = ';';
+        ++index;
+
+        if(device.flags & pd_device_flag_rssi)
+        {
+            dtostrf(_rssiEstimator->distance(device), 0, 2, &out[index]);
+            index += strlen(&out[index]);
+        }
+    }
+
+    if(_classification || _intervals)
+    {
+        const char* vendor = DeviceClassifier::vendorName(device.vendor);
+        const char* deviceClass = DeviceClassifier::className((DeviceClass)device.deviceClass);
+
+        out[index] = ';';
+        ++index;
+        strcpy(&out[index], vendor);
+        index += strlen(vendor);
+
+        out[index] = ';';
+        ++index;
+        strcpy(&out[index], deviceClass);
+        index += strlen(deviceClass);
+    }
+
+    // Median advertising interval and jitter in ms, empty until the interval is known
+    if(_intervals)
+    {
+        out[index] = ';';
+        ++index;
+        if(device.interval != 0)
+        {
+            utoa(device.interval, &out[index], 10);
+            index += strlen(&out[index]);
+        }
+
+        out[index] = ';';
+        ++index;
+        if(device.interval != 0)
+        {
+            utoa(device.jitter, &out[index], 10);
+            index += strlen(&out[index]);
+        }
+    }
+
+    return index;
+}
+
+size_t PresenceSerializer::buildCbor(const long long address, const PdDevice& device, const unsigned long ts, const uint32_t report, uint8_t* out) const
+{
+    // [address (6 byte bstr), rssi (int8), seconds since last seen (uint16), smoothed rssi (int8),
+    //  distance in cm (uint16), vendor id (uint8), class (uint8), median advertising interval in ms (uint16),
+    //  jitter in ms (uint16), name (tstr, optional)],
+    // rssi values and distance are null without RSSI, vendor, class and interval are 0 if unknown.
+    // All values use a fixed head size, so a record only changes length when the name does.
+    bool name = includeName(device, report);
+    size_t index = 0;
+
+    out[index++] = 0x80 | (name ? 10 : 9);
+
+    out[index++] = 0x46;
+    for(int i = 5; i >= 0; i--)
+    {
+        out[index++] = (address >> (i * 8)) & 0xFF;
+    }
+
+    if(device.flags & pd_device_flag_rssi)
+    {
+        index += encodeCborInt8(device.rssi, &out[index]);
+    }
+    else
+    {
+        out[index++] = 0xF6;
+    }
+
+    long lastSeen = (long)(ts - device.timestamp) / 1000;
+    lastSeen = lastSeen < 0 ? 0 : (lastSeen > 0xFFFF ? 0xFFFF : lastSeen);
+    out[index++] = 0x19;
+    out[index++] = lastSeen >> 8;
+    out[index++] = lastSeen & 0xFF;
+
+    if(device.flags & pd_device_flag_rssi)
+    {
+        index += encodeCborInt8(device.smoothedRssi, &out[index]);
+
+        uint16_t distance = lroundf(_rssiEstimator->distance(device) * 100);
+        out[index++] = 0x19;
+        out[index++] = distance >> 8;
+        out[index++] = distance & 0xFF;
+    }
+    else
+    {
+        out[index++] = 0xF6;
+        out[index++] = 0xF6;
+    }
+
+    out[index++] = 0x18;
+    out[index++] = device.vendor;
+    out[index++] = 0x18;
+    out[index++] = device.deviceClass;
+
+    out[index++] = 0x19;
+    out[index++] = device.interval >> 8;
+    out[index++] = device.interval & 0xFF;
+    out[index++] = 0x19;
+    out[index++] = device.jitter >> 8;
+    out[index++] = device.jitter & 0xFF;
+
+    if(name)
+    {
+        size_t nameLength;
+        const char* deviceName = _names->get(device.nameId, nameLength);
+        index += encodeCborHead(0x60, nameLength, &out[index]);
+        memcpy(&out[index], deviceName, nameLength);
+        index += nameLength;
+    }
+
+    return index;
+}
+
+size_t PresenceSerializer::encodeCborInt8(const int value, uint8_t* out) const
+{
+    int clamped = value < -128 ? -128 : (value > 127 ? 127 : value);
+    out[0] = clamped < 0 ? 0x38 : 0x18;
+    out[1] = clamped < 0 ? -1 - clamped : clamped;
+    return 2;
+}
+
+size_t PresenceSerializer::encodeCborHead(const uint8_t majorType, const uint32_t value, uint8_t* out) const
+{
+    if(value < 24)
+    {
+        out[0] = majorType | value;
+        return 1;
+    }
+    if(value <= 0xFF)
+    {
+        out[0] = majorType | 24;
+        out[1] = value;
+        return 2;
+    }
+    out[0] = majorType | 25;
+    out[1] = value >> 8;
+    out[2] = value & 0xFF;
+    return 3;
+}
+
+void PresenceSerializer::buildCborFiller(uint8_t* out, const size_t length) const
+{
+    // A byte string of exactly length bytes (head included), decoders skip it like any non-record item
+    if(length == 0)
+    {
+        return;
+    }
+
+    size_t headLength = length <= 24 ? 1 : (length <= 257 ? 2 : 3);
+    size_t contentLength = length - headLength;
+
+    memset(out, 0, length);
+    switch(headLength)
+    {
+        case 1:
+            out[0] = 0x40 | contentLength;
+            break;
+        case 2:
+            out[0] = 0x58;
+            out[1] = contentLength;
+            break;
+        default:
+            out[0] = 0x59;
+            out[1] = contentLength >> 8;
+            out[2] = contentLength & 0xFF;
+            break;
+    }
+}
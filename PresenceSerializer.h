@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+#include "DeviceMap.h"
+#include "NameTable.h"
+#include "RssiEstimator.h"
+#include "DeviceClassifier.h"
+#include "PresenceStateMachine.h"
+#include "PresenceQuery.h"
+
+// address + name + rssi + smoothed rssi + distance + vendor + class + interval + jitter + separators
+#define presence_record_max_length 128
+#define presence_cbor_version 4
+// Every n-th CBOR report carries all names, so late subscribers don't have to wait for a name change
+#define presence_cbor_name_refresh_interval 30
+
+enum class PresenceFormat
+{
+    Csv = 0,
+    Cbor = 1
+};
+
+// Renders presence reports page by page straight from the device table, so no buffer has to be
+// sized for the whole report. A page is identified by its first and last address. It is measured, then
+// rendered once into a reference counted payload of that length, which the MQTT client keeps for retransmits.
+// Answers to queries use the same pages with report number 0, their records always carry the name.
+class PresenceSerializer
+{
+public:
+    PresenceSerializer(DeviceMap* devices, const NameTable* names, const RssiEstimator* rssiEstimator, const bool classification, const bool intervals, const size_t pageSize, const PresenceFormat format);
+
+    // Returns the payload length of the page starting at startAddress (0 if no device matches the query).
+    // nextAddress is set to the first address of the following page, or -1 if this is the last page.
+    size_t measurePage(const PresenceQuery& query, const long long startAddress, const unsigned long ts, const uint32_t report, long long& endAddress, long long& nextAddress);
+
+    // Writes exactly length bytes. Devices that timed out since the page was measured are skipped and
+    // the remainder is padded (empty lines / CBOR filler), devices that don't fit anymore are left for the next report.
+    size_t renderPage(uint8_t* data, const size_t length, const PresenceQuery& query, const long long startAddress, const long long endAddress, const unsigned long ts, const uint32_t report) const;
+
+    size_t buildEmptyReport(uint8_t* data, const uint32_t report) const;
+    size_t emptyReportLength() const;
+
+private:
+    bool includeName(const PdDevice& device, const uint32_t report) const;
+    size_t headerLength() const;
+    size_t buildHeader(uint8_t* out, const uint32_t report) const;
+    size_t buildRecord(const long long address, const PdDevice& device, const unsigned long ts, const uint32_t report, uint8_t* out) const;
+    size_t buildCsv(const long long address, const PdDevice& device, char* out) const;
+    size_t buildCbor(const long long address, const PdDevice& device, const unsigned long ts, const uint32_t report, uint8_t* out) const;
+    size_t encodeCborInt8(const int value, uint8_t* out) const;
+    size_t encodeCborHead(const uint8_t majorType, const uint32_t value, uint8_t* out) const;
+    void buildCborFiller(uint8_t* out, const size_t length) const;
+
+    DeviceMap* _devices;
+    const NameTable* _names;
+    const RssiEstimator* _rssiEstimator;
+    const bool _classification;
+    const bool _intervals;
+    const size_t _pageSize;
+    const PresenceFormat _format;
+};
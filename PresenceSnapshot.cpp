@@ -0,0 +1,191 @@
+#include "PresenceSnapshot.h"
+#include <vector>
+#include "Crc16.h"
+
+#define presence_snapshot_header_length 6
+#define presence_snapshot_flag_clean 0x01
+#define presence_snapshot_state_present 0x01
+#define presence_snapshot_name_reference 0xFF
+
+PresenceSnapshot::PresenceSnapshot(DeviceMap* devices, NameTable* names, const int timeout)
+: _devices(devices),
+  _names(names),
+  _timeout(timeout)
+{}
+
+size_t PresenceSnapshot::build(uint8_t* data, const size_t maxLength, const bool clean) const
+{
+    std::map<uint16_t, uint16_t> nameIndices;
+    size_t index = presence_snapshot_header_length;
+    uint16_t count = 0;
+    size_t footerLength = 2;
+
+    for(int pass = 0; pass < 2; pass++)
+    {
+        bool present = pass == 0;
+        for(const auto& it : *_devices)
+        {
+            if(PresenceStateMachine::isPresent(it.second) != present)
+            {
+                continue;
+            }
+
+            size_t entryLength = buildEntry(it.first, it.second, present, nameIndices, &data[index], maxLength - footerLength - index);
+            if(entryLength == 0 || count == UINT16_MAX)
+            {
+                pass = 2;
+                break;
+            }
+            index += entryLength;
+            ++count;
+        }
+    }
+
+    data[0] = 'P';
+    data[1] = 'D';
+    data[2] = presence_snapshot_version;
+    data[3] = clean ? presence_snapshot_flag_clean : 0;
+    data[4] = count >> 8;
+    data[5] = count & 0xFF;
+
+    Crc16 crc;
+    uint16_t checksum = crc.XModemCrc(data, 0, index);
+    data[index++] = checksum >> 8;
+    data[index++] = checksum & 0xFF;
+
+    return index;
+}
+
+size_t PresenceSnapshot::buildEntry(const long long address, const PdDevice& device, const bool present, std::map<uint16_t, uint16_t>& nameIndices, uint8_t* out, const size_t maxLength) const
+{
+    size_t nameLength;
+    const char* name = _names->get(device.nameId, nameLength);
+    auto nameIndex = nameIndices.find(device.nameId);
+
+    size_t length = 8;
+    if(name != nullptr)
+    {
+        length += nameIndex != nameIndices.end() ? 3 : 1 + nameLength;
+    }
+    else
+    {
+        length += 1;
+    }
+
+    if(length > maxLength)
+    {
+        return 0;
+    }
+
+    size_t index = 0;
+    for(int i = 5; i >= 0; i--)
+    {
+        out[index++] = (address >> (i * 8)) & 0xFF;
+    }
+    out[index++] = device.measuredPower;
+    out[index++] = present ? presence_snapshot_state_present : 0;
+
+    if(name == nullptr)
+    {
+        out[index++] = 0;
+    }
+    else if(nameIndex != nameIndices.end())
+    {
+        out[index++] = presence_snapshot_name_reference;
+        out[index++] = nameIndex->second >> 8;
+        out[index++] = nameIndex->second & 0xFF;
+    }
+    else
+    {
+        uint16_t newIndex = nameIndices.size();
+        nameIndices[device.nameId] = newIndex;
+        out[index++] = nameLength;
+        memcpy(&out[index], name, nameLength);
+        index += nameLength;
+    }
+
+    return index;
+}
+
+int PresenceSnapshot::restore(const uint8_t* data, const size_t length, const unsigned long ts)
+{
+    if(length < presence_snapshot_header_length + 2 || data[0] != 'P' || data[1] != 'D' || data[2] != presence_snapshot_version)
+    {
+        return -1;
+    }
+
+    Crc16 crc;
+    uint16_t checksum = (data[length - 2] << 8) | data[length - 1];
+    if(crc.XModemCrc((uint8_t*)data, 0, length - 2) != checksum)
+    {
+        return -1;
+    }
+
+    bool clean = (data[3] & presence_snapshot_flag_clean) != 0;
+    uint16_t count = (data[4] << 8) | data[5];
+    size_t end = length - 2;
+    size_t index = presence_snapshot_header_length;
+    std::vector<uint16_t> nameIds;
+    int restored = 0;
+
+    for(uint16_t i = 0; i < count; i++)
+    {
+        if(index + 9 > end)
+        {
+            break;
+        }
+
+        long long address = 0;
+        for(int j = 0; j < 6; j++)
+        {
+            address = (address << 8) | data[index++];
+        }
+
+        PdDevice device;
+        device.measuredPower = (int8_t)data[index++];
+        uint8_t state = data[index++];
+        bool present = clean && (state & presence_snapshot_state_present) != 0;
+
+        uint8_t nameLength = data[index++];
+        if(nameLength == presence_snapshot_name_reference)
+        {
+            if(index + 2 > end)
+            {
+                break;
+            }
+            uint16_t nameIndex = (data[index] << 8) | data[index + 1];
+            index += 2;
+            if(nameIndex < nameIds.size() && nameIds[nameIndex] != name_table_no_name)
+            {
+                device.nameId = _names->retain(nameIds[nameIndex]);
+            }
+        }
+        else if(nameLength > 0)
+        {
+            if(index + nameLength > end)
+            {
+                break;
+            }
+            device.nameId = _names->intern((const char*)&data[index], nameLength);
+            nameIds.push_back(device.nameId);
+            index += nameLength;
+        }
+
+        // Devices that weren't present count as expired, so they are reported as arrivals when seen again
+        device.timestamp = present ? ts : ts - _timeout;
+        device.state = (uint8_t)(present ? PresenceState::Present : PresenceState::Away);
+        device.stateTs = ts;
+
+        auto existing = _devices->find(address);
+        if(existing != _devices->end() || _devices->size() >= presence_max_devices)
+        {
+            _names->release(device.nameId);
+            continue;
+        }
+
+        (*_devices)[address] = device;
+        ++restored;
+    }
+
+    return restored;
+}
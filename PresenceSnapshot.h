@@ -0,0 +1,36 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include "DeviceMap.h"
+#include "NameTable.h"
+#include "PresenceStateMachine.h"
+
+// Fits into a single NVS blob together with the other settings
+#define presence_snapshot_max_size 4000
+#define presence_snapshot_version 1
+
+// Serializes the known devices, so presence detection doesn't have to relearn names and
+// calibration after a restart. Layout:
+// magic "PD", version, flags, device count (uint16), entries, CRC16 (XModem) over everything before.
+// Entry: address (6 bytes), measured power (int8), state, name. The name is a length followed by the
+// characters on its first use, 0xFF followed by the uint16 index of an earlier name, or 0 for no name.
+class PresenceSnapshot
+{
+public:
+    PresenceSnapshot(DeviceMap* devices, NameTable* names, const int timeout);
+
+    // Present devices are written first, so they are kept if not all devices fit.
+    // clean marks a snapshot taken right before a controlled restart, only then present devices are restored as present.
+    size_t build(uint8_t* data, const size_t maxLength, const bool clean) const;
+
+    // Returns the number of restored devices, or -1 if the snapshot is invalid
+    int restore(const uint8_t* data, const size_t length, const unsigned long ts);
+
+private:
+    size_t buildEntry(const long long address, const PdDevice& device, const bool present, std::map<uint16_t, uint16_t>& nameIndices, uint8_t* out, const size_t maxLength) const;
+
+    DeviceMap* _devices;
+    NameTable* _names;
+    const int _timeout;
+};
@@ -0,0 +1,408 @@
+#include "PresenceStateMachine.h"
+#include "IntervalEstimator.h"
+#include <algorithm>
+#include <string.h>
+
+static const char* presenceStateNames[] = { "unknown", "arriving", "present", "leaving", "away" };
+
+// Orders the heap by the earliest deadline, millis() may wrap
+static bool laterDeadline(const uint32_t a, const uint32_t b)
+{
+    return (int32_t)(a - b) > 0;
+}
+
+PresenceStateMachine::PresenceStateMachine(DeviceMap* devices, const unsigned long timeout, const uint8_t graceIntervals)
+: _devices(devices),
+  _timeout(timeout),
+  _graceIntervals(graceIntervals)
+{
+    _profiles.push_back(PresenceProfile());
+}
+
+int PresenceStateMachine::loadProfiles(const char* config)
+{
+    int loaded = 0;
+    const char* line = config;
+
+    while(line != nullptr && *line != 0x00)
+    {
+        const char* end = strchr(line, '\n');
+        char buffer[80] = {0};
+        size_t length = end != nullptr ? end - line : strlen(line);
+        memcpy(buffer, line, length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1);
+        line = end != nullptr ? end + 1 : nullptr;
+
+        char target[32];
+        int enterRssi, exitRssi;
+        unsigned long enterTime, exitTime;
+        if(sscanf(buffer, "%31s %d %d %lu %lu", target, &enterRssi, &exitRssi, &enterTime, &exitTime) != 5)
+        {
+            continue;
+        }
+
+        PresenceProfile profile;
+        // The exit threshold can't be above the enter threshold, devices would flap between the two
+        enterRssi = enterRssi < -128 ? -128 : (enterRssi > 0 ? 0 : enterRssi);
+        exitRssi = exitRssi < -128 ? -128 : (exitRssi > enterRssi ? enterRssi : exitRssi);
+        profile.enterRssi = enterRssi;
+        profile.exitRssi = exitRssi;
+        profile.enterTime = enterTime;
+        profile.exitTime = exitTime;
+
+        if(strcmp(target, "default") == 0)
+        {
+            _profiles[0] = profile;
+            ++loaded;
+            continue;
+        }
+
+        if(_profiles.size() >= presence_max_profiles)
+        {
+            break;
+        }
+
+        unsigned int a[6];
+        if(sscanf(target, "%2x:%2x:%2x:%2x:%2x:%2x", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5]) == 6)
+        {
+            long long address = 0;
+            for(int i = 0; i < 6; i++)
+            {
+                address = (address << 8) | a[i];
+            }
+            _addressProfiles[address] = _profiles.size();
+            _profiles.push_back(profile);
+            ++loaded;
+            continue;
+        }
+
+        for(int i = 1; i < device_class_count; i++)
+        {
+            if(strcmp(target, DeviceClassifier::className((DeviceClass)i)) == 0)
+            {
+                _classProfiles[i] = _profiles.size();
+                _profiles.push_back(profile);
+                ++loaded;
+                break;
+            }
+        }
+    }
+
+    return loaded;
+}
+
+void PresenceStateMachine::assignProfile(const long long address, PdDevice& device) const
+{
+    auto it = _addressProfiles.find(address);
+    if(it != _addressProfiles.end())
+    {
+        device.profile = it->second;
+    }
+    else
+    {
+        device.profile = device.deviceClass < device_class_count ? _classProfiles[device.deviceClass] : 0;
+    }
+}
+
+bool PresenceStateMachine::onAdvertisement(const long long address, PdDevice& device, const unsigned long ts)
+{
+    // Gaps longer than the timeout are absences, not the advertising interval
+    unsigned long elapsed = ts - device.timestamp;
+    bool firstAdvertisement = device.timestamp == 0;
+    bool firstInterval = false;
+    if(!firstAdvertisement && elapsed < _timeout)
+    {
+        firstInterval = device.interval == 0;
+        IntervalEstimator::update(device, elapsed);
+    }
+    device.timestamp = ts;
+
+    // New devices are scheduled to be dropped, unless they arrive below
+    if(firstAdvertisement)
+    {
+        schedule(address, device);
+    }
+
+    // The grace period was the timeout until now, an earlier deadline has to replace the pending one.
+    // Later changes of the interval are picked up when the pending deadline is due.
+    if(firstInterval)
+    {
+        schedule(address, device);
+    }
+
+    const PresenceProfile& thresholds = profile(device);
+    bool hasRssi = device.flags & pd_device_flag_rssi;
+    bool strong = !hasRssi || device.smoothedRssi >= thresholds.enterRssi;
+    bool weak = hasRssi && device.smoothedRssi < thresholds.exitRssi;
+
+    switch((PresenceState)device.state)
+    {
+        case PresenceState::Unknown:
+        case PresenceState::Away:
+            if(strong)
+            {
+                setState(address, device, PresenceState::Arriving, ts);
+                // Without enter time the device is present right away
+                return evaluate(address, device, ts);
+            }
+            return false;
+        case PresenceState::Arriving:
+            if(weak)
+            {
+                return setState(address, device, PresenceState::Away, ts);
+            }
+            return evaluate(address, device, ts);
+        case PresenceState::Present:
+            if(weak)
+            {
+                return setState(address, device, PresenceState::Leaving, ts);
+            }
+            return false;
+        case PresenceState::Leaving:
+            if(!weak)
+            {
+                return setState(address, device, PresenceState::Present, ts);
+            }
+            return evaluate(address, device, ts);
+        default:
+            return false;
+    }
+}
+
+bool PresenceStateMachine::processDeadlines(const unsigned long ts)
+{
+    bool changed = false;
+
+    while(!_deadlines.empty() && !laterDeadline(_deadlines.front().ts, ts))
+    {
+        std::pop_heap(_deadlines.begin(), _deadlines.end(), [](const Deadline& a, const Deadline& b) { return laterDeadline(a.ts, b.ts); });
+        Deadline entry = _deadlines.back();
+        _deadlines.pop_back();
+
+        auto it = _devices->find(entry.address);
+        if(it == _devices->end() || (it->second.flags & pd_device_schedule_mask) != entry.generation)
+        {
+            continue;
+        }
+
+        uint8_t generation = it->second.flags & pd_device_schedule_mask;
+        if(evaluate(entry.address, it->second, ts))
+        {
+            changed = true;
+        }
+
+        if(expired(it->second, ts))
+        {
+            evict(it);
+            continue;
+        }
+
+        // Devices that were seen since the entry was scheduled move their deadline, transitions scheduled their own
+        if((it->second.flags & pd_device_schedule_mask) == generation)
+        {
+            schedule(entry.address, it->second);
+        }
+    }
+
+    return changed;
+}
+
+bool PresenceStateMachine::nextDeadline(unsigned long& deadline) const
+{
+    if(_deadlines.empty())
+    {
+        return false;
+    }
+    deadline = _deadlines.front().ts;
+    return true;
+}
+
+void PresenceStateMachine::setStateCallback(std::function<void(const long long, PdDevice&)> callback)
+{
+    _stateCallback = callback;
+}
+
+void PresenceStateMachine::setEvictCallback(std::function<void(const long long, PdDevice&)> callback)
+{
+    _evictCallback = callback;
+}
+
+bool PresenceStateMachine::evictOldest(const unsigned long ts)
+{
+    auto oldest = _devices->end();
+    unsigned long oldestAge = 0;
+
+    for(auto it = _devices->begin(); it != _devices->end(); ++it)
+    {
+        if(it->second.state != (uint8_t)PresenceState::Unknown && it->second.state != (uint8_t)PresenceState::Away)
+        {
+            continue;
+        }
+
+        unsigned long age = ts - it->second.timestamp;
+        if(oldest == _devices->end() || age > oldestAge)
+        {
+            oldest = it;
+            oldestAge = age;
+        }
+    }
+
+    if(oldest == _devices->end())
+    {
+        return false;
+    }
+
+    // Its deadline stays in the heap and is skipped when due, like any stale entry
+    evict(oldest);
+    return true;
+}
+
+void PresenceStateMachine::track(const long long address, PdDevice& device)
+{
+    schedule(address, device);
+}
+
+bool PresenceStateMachine::isPresent(const PdDevice& device)
+{
+    return device.state == (uint8_t)PresenceState::Present || device.state == (uint8_t)PresenceState::Leaving;
+}
+
+const char* PresenceStateMachine::stateName(const PresenceState state)
+{
+    return (uint8_t)state < sizeof(presenceStateNames) / sizeof(presenceStateNames[0]) ? presenceStateNames[(uint8_t)state] : "";
+}
+
+bool PresenceStateMachine::evaluate(const long long address, PdDevice& device, const unsigned long ts)
+{
+    const PresenceProfile& thresholds = profile(device);
+    bool missing = ts - device.timestamp >= grace(device);
+
+    switch((PresenceState)device.state)
+    {
+        case PresenceState::Arriving:
+            if(missing)
+            {
+                return setState(address, device, PresenceState::Away, ts);
+            }
+            if(ts - device.stateTs >= thresholds.enterTime)
+            {
+                return setState(address, device, PresenceState::Present, ts);
+            }
+            return false;
+        case PresenceState::Present:
+            if(missing)
+            {
+                setState(address, device, PresenceState::Leaving, ts);
+                // Without exit time the device is away right away
+                return evaluate(address, device, ts);
+            }
+            return false;
+        case PresenceState::Leaving:
+            if(ts - device.stateTs >= thresholds.exitTime)
+            {
+                return setState(address, device, PresenceState::Away, ts);
+            }
+            return false;
+        default:
+            return false;
+    }
+}
+
+bool PresenceStateMachine::setState(const long long address, PdDevice& device, const PresenceState state, const unsigned long ts)
+{
+    bool wasPresent = isPresent(device);
+
+    device.state = (uint8_t)state;
+    device.stateTs = ts;
+    schedule(address, device);
+
+    if(_stateCallback != nullptr)
+    {
+        _stateCallback(address, device);
+    }
+
+    return wasPresent != isPresent(device);
+}
+
+bool PresenceStateMachine::deadline(const PdDevice& device, unsigned long& deadline) const
+{
+    const PresenceProfile& thresholds = profile(device);
+    unsigned long missingTs = device.timestamp + grace(device);
+
+    switch((PresenceState)device.state)
+    {
+        case PresenceState::Arriving:
+        {
+            unsigned long enterTs = device.stateTs + thresholds.enterTime;
+            deadline = laterDeadline(enterTs, missingTs) ? missingTs : enterTs;
+            return true;
+        }
+        case PresenceState::Present:
+            deadline = missingTs;
+            return true;
+        case PresenceState::Leaving:
+            deadline = device.stateTs + thresholds.exitTime;
+            return true;
+        case PresenceState::Unknown:
+        case PresenceState::Away:
+            deadline = device.timestamp + presence_away_retention;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void PresenceStateMachine::schedule(const long long address, PdDevice& device)
+{
+    // Only the newest entry of a device is valid, so each device is evaluated once per deadline
+    uint8_t generation = (device.flags + pd_device_schedule_step) & pd_device_schedule_mask;
+    device.flags = (device.flags & ~pd_device_schedule_mask) | generation;
+
+    Deadline entry;
+    unsigned long ts;
+    if(!deadline(device, ts))
+    {
+        return;
+    }
+
+    entry.ts = ts;
+    entry.generation = generation;
+    entry.address = address;
+    _deadlines.push_back(entry);
+    std::push_heap(_deadlines.begin(), _deadlines.end(), [](const Deadline& a, const Deadline& b) { return laterDeadline(a.ts, b.ts); });
+}
+
+bool PresenceStateMachine::expired(const PdDevice& device, const unsigned long ts) const
+{
+    bool away = device.state == (uint8_t)PresenceState::Unknown || device.state == (uint8_t)PresenceState::Away;
+    return away && ts - device.timestamp >= presence_away_retention;
+}
+
+void PresenceStateMachine::evict(DeviceMap::iterator it)
+{
+    if(_evictCallback != nullptr)
+    {
+        _evictCallback(it->first, it->second);
+    }
+    _devices->erase(it);
+}
+
+unsigned long PresenceStateMachine::grace(const PdDevice& device) const
+{
+    // A device is missing after it skipped a number of its own advertisements, but never later than the timeout
+    if(_graceIntervals == 0 || device.interval == 0)
+    {
+        return _timeout;
+    }
+
+    unsigned long grace = (unsigned long)device.interval * _graceIntervals;
+    if(grace < presence_min_grace)
+    {
+        return presence_min_grace;
+    }
+    return grace > _timeout ? _timeout : grace;
+}
+
+const PresenceProfile& PresenceStateMachine::profile(const PdDevice& device) const
+{
+    return device.profile < _profiles.size() ? _profiles[device.profile] : _profiles[0];
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include <functional>
+#include "DeviceMap.h"
+#include "DeviceClassifier.h"
+
+#define presence_max_profiles 16
+// Shortest grace period, below it a device would leave during a normal pause between scans
+#define presence_min_grace 2000
+// ms after the last advertisement a device that is away or never arrived is dropped, e.g. a private address that rotated
+#define presence_away_retention 600000
+// Most devices tracked at once, the one that is away for the longest time makes room for a new one
+#define presence_max_devices 512
+
+enum class PresenceState : uint8_t
+{
+    Unknown = 0, // seen, but never strong enough to arrive
+    Arriving = 1, // strong enough, waiting for the enter time to pass
+    Present = 2,
+    Leaving = 3, // weak or missing, waiting for the exit time to pass
+    Away = 4
+};
+
+// Thresholds with hysteresis: a device arrives above enterRssi and leaves below exitRssi (smoothed RSSI)
+struct PresenceProfile
+{
+    int8_t enterRssi = -128;
+    int8_t exitRssi = -128;
+    uint32_t enterTime = 0; // ms a device has to stay strong before it's present
+    uint32_t exitTime = 0; // ms a device has to stay weak or missing before it's away
+};
+
+// Decides presence per device. Advertisements are evaluated as they arrive, time based transitions
+// are kept in a min-heap of deadlines, so a tick only touches the devices that are actually due.
+// The grace period after the last advertisement adapts to the measured advertising interval of each device.
+// Devices that are away or never arrived stay in the heap until they are dropped after presence_away_retention.
+// Not thread safe, PresenceDetection only uses it while holding the devices mutex.
+class PresenceStateMachine
+{
+public:
+    PresenceStateMachine(DeviceMap* devices, const unsigned long timeout, const uint8_t graceIntervals);
+
+    // One profile per line: <address, class name or "default"> <enter rssi> <exit rssi> <enter ms> <exit ms>,
+    // e.g. "tag -70 -80 0 5000". Returns the number of profiles loaded.
+    int loadProfiles(const char* config);
+    // Profiles by address take precedence over profiles by device class
+    void assignProfile(const long long address, PdDevice& device) const;
+
+    // Called for every advertisement, updates timestamp and interval. Returns true if the device
+    // arrived or left, i.e. it has to be added to or removed from the reports.
+    bool onAdvertisement(const long long address, PdDevice& device, const unsigned long ts);
+    // Applies the time based transitions that are due. Returns true if a device arrived or left.
+    bool processDeadlines(const unsigned long ts);
+    // Returns false if no deadline is pending
+    bool nextDeadline(unsigned long& deadline) const;
+
+    // Called after every state change, from the task that caused it
+    void setStateCallback(std::function<void(const long long, PdDevice&)> callback);
+    // Called before a device is dropped, to release what it references
+    void setEvictCallback(std::function<void(const long long, PdDevice&)> callback);
+
+    // Drops the device that is away or unknown for the longest time. Returns false if all devices are
+    // present or arriving. Invalidates iterators and references into the devices.
+    bool evictOldest(const unsigned long ts);
+
+    // Schedules a device whose state was set elsewhere, e.g. restored from a snapshot
+    void track(const long long address, PdDevice& device);
+
+    static bool isPresent(const PdDevice& device);
+    static const char* stateName(const PresenceState state);
+
+private:
+    struct Deadline
+    {
+        uint32_t ts;
+        long long address;
+        uint8_t generation; // entries replaced by a later one are stale
+    };
+
+    bool evaluate(const long long address, PdDevice& device, const unsigned long ts);
+    bool setState(const long long address, PdDevice& device, const PresenceState state, const unsigned long ts);
+    bool deadline(const PdDevice& device, unsigned long& deadline) const;
+    void schedule(const long long address, PdDevice& device);
+    bool expired(const PdDevice& device, const unsigned long ts) const;
+    void evict(DeviceMap::iterator it);
+    unsigned long grace(const PdDevice& device) const;
+    const PresenceProfile& profile(const PdDevice& device) const;
+
+    DeviceMap* _devices;
+    const unsigned long _timeout;
+    const uint8_t _graceIntervals;
+    std::vector<PresenceProfile> _profiles; // 0 is the default profile
+    std::map<long long, uint8_t> _addressProfiles;
+    uint8_t _classProfiles[device_class_count] = {0};
+    std::vector<Deadline> _deadlines;
+    std::function<void(const long long, PdDevice&)> _stateCallback = nullptr;
+    std::function<void(const long long, PdDevice&)> _evictCallback = nullptr;
+};
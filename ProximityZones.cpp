@@ -0,0 +1,271 @@
+#include "ProximityZones.h"
+#include "PresenceStateMachine.h"
+#include <string.h>
+
+static const char* proximityZoneNames[] = { "none", "far", "near", "immediate" };
+
+ProximityZones::ProximityZones(Gpio* gpio)
+: _gpio(gpio)
+{
+    _rules.push_back(ProximityRule());
+}
+
+int ProximityZones::loadRules(const char* config)
+{
+    int loaded = 0;
+    const char* line = config;
+
+    while(line != nullptr && *line != 0x00)
+    {
+        const char* end = strchr(line, '\n');
+        char buffer[80] = {0};
+        size_t length = end != nullptr ? end - line : strlen(line);
+        memcpy(buffer, line, length < sizeof(buffer) - 1 ? length : sizeof(buffer) - 1);
+        line = end != nullptr ? end + 1 : nullptr;
+
+        char target[32];
+        char actionZone[16] = {0};
+        int immediateRssi, nearRssi;
+        int hysteresis = 4;
+        int pin = 0;
+        int fields = sscanf(buffer, "%31s %d %d %d %15s %d", target, &immediateRssi, &nearRssi, &hysteresis, actionZone, &pin);
+        if(fields < 3 || fields == 5)
+        {
+            continue;
+        }
+
+        ProximityRule rule;
+        rule.immediateRssi = immediateRssi < -127 ? -127 : (immediateRssi > 0 ? 0 : immediateRssi);
+        rule.nearRssi = nearRssi < -127 ? -127 : (nearRssi > rule.immediateRssi ? rule.immediateRssi : nearRssi);
+        rule.hysteresis = hysteresis < 0 ? 0 : (hysteresis > 20 ? 20 : hysteresis);
+
+        if(fields == 6)
+        {
+            for(int i = (int)ProximityZone::Far; i <= (int)ProximityZone::Immediate; i++)
+            {
+                if(strcmp(actionZone, proximityZoneNames[i]) == 0)
+                {
+                    rule.actionZone = (ProximityZone)i;
+                }
+            }
+
+            if(rule.actionZone != ProximityZone::None && _gpio != nullptr && _gpio->setOutput(pin, false))
+            {
+                rule.outputPin = pin;
+            }
+            else
+            {
+                Serial.print(F("Ignoring proximity action of "));
+                Serial.println(target);
+                rule.actionZone = ProximityZone::None;
+            }
+        }
+
+        if(strcmp(target, "default") == 0)
+        {
+            _rules[0] = rule;
+            _hasDefaultRule = true;
+            ++loaded;
+            continue;
+        }
+
+        if(_rules.size() >= proximity_max_rules)
+        {
+            break;
+        }
+
+        unsigned int a[6];
+        if(sscanf(target, "%2x:%2x:%2x:%2x:%2x:%2x", &a[0], &a[1], &a[2], &a[3], &a[4], &a[5]) == 6)
+        {
+            long long address = 0;
+            for(int i = 0; i < 6; i++)
+            {
+                address = (address << 8) | a[i];
+            }
+            _addressRules[address] = _rules.size();
+            _rules.push_back(rule);
+            ++loaded;
+            continue;
+        }
+
+        for(int i = 1; i < device_class_count; i++)
+        {
+            if(strcmp(target, DeviceClassifier::className((DeviceClass)i)) == 0)
+            {
+                _classRules[i] = _rules.size();
+                _rules.push_back(rule);
+                ++loaded;
+                break;
+            }
+        }
+    }
+
+    return loaded;
+}
+
+bool ProximityZones::enabled() const
+{
+    return _hasDefaultRule || _rules.size() > 1;
+}
+
+bool ProximityZones::update(const long long address, PdDevice& device)
+{
+    const ProximityRule* deviceRule = rule(address, device);
+    if(deviceRule == nullptr)
+    {
+        remove(address);
+        return false;
+    }
+
+    ProximityZone previous = zone(device);
+    ProximityZone current = evaluate(*deviceRule, device, previous);
+    if(current == previous)
+    {
+        // The rule can change without a zone change, e.g. once the device is classified, so its output
+        // is switched over to the pin of the new rule
+        if(deviceRule->outputPin != 0 || !_deviceOutputs.empty())
+        {
+            applyAction(address, *deviceRule, current);
+        }
+        return false;
+    }
+
+    device.flags = (device.flags & ~pd_device_zone_mask) | ((uint8_t)current << pd_device_zone_shift);
+    applyAction(address, *deviceRule, current);
+    queueEvent(address, current);
+    return true;
+}
+
+bool ProximityZones::popEvent(ProximityEvent& event)
+{
+    if(_eventCount == 0)
+    {
+        return false;
+    }
+
+    event = _events[_eventStart];
+    _eventStart = (_eventStart + 1) % proximity_event_queue_size;
+    --_eventCount;
+    return true;
+}
+
+ProximityZone ProximityZones::zone(const PdDevice& device)
+{
+    return (ProximityZone)((device.flags & pd_device_zone_mask) >> pd_device_zone_shift);
+}
+
+const char* ProximityZones::zoneName(const ProximityZone zone)
+{
+    return proximityZoneNames[(uint8_t)zone & 0x03];
+}
+
+const ProximityRule* ProximityZones::rule(const long long address, const PdDevice& device) const
+{
+    auto it = _addressRules.find(address);
+    if(it != _addressRules.end())
+    {
+        return &_rules[it->second];
+    }
+    if(device.deviceClass < device_class_count && _classRules[device.deviceClass] != 0)
+    {
+        return &_rules[_classRules[device.deviceClass]];
+    }
+    return _hasDefaultRule ? &_rules[0] : nullptr;
+}
+
+ProximityZone ProximityZones::evaluate(const ProximityRule& rule, const PdDevice& device, const ProximityZone current) const
+{
+    if(!PresenceStateMachine::isPresent(device))
+    {
+        return ProximityZone::None;
+    }
+    if(!(device.flags & pd_device_flag_rssi))
+    {
+        return current == ProximityZone::None ? ProximityZone::Far : current;
+    }
+
+    // Zones closer than the current one need the full threshold, the current and farther ones are
+    // kept down to hysteresis dB below it
+    const int8_t thresholds[] = { rule.immediateRssi, rule.nearRssi };
+    const ProximityZone zones[] = { ProximityZone::Immediate, ProximityZone::Near };
+    for(int i = 0; i < 2; i++)
+    {
+        int required = zones[i] > current ? thresholds[i] : thresholds[i] - rule.hysteresis;
+        if(device.smoothedRssi >= required)
+        {
+            return zones[i];
+        }
+    }
+    return ProximityZone::Far;
+}
+
+void ProximityZones::applyAction(const long long address, const ProximityRule& rule, const ProximityZone current)
+{
+    uint8_t pin = rule.outputPin != 0 && current >= rule.actionZone ? rule.outputPin : 0;
+
+    auto it = _deviceOutputs.find(address);
+    uint8_t heldPin = it != _deviceOutputs.end() ? it->second : 0;
+    if(heldPin == pin)
+    {
+        return;
+    }
+
+    if(heldPin != 0)
+    {
+        releaseOutput(heldPin);
+        _deviceOutputs.erase(it);
+    }
+
+    if(pin != 0)
+    {
+        // Several devices can share an output, it stays on while any of them is close enough
+        if(_activeDevices[pin]++ == 0)
+        {
+            _gpio->setOutput(pin, true);
+        }
+        _deviceOutputs[address] = pin;
+    }
+}
+
+void ProximityZones::releaseOutput(const uint8_t pin)
+{
+    uint16_t& count = _activeDevices[pin];
+    if(count > 0 && --count == 0)
+    {
+        _gpio->setOutput(pin, false);
+    }
+}
+
+void ProximityZones::remove(const long long address)
+{
+    auto it = _deviceOutputs.find(address);
+    if(it != _deviceOutputs.end())
+    {
+        releaseOutput(it->second);
+        _deviceOutputs.erase(it);
+    }
+}
+
+void ProximityZones::queueEvent(const long long address, const ProximityZone zone)
+{
+    // A device that changes again before it was published only needs its latest zone
+    for(uint8_t i = 0; i < _eventCount; i++)
+    {
+        ProximityEvent& event = _events[(_eventStart + i) % proximity_event_queue_size];
+        if(event.address == address)
+        {
+            event.zone = zone;
+            return;
+        }
+    }
+
+    if(_eventCount == proximity_event_queue_size)
+    {
+        // Drop the oldest change, the retained topic of that device is corrected by its next change
+        _eventStart = (_eventStart + 1) % proximity_event_queue_size;
+        --_eventCount;
+    }
+
+    _events[(_eventStart + _eventCount) % proximity_event_queue_size] = { address, zone };
+    ++_eventCount;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <Arduino.h>
+#include <map>
+#include <vector>
+#include "PdDevice.h"
+#include "DeviceClassifier.h"
+#include "Gpio.h"
+
+#define proximity_max_rules 16
+// Zone changes wait here until the presence task publishes them
+#define proximity_event_queue_size 32
+
+enum class ProximityZone : uint8_t
+{
+    None = 0, // not present
+    Far = 1,
+    Near = 2,
+    Immediate = 3
+};
+
+// Smoothed RSSI thresholds of a zone. A device enters a zone at its threshold and leaves it hysteresis dB below.
+struct ProximityRule
+{
+    int8_t immediateRssi = -55;
+    int8_t nearRssi = -70;
+    uint8_t hysteresis = 4;
+    ProximityZone actionZone = ProximityZone::None; // the output is on while a device is in this zone or closer
+    uint8_t outputPin = 0; // GPIO number, 0 for none
+};
+
+struct ProximityEvent
+{
+    long long address;
+    ProximityZone zone;
+};
+
+// Assigns present devices to the zones immediate, near and far on the node and switches GPIO outputs
+// right away, so door locks and lights don't wait for a round trip through the broker.
+// Not thread safe, PresenceDetection only uses it while holding the devices mutex.
+class ProximityZones
+{
+public:
+    explicit ProximityZones(Gpio* gpio);
+
+    // One rule per line: <address, class name or "default"> <immediate rssi> <near rssi> [<hysteresis> [<zone> <gpio>]],
+    // e.g. "tag -55 -70 4 near 13". Devices without matching rule have no zone. Returns the number of rules loaded.
+    int loadRules(const char* config);
+    bool enabled() const;
+
+    // Evaluates the zone of a device after an advertisement or presence change and keeps its output
+    // in line with its current rule. Returns true if the zone changed, the change is queued as event then.
+    bool update(const long long address, PdDevice& device);
+    bool popEvent(ProximityEvent& event);
+    // Releases the output a device holds, call before the device record is dropped
+    void remove(const long long address);
+
+    static ProximityZone zone(const PdDevice& device);
+    static const char* zoneName(const ProximityZone zone);
+
+private:
+    const ProximityRule* rule(const long long address, const PdDevice& device) const;
+    ProximityZone evaluate(const ProximityRule& rule, const PdDevice& device, const ProximityZone current) const;
+    void applyAction(const long long address, const ProximityRule& rule, const ProximityZone current);
+    void releaseOutput(const uint8_t pin);
+    void queueEvent(const long long address, const ProximityZone zone);
+
+    Gpio* _gpio;
+    std::vector<ProximityRule> _rules; // 0 is the default rule
+    bool _hasDefaultRule = false;
+    std::map<long long, uint8_t> _addressRules;
+    uint8_t _classRules[device_class_count] = {0};
+    std::map<uint8_t, uint16_t> _activeDevices; // per output pin
+    // Output each device switched on. The rule of a device can change while it is in a zone, e.g. when
+    // it is classified later, so the pin is released that was switched on, not the one of the current rule.
+    std::map<long long, uint8_t> _deviceOutputs;
+
+    ProximityEvent _events[proximity_event_queue_size];
+    uint8_t _eventStart = 0;
+    uint8_t _eventCount = 0;
+};
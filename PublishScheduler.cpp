@@ -0,0 +1,247 @@
+#include "PublishScheduler.h"
+#include <algorithm>
+#include "Version.h"
+
+PublishScheduler::PublishScheduler()
+{
+    _mutex = xSemaphoreCreateMutex();
+
+    _queues[(int)PublishClass::Control].rate = publish_control_rate;
+    _queues[(int)PublishClass::Control].burst = publish_control_burst;
+    _queues[(int)PublishClass::Control].maxQueuedBytes = publish_control_max_queued;
+    _queues[(int)PublishClass::Presence].rate = publish_presence_rate;
+    _queues[(int)PublishClass::Presence].burst = publish_presence_burst;
+    _queues[(int)PublishClass::Presence].maxQueuedBytes = publish_presence_max_queued;
+    _queues[(int)PublishClass::Telemetry].rate = publish_telemetry_rate;
+    _queues[(int)PublishClass::Telemetry].burst = publish_telemetry_burst;
+    _queues[(int)PublishClass::Telemetry].maxQueuedBytes = publish_telemetry_max_queued;
+
+    for(auto& queue : _queues)
+    {
+        queue.tokens = queue.burst;
+    }
+}
+
+PublishScheduler::~PublishScheduler()
+{
+    for(auto& queue : _queues)
+    {
+        for(auto& message : queue.messages)
+        {
+            message.payload->release();
+        }
+    }
+    vSemaphoreDelete(_mutex);
+}
+
+void PublishScheduler::setDevice(NetworkDevice* device)
+{
+    _device = device;
+}
+
+bool PublishScheduler::publish(const PublishClass publishClass, const char* topic, espMqttClientTypes::SharedPayload* payload,
+                               const bool retain, const bool latest, const uint32_t messageExpiry, const unsigned long waitMs)
+{
+    // Roughly what the message takes in the outbox: fixed header, topic, packet id and payload
+    size_t size = 5 + strlen(topic) + payload->length();
+    ClassQueue& queue = _queues[(int)publishClass];
+    unsigned long startTs = millis();
+
+    while(true)
+    {
+        bool timedOut = millis() - startTs >= waitMs;
+
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        bool queued = enqueue(queue, topic, payload, size, retain, latest, messageExpiry);
+        if(!queued && timedOut)
+        {
+            ++queue.dropped;
+        }
+        xSemaphoreGive(_mutex);
+
+        if(queued || timedOut)
+        {
+            return queued;
+        }
+        delay(publish_wait_step);
+    }
+}
+
+bool PublishScheduler::publish(const PublishClass publishClass, const char* topic, const char* payload, const bool retain, const bool latest,
+                               const unsigned long waitMs)
+{
+    size_t length = strlen(payload);
+    espMqttClientTypes::SharedPayload* shared = espMqttClientTypes::SharedPayload::create(length);
+    if(shared == nullptr)
+    {
+        xSemaphoreTake(_mutex, portMAX_DELAY);
+        ++_queues[(int)publishClass].dropped;
+        xSemaphoreGive(_mutex);
+        return false;
+    }
+    memcpy(shared->data(), payload, length);
+
+    bool success = publish(publishClass, topic, shared, retain, latest, 0, waitMs);
+    shared->release();
+    return success;
+}
+
+bool PublishScheduler::enqueue(ClassQueue& queue, const char* topic, espMqttClientTypes::SharedPayload* payload, const size_t size,
+                               const bool retain, const bool latest, const uint32_t messageExpiry)
+{
+    unsigned long ts = millis();
+    bool replaced = false;
+    if(latest)
+    {
+        for(auto& message : queue.messages)
+        {
+            if(message.latest && message.topic == topic)
+            {
+                // Keeps its place in the queue, so the latency counts from the first value
+                payload->retain();
+                message.payload->release();
+                message.payload = payload;
+                queue.queuedBytes = queue.queuedBytes - message.size + size;
+                message.size = size;
+                message.retain = retain;
+                message.messageExpiry = messageExpiry;
+                ++queue.replaced;
+                replaced = true;
+                break;
+            }
+        }
+    }
+
+    if(!replaced)
+    {
+        // A message larger than the whole queue is still accepted when nothing else is waiting
+        if(!queue.messages.empty() && queue.queuedBytes + size > queue.maxQueuedBytes)
+        {
+            return false;
+        }
+
+        payload->retain();
+        queue.messages.push_back({ String(topic), payload, messageExpiry, ts, size, retain, latest });
+        queue.queuedBytes += size;
+    }
+
+    if(queue.queuedBytes > queue.peakQueuedBytes)
+    {
+        queue.peakQueuedBytes = queue.queuedBytes;
+    }
+
+    return true;
+}
+
+void PublishScheduler::update()
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    dispatch(millis());
+    xSemaphoreGive(_mutex);
+}
+
+void PublishScheduler::dispatch(const unsigned long ts)
+{
+    if(_device == nullptr || !_device->mqttConnected())
+    {
+        return;
+    }
+
+    size_t outboxBytes = _device->mqttOutboxBytes();
+
+    for(int i = 0; i < publish_class_count; i++)
+    {
+        ClassQueue& queue = _queues[i];
+        refill(queue, ts);
+
+        while(!queue.messages.empty())
+        {
+            if(i != (int)PublishClass::Control && outboxBytes >= publish_outbox_high_water)
+            {
+                return;
+            }
+
+            const PendingPublish& message = queue.messages.front();
+            // A message larger than the bucket waits until the bucket is full
+            if(queue.rate > 0 && queue.tokens < std::min<float>(message.size, queue.burst))
+            {
+                break;
+            }
+
+            if(send(queue, message, ts))
+            {
+                outboxBytes += message.size;
+            }
+            if(queue.rate > 0)
+            {
+                queue.tokens -= message.size;
+            }
+
+            queue.queuedBytes -= message.size;
+            message.payload->release();
+            queue.messages.pop_front();
+        }
+    }
+}
+
+bool PublishScheduler::send(ClassQueue& queue, const PendingPublish& message, const unsigned long ts)
+{
+    uint16_t packetId;
+    if(message.latest)
+    {
+        packetId = _device->mqttPublishLatest(message.topic.c_str(), MQTT_QOS_LEVEL, message.retain, message.messageExpiry, message.payload);
+    }
+    else
+    {
+        packetId = _device->mqttPublish(message.topic.c_str(), MQTT_QOS_LEVEL, message.retain, message.payload);
+    }
+
+    if(packetId == 0)
+    {
+        ++queue.dropped;
+        return false;
+    }
+
+    unsigned long latency = ts - message.queuedTs;
+    ++queue.sent;
+    queue.latencySum += latency;
+    if(latency > queue.maxLatency)
+    {
+        queue.maxLatency = latency;
+    }
+    return true;
+}
+
+void PublishScheduler::refill(ClassQueue& queue, const unsigned long ts)
+{
+    if(queue.rate == 0)
+    {
+        return;
+    }
+
+    queue.tokens += (float)queue.rate * (ts - queue.lastRefillTs) / 1000.0f;
+    if(queue.tokens > queue.burst)
+    {
+        queue.tokens = queue.burst;
+    }
+    queue.lastRefillTs = ts;
+}
+
+const PublishClassStats PublishScheduler::stats(const PublishClass publishClass)
+{
+    xSemaphoreTake(_mutex, portMAX_DELAY);
+    const ClassQueue& queue = _queues[(int)publishClass];
+
+    PublishClassStats stats;
+    stats.queuedMessages = queue.messages.size();
+    stats.queuedBytes = queue.queuedBytes;
+    stats.peakQueuedBytes = queue.peakQueuedBytes;
+    stats.sent = queue.sent;
+    stats.replaced = queue.replaced;
+    stats.dropped = queue.dropped;
+    stats.averageLatency = queue.sent > 0 ? queue.latencySum / queue.sent : 0;
+    stats.maxLatency = queue.maxLatency;
+
+    xSemaphoreGive(_mutex);
+    return stats;
+}
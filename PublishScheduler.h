@@ -0,0 +1,112 @@
+#pragma once
+
+#include <Arduino.h>
+#include <deque>
+#include "networkDevices/NetworkDevice.h"
+
+// Lower classes are sent first
+enum class PublishClass : uint8_t
+{
+    Control = 0, // GPIO inputs and alerts
+    Presence = 1, // presence reports, zone changes and query answers
+    Telemetry = 2 // sensors, crowd estimates, uptime and RSSI
+};
+
+#define publish_class_count 3
+
+// Token buckets in bytes per second and bytes, 0 bytes per second doesn't limit the class
+#define publish_control_rate 2048
+#define publish_control_burst 4096
+#define publish_control_max_queued 2048
+#define publish_presence_rate 8192
+#define publish_presence_burst 16384
+#define publish_presence_max_queued 16384
+#define publish_telemetry_rate 1024
+#define publish_telemetry_burst 4096
+#define publish_telemetry_max_queued 4096
+// Presence and telemetry wait while the MQTT client has more bytes queued, control messages never do
+#define publish_outbox_high_water 4096
+// ms between checks for queue space when a publish waits for it
+#define publish_wait_step 10
+
+struct PublishClassStats
+{
+    uint16_t queuedMessages;
+    size_t queuedBytes;
+    size_t peakQueuedBytes;
+    uint32_t sent;
+    uint32_t replaced; // superseded by a newer value while queued
+    uint32_t dropped; // queue full, out of memory or rejected by the MQTT client
+    unsigned long averageLatency; // ms from publishing until handed to the MQTT client
+    unsigned long maxLatency;
+};
+
+// Holds publishes per priority class until the MQTT client can take them, so a large presence report
+// doesn't delay GPIO events and a burst of telemetry doesn't saturate the uplink. Each class is limited
+// by its own token bucket and queue size, presence and telemetry also by the bytes the MQTT client has
+// queued. publish() only queues, the messages are handed over in update() on the network task, so
+// publishing from a task with a small stack never runs the MQTT client. Thread safe.
+class PublishScheduler
+{
+public:
+    PublishScheduler();
+    PublishScheduler(const PublishScheduler&) = delete;
+    PublishScheduler& operator=(const PublishScheduler&) = delete;
+    virtual ~PublishScheduler();
+
+    void setDevice(NetworkDevice* device);
+
+    // latest replaces a message on the same topic that is still queued, for retained state.
+    // The payload is referenced, not copied. If the class queue is full, waits up to waitMs for update()
+    // to make room, e.g. for the pages of a report that has to arrive complete. Returns false if it stays full.
+    // Never wait on the network task, it is the one that empties the queues.
+    bool publish(const PublishClass publishClass, const char* topic, espMqttClientTypes::SharedPayload* payload,
+                 const bool retain, const bool latest, const uint32_t messageExpiry = 0, const unsigned long waitMs = 0);
+    bool publish(const PublishClass publishClass, const char* topic, const char* payload, const bool retain, const bool latest,
+                 const unsigned long waitMs = 0);
+
+    // Hands queued messages to the MQTT client as far as the buckets and the outbox allow, only while
+    // MQTT is connected. Call regularly from the network task.
+    void update();
+
+    const PublishClassStats stats(const PublishClass publishClass);
+
+private:
+    struct PendingPublish
+    {
+        String topic;
+        espMqttClientTypes::SharedPayload* payload;
+        uint32_t messageExpiry;
+        unsigned long queuedTs;
+        size_t size;
+        bool retain;
+        bool latest;
+    };
+
+    struct ClassQueue
+    {
+        std::deque<PendingPublish> messages;
+        float tokens = 0;
+        unsigned long lastRefillTs = 0;
+        uint32_t rate = 0;
+        uint32_t burst = 0;
+        size_t maxQueuedBytes = 0;
+        size_t queuedBytes = 0;
+        size_t peakQueuedBytes = 0;
+        uint32_t sent = 0;
+        uint32_t replaced = 0;
+        uint32_t dropped = 0;
+        uint64_t latencySum = 0;
+        unsigned long maxLatency = 0;
+    };
+
+    bool enqueue(ClassQueue& queue, const char* topic, espMqttClientTypes::SharedPayload* payload, const size_t size,
+                 const bool retain, const bool latest, const uint32_t messageExpiry);
+    void dispatch(const unsigned long ts);
+    bool send(ClassQueue& queue, const PendingPublish& message, const unsigned long ts);
+    void refill(ClassQueue& queue, const unsigned long ts);
+
+    NetworkDevice* _device = nullptr;
+    ClassQueue _queues[publish_class_count];
+    SemaphoreHandle_t _mutex;
+};
@@ -0,0 +1,283 @@
+#include "RpaResolver.h"
+#include <string.h>
+
+#if !defined(ESP32)
+static const uint8_t aesSbox[256] =
+{
+    0x63, 0x7c, 0x77, 0x7b, 0xf2, 0x6b, 0x6f, 0xc5, 0x30, 0x01, 0x67, 0x2b, 0xfe, 0xd7, 0xab, 0x76,
+    0xca, 0x82, 0xc9, 0x7d, 0xfa, 0x59, 0x47, 0xf0, 0xad, 0xd4, 0xa2, 0xaf, 0x9c, 0xa4, 0x72, 0xc0,
+    0xb7, 0xfd, 0x93, 0x26, 0x36, 0x3f, 0xf7, 0xcc, 0x34, 0xa5, 0xe5, 0xf1, 0x71, 0xd8, 0x31, 0x15,
+    0x04, 0xc7, 0x23, 0xc3, 0x18, 0x96, 0x05, 0x9a, 0x07, 0x12, 0x80, 0xe2, 0xeb, 0x27, 0xb2, 0x75,
+    0x09, 0x83, 0x2c, 0x1a, 0x1b, 0x6e, 0x5a, 0xa0, 0x52, 0x3b, 0xd6, 0xb3, 0x29, 0xe3, 0x2f, 0x84,
+    0x53, 0xd1, 0x00, 0xed, 0x20, 0xfc, 0xb1, 0x5b, 0x6a, 0xcb, 0xbe, 0x39, 0x4a, 0x4c, 0x58, 0xcf,
+    0xd0, 0xef, 0xaa, 0xfb, 0x43, 0x4d, 0x33, 0x85, 0x45, 0xf9, 0x02, 0x7f, 0x50, 0x3c, 0x9f, 0xa8,
+    0x51, 0xa3, 0x40, 0x8f, 0x92, 0x9d, 0x38, 0xf5, 0xbc, 0xb6, 0xda, 0x21, 0x10, 0xff, 0xf3, 0xd2,
+    0xcd, 0x0c, 0x13, 0xec, 0x5f, 0x97, 0x44, 0x17, 0xc4, 0xa7, 0x7e, 0x3d, 0x64, 0x5d, 0x19, 0x73,
+    0x60, 0x81, 0x4f, 0xdc, 0x22, 0x2a, 0x90, 0x88, 0x46, 0xee, 0xb8, 0x14, 0xde, 0x5e, 0x0b, 0xdb,
+    0xe0, 0x32, 0x3a, 0x0a, 0x49, 0x06, 0x24, 0x5c, 0xc2, 0xd3, 0xac, 0x62, 0x91, 0x95, 0xe4, 0x79,
+    0xe7, 0xc8, 0x37, 0x6d, 0x8d, 0xd5, 0x4e, 0xa9, 0x6c, 0x56, 0xf4, 0xea, 0x65, 0x7a, 0xae, 0x08,
+    0xba, 0x78, 0x25, 0x2e, 0x1c, 0xa6, 0xb4, 0xc6, 0xe8, 0xdd, 0x74, 0x1f, 0x4b, 0xbd, 0x8b, 0x8a,
+    0x70, 0x3e, 0xb5, 0x66, 0x48, 0x03, 0xf6, 0x0e, 0x61, 0x35, 0x57, 0xb9, 0x86, 0xc1, 0x1d, 0x9e,
+    0xe1, 0xf8, 0x98, 0x11, 0x69, 0xd9, 0x8e, 0x94, 0x9b, 0x1e, 0x87, 0xe9, 0xce, 0x55, 0x28, 0xdf,
+    0x8c, 0xa1, 0x89, 0x0d, 0xbf, 0xe6, 0x42, 0x68, 0x41, 0x99, 0x2d, 0x0f, 0xb0, 0x54, 0xbb, 0x16
+};
+
+static uint8_t aesXtime(const uint8_t x)
+{
+    return (x << 1) ^ ((x & 0x80) ? 0x1B : 0x00);
+}
+
+static void aesExpandKey(const uint8_t* key, uint8_t* roundKeys)
+{
+    static const uint8_t rcon[10] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+
+    memcpy(roundKeys, key, 16);
+    for(int i = 4; i < 44; i++)
+    {
+        uint8_t word[4];
+        memcpy(word, &roundKeys[(i - 1) * 4], 4);
+        if(i % 4 == 0)
+        {
+            uint8_t first = word[0];
+            word[0] = aesSbox[word[1]] ^ rcon[i / 4 - 1];
+            word[1] = aesSbox[word[2]];
+            word[2] = aesSbox[word[3]];
+            word[3] = aesSbox[first];
+        }
+        for(int j = 0; j < 4; j++)
+        {
+            roundKeys[i * 4 + j] = roundKeys[(i - 4) * 4 + j] ^ word[j];
+        }
+    }
+}
+
+static void aesEncryptBlock(const uint8_t* roundKeys, const uint8_t* in, uint8_t* out)
+{
+    // State is column major, state[column * 4 + row]
+    uint8_t state[16];
+    uint8_t shifted[16];
+
+    for(int i = 0; i < 16; i++)
+    {
+        state[i] = in[i] ^ roundKeys[i];
+    }
+
+    for(int round = 1; round <= 10; round++)
+    {
+        // SubBytes and ShiftRows
+        for(int column = 0; column < 4; column++)
+        {
+            for(int row = 0; row < 4; row++)
+            {
+                shifted[column * 4 + row] = aesSbox[state[((column + row) % 4) * 4 + row]];
+            }
+        }
+
+        // MixColumns, skipped in the last round
+        if(round < 10)
+        {
+            for(int column = 0; column < 4; column++)
+            {
+                uint8_t* c = &shifted[column * 4];
+                uint8_t a0 = c[0], a1 = c[1], a2 = c[2], a3 = c[3];
+                uint8_t all = a0 ^ a1 ^ a2 ^ a3;
+                c[0] = a0 ^ all ^ aesXtime(a0 ^ a1);
+                c[1] = a1 ^ all ^ aesXtime(a1 ^ a2);
+                c[2] = a2 ^ all ^ aesXtime(a2 ^ a3);
+                c[3] = a3 ^ all ^ aesXtime(a3 ^ a0);
+            }
+        }
+
+        for(int i = 0; i < 16; i++)
+        {
+            state[i] = shifted[i] ^ roundKeys[round * 16 + i];
+        }
+    }
+
+    memcpy(out, state, 16);
+}
+#endif
+
+static int hexValue(const char c)
+{
+    if(c >= '0' && c <= '9')
+    {
+        return c - '0';
+    }
+    if(c >= 'a' && c <= 'f')
+    {
+        return c - 'a' + 10;
+    }
+    if(c >= 'A' && c <= 'F')
+    {
+        return c - 'A' + 10;
+    }
+    return -1;
+}
+
+RpaResolver::~RpaResolver()
+{
+    for(Key* key : _keys)
+    {
+#if defined(ESP32)
+        mbedtls_aes_free(&key->aes);
+#endif
+        delete key;
+    }
+}
+
+int RpaResolver::loadKeys(const char* keys)
+{
+    int added = 0;
+    uint8_t irk[rpa_irk_length];
+    int digits = 0;
+    bool valid = true;
+
+    for(const char* c = keys; ; c++)
+    {
+        bool separator = *c == 0x00 || *c == ',' || *c == ';' || *c == ' ' || *c == '\n' || *c == '\r' || *c == '\t';
+        if(separator)
+        {
+            if(valid && digits == rpa_irk_length * 2 && addKey(irk))
+            {
+                ++added;
+            }
+            digits = 0;
+            valid = true;
+            if(*c == 0x00)
+            {
+                break;
+            }
+            continue;
+        }
+
+        int value = hexValue(*c);
+        if(value < 0 || digits >= rpa_irk_length * 2)
+        {
+            valid = false;
+            continue;
+        }
+
+        if(digits % 2 == 0)
+        {
+            irk[digits / 2] = value << 4;
+        }
+        else
+        {
+            irk[digits / 2] |= value;
+        }
+        ++digits;
+    }
+
+    return added;
+}
+
+bool RpaResolver::addKey(const uint8_t* irk)
+{
+    if(_keys.size() >= rpa_max_irks)
+    {
+        return false;
+    }
+
+    Key* key = new Key();
+    memcpy(key->irk, irk, rpa_irk_length);
+
+    // Static random address (two most significant bits set) from the first bytes of the IRK
+    key->identity = 0;
+    for(int i = 0; i < 6; i++)
+    {
+        key->identity = (key->identity << 8) | irk[i];
+    }
+    key->identity |= 0xC00000000000LL;
+
+#if defined(ESP32)
+    mbedtls_aes_init(&key->aes);
+    mbedtls_aes_setkey_enc(&key->aes, key->irk, rpa_irk_length * 8);
+#else
+    aesExpandKey(key->irk, key->roundKeys);
+#endif
+
+    _keys.push_back(key);
+
+    // Unresolvable RPAs might belong to the new key
+    memset(_cache, 0, sizeof(_cache));
+
+    return true;
+}
+
+long long RpaResolver::resolve(const long long address)
+{
+    if(_keys.empty() || !isResolvable(address))
+    {
+        return address;
+    }
+
+    // Two way set associative, an RPA is random so its low bits are a good enough hash.
+    // The most recently used entry of a set is kept first.
+    CacheEntry* set = &_cache[((address ^ (address >> 24)) & (rpa_cache_size / 2 - 1)) * 2];
+    if((set[1] & 0xFFFFFFFFFFFFULL) == (uint64_t)address)
+    {
+        CacheEntry hit = set[1];
+        set[1] = set[0];
+        set[0] = hit;
+    }
+    else if((set[0] & 0xFFFFFFFFFFFFULL) != (uint64_t)address)
+    {
+        uint64_t keyIndex = 0;
+        for(size_t i = 0; i < _keys.size(); i++)
+        {
+            if(matches(*_keys[i], address))
+            {
+                keyIndex = i + 1;
+                break;
+            }
+        }
+        set[1] = set[0];
+        set[0] = address | (keyIndex << 48);
+    }
+
+    size_t keyIndex = set[0] >> 48;
+    return keyIndex > 0 ? _keys[keyIndex - 1]->identity : address;
+}
+
+long long RpaResolver::identityAddress(const size_t keyIndex) const
+{
+    return keyIndex < _keys.size() ? _keys[keyIndex]->identity : -1;
+}
+
+size_t RpaResolver::keyCount() const
+{
+    return _keys.size();
+}
+
+bool RpaResolver::isResolvable(const long long address)
+{
+    // Two most significant bits 01
+    return ((address >> 46) & 0x03) == 0x01;
+}
+
+bool RpaResolver::matches(const Key& key, const long long address) const
+{
+    // hash = ah(irk, prand) = e(irk, padding || prand) mod 2^24, RPA = prand || hash (Core spec Vol 3 Part H 2.2.2)
+    uint8_t plaintext[16] = {0};
+    uint8_t ciphertext[16];
+
+    plaintext[13] = (address >> 40) & 0xFF;
+    plaintext[14] = (address >> 32) & 0xFF;
+    plaintext[15] = (address >> 24) & 0xFF;
+
+    encrypt(key, plaintext, ciphertext);
+
+    return ciphertext[13] == ((address >> 16) & 0xFF) &&
+           ciphertext[14] == ((address >> 8) & 0xFF) &&
+           ciphertext[15] == (address & 0xFF);
+}
+
+void RpaResolver::encrypt(const Key& key, const uint8_t* in, uint8_t* out) const
+{
+#if defined(ESP32)
+    mbedtls_aes_crypt_ecb(const_cast<mbedtls_aes_context*>(&key.aes), MBEDTLS_AES_ENCRYPT, in, out);
+#else
+    aesEncryptBlock(key.roundKeys, in, out);
+#endif
+}
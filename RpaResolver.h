@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+#if defined(ESP32)
+#include "mbedtls/aes.h"
+#endif
+
+#define rpa_irk_length 16
+#define rpa_max_irks 16
+// Resolved and unresolvable RPAs are both cached, 8 bytes per entry, must be a power of two
+#define rpa_cache_size 256
+
+// Resolves Bluetooth resolvable private addresses (RPA) against identity resolving keys (IRK), so a phone
+// that rotates its address every few minutes is tracked as one identity.
+// AES runs on the ESP32 accelerator through mbedtls. Other platforms use a software AES, so the resolver
+// can be built and benchmarked on the host (see tools/rpa_benchmark.cpp).
+class RpaResolver
+{
+public:
+    RpaResolver() = default;
+    RpaResolver(const RpaResolver&) = delete;
+    RpaResolver& operator=(const RpaResolver&) = delete;
+    virtual ~RpaResolver();
+
+    // IRKs as 32 hex digits, most significant byte first, separated by whitespace, ',' or ';'.
+    // Returns the number of keys added.
+    int loadKeys(const char* keys);
+    bool addKey(const uint8_t* irk);
+
+    // Returns the identity address for an RPA matching one of the keys, otherwise the address itself.
+    // Only call this for random addresses, public addresses can look like RPAs.
+    long long resolve(const long long address);
+
+    // Static random address derived from the IRK, used to report the identity
+    long long identityAddress(const size_t keyIndex) const;
+    size_t keyCount() const;
+
+    static bool isResolvable(const long long address);
+
+private:
+    struct Key
+    {
+        uint8_t irk[rpa_irk_length];
+        long long identity;
+#if defined(ESP32)
+        mbedtls_aes_context aes;
+#else
+        uint8_t roundKeys[176];
+#endif
+    };
+
+    // Address in the lower 48 bits, key index + 1 above, 0 if the address didn't resolve
+    typedef uint64_t CacheEntry;
+
+    bool matches(const Key& key, const long long address) const;
+    void encrypt(const Key& key, const uint8_t* in, uint8_t* out) const;
+
+    std::vector<Key*> _keys;
+    CacheEntry _cache[rpa_cache_size] = {0};
+};
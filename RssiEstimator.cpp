@@ -0,0 +1,105 @@
+#include <NimBLEDevice.h>
+#include "RssiEstimator.h"
+#include "BeaconDecoder.h"
+
+RssiEstimator::RssiEstimator(const RssiFilterType filterType, const int defaultMeasuredPower, const float pathLossExponent)
+: _filterType(filterType),
+  _defaultMeasuredPower(defaultMeasuredPower),
+  _pathLossExponent(pathLossExponent)
+{}
+
+void RssiEstimator::update(PdDevice& device, const int rssi) const
+{
+    RssiFilterState& state = device.filter;
+    bool first = (device.flags & pd_device_flag_rssi) == 0;
+    int8_t clamped = rssi < -128 ? -128 : (rssi > 127 ? 127 : rssi);
+
+    device.rssi = clamped;
+    device.flags |= pd_device_flag_rssi;
+
+    switch(_filterType)
+    {
+        case RssiFilterType::Ema:
+            state.estimate.value = first ? clamped : state.estimate.value + rssi_ema_alpha * (clamped - state.estimate.value);
+            device.smoothedRssi = (int8_t)lroundf(state.estimate.value);
+            break;
+        case RssiFilterType::Kalman:
+            if(first)
+            {
+                state.estimate.value = clamped;
+                state.estimate.variance = rssi_kalman_measurement_noise;
+            }
+            else
+            {
+                float variance = state.estimate.variance + rssi_kalman_process_noise;
+                float gain = variance / (variance + rssi_kalman_measurement_noise);
+                state.estimate.value += gain * (clamped - state.estimate.value);
+                state.estimate.variance = (1.0f - gain) * variance;
+            }
+            device.smoothedRssi = (int8_t)lroundf(state.estimate.value);
+            break;
+        case RssiFilterType::Median:
+            state.median.ring[state.median.index] = clamped;
+            state.median.index = (state.median.index + 1) % rssi_median_window;
+            if(state.median.count < rssi_median_window)
+            {
+                ++state.median.count;
+            }
+            device.smoothedRssi = (int8_t)lroundf(median(state));
+            break;
+        default:
+            device.smoothedRssi = clamped;
+            break;
+    }
+}
+
+void RssiEstimator::calibrate(PdDevice& device, NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) const
+{
+    if(beacon != nullptr && beacon->hasTxPower)
+    {
+        device.measuredPower = beacon->measuredPower();
+        return;
+    }
+
+    // TX power level is given at 0 m, about 41 dB above the power received at 1 m
+    if(device.measuredPower == 0 && advertisedDevice->haveTXPower())
+    {
+        device.measuredPower = advertisedDevice->getTXPower() - 41;
+    }
+}
+
+float RssiEstimator::distance(const PdDevice& device) const
+{
+    int measuredPower = device.measuredPower != 0 ? device.measuredPower : _defaultMeasuredPower;
+    float distance = powf(10.0f, (measuredPower - device.smoothedRssi) / (10.0f * _pathLossExponent));
+    return distance < rssi_max_distance ? distance : rssi_max_distance;
+}
+
+bool RssiEstimator::enabled() const
+{
+    return _filterType != RssiFilterType::None;
+}
+
+float RssiEstimator::median(const RssiFilterState& state) const
+{
+    // Insertion sort over at most rssi_median_window values, constant work per advertisement
+    int8_t sorted[rssi_median_window];
+    uint8_t count = state.median.count;
+    for(int i = 0; i < count; i++)
+    {
+        int8_t value = state.median.ring[i];
+        int j = i;
+        while(j > 0 && sorted[j - 1] > value)
+        {
+            sorted[j] = sorted[j - 1];
+            --j;
+        }
+        sorted[j] = value;
+    }
+
+    if(count % 2 == 1)
+    {
+        return sorted[count / 2];
+    }
+    return (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0f;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <Arduino.h>
+#include <string>
+#include "PdDevice.h"
+
+#define rssi_ema_alpha 0.25f
+#define rssi_kalman_process_noise 0.1f
+#define rssi_kalman_measurement_noise 8.0f
+// typical measured power of a phone at 1 m, used when a device doesn't advertise its own
+#define rssi_default_measured_power -59
+// distances are published in cm as uint16
+#define rssi_max_distance 655.35f
+
+class NimBLEAdvertisedDevice;
+struct Beacon;
+
+enum class RssiFilterType
+{
+    None = 0,
+    Ema = 1,
+    Kalman = 2,
+    Median = 3
+};
+
+// Smooths the RSSI of a device with O(1) work per advertisement and estimates the distance
+// with the log-distance path loss model, using the device's calibrated power at 1 m.
+class RssiEstimator
+{
+public:
+    RssiEstimator(const RssiFilterType filterType, const int defaultMeasuredPower, const float pathLossExponent);
+
+    void update(PdDevice& device, const int rssi) const;
+    void calibrate(PdDevice& device, NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) const;
+
+    float distance(const PdDevice& device) const; // meters
+    bool enabled() const;
+
+private:
+    float median(const RssiFilterState& state) const;
+
+    const RssiFilterType _filterType;
+    const int _defaultMeasuredPower;
+    const float _pathLossExponent;
+};
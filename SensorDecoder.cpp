@@ -0,0 +1,397 @@
+#include "SensorDecoder.h"
+#include "MqttTopics.h"
+#include "AdStructureIterator.h"
+
+static const char* sensorQuantityNames[] = { "temperature", "humidity", "battery", "voltage", "pressure",
+                                             "illuminance", "moisture", "conductivity", "co2" };
+static const uint8_t sensorQuantityPrecision[] = { 2, 2, 0, 3, 2, 2, 2, 0, 0 };
+
+static int32_t readLe(const uint8_t* data, const uint8_t length, const bool isSigned)
+{
+    uint32_t value = 0;
+    for(int i = length - 1; i >= 0; i--)
+    {
+        value = (value << 8) | data[i];
+    }
+    if(isSigned && length < 4 && (value & (1UL << (length * 8 - 1))))
+    {
+        value |= ~0UL << (length * 8);
+    }
+    return (int32_t)value;
+}
+
+static int32_t readBe(const uint8_t* data, const uint8_t length, const bool isSigned)
+{
+    uint8_t reversed[4];
+    for(int i = 0; i < length; i++)
+    {
+        reversed[i] = data[length - 1 - i];
+    }
+    return readLe(reversed, length, isSigned);
+}
+
+// BTHome v2 objects: id, length, signed, factor, quantity. Objects without quantity are skipped.
+struct BtHomeObject
+{
+    uint8_t id;
+    uint8_t length;
+    bool isSigned;
+    float factor;
+    int8_t quantity; // SensorQuantity, -1 if not published
+};
+
+#define BTHOME_PACKET_ID 0x00
+
+static const BtHomeObject btHomeObjects[] =
+{
+    { 0x00, 1, false, 1, -1 }, // packet id
+    { 0x01, 1, false, 1, (int8_t)SensorQuantity::Battery },
+    { 0x02, 2, true, 0.01f, (int8_t)SensorQuantity::Temperature },
+    { 0x03, 2, false, 0.01f, (int8_t)SensorQuantity::Humidity },
+    { 0x04, 3, false, 0.01f, (int8_t)SensorQuantity::Pressure },
+    { 0x05, 3, false, 0.01f, (int8_t)SensorQuantity::Illuminance },
+    { 0x06, 2, false, 0.01f, -1 }, { 0x07, 2, false, 0.01f, -1 }, { 0x08, 2, true, 0.01f, -1 },
+    { 0x09, 1, false, 1, -1 }, { 0x0A, 3, false, 0.001f, -1 }, { 0x0B, 3, false, 0.01f, -1 },
+    { 0x0C, 2, false, 0.001f, (int8_t)SensorQuantity::Voltage },
+    { 0x0D, 2, false, 1, -1 }, { 0x0E, 2, false, 1, -1 },
+    { 0x12, 2, false, 1, (int8_t)SensorQuantity::Co2 },
+    { 0x13, 2, false, 1, -1 },
+    { 0x14, 2, false, 0.01f, (int8_t)SensorQuantity::Moisture },
+    { 0x2E, 1, false, 1, (int8_t)SensorQuantity::Humidity },
+    { 0x2F, 1, false, 1, (int8_t)SensorQuantity::Moisture },
+    { 0x3A, 1, false, 1, -1 }, { 0x3C, 2, false, 1, -1 }, { 0x3D, 2, false, 1, -1 }, { 0x3E, 4, false, 1, -1 },
+    { 0x3F, 2, true, 0.1f, -1 }, { 0x40, 2, false, 1, -1 }, { 0x41, 2, false, 0.1f, -1 }, { 0x42, 3, false, 0.001f, -1 },
+    { 0x43, 2, false, 0.001f, -1 }, { 0x44, 2, false, 0.01f, -1 },
+    { 0x45, 2, true, 0.1f, (int8_t)SensorQuantity::Temperature },
+    { 0x46, 1, false, 0.1f, -1 }, { 0x47, 2, false, 0.1f, -1 }, { 0x48, 2, false, 1, -1 }, { 0x49, 2, false, 0.001f, -1 },
+    { 0x4A, 2, false, 0.1f, (int8_t)SensorQuantity::Voltage },
+    { 0x4B, 3, false, 0.001f, -1 }, { 0x4C, 4, false, 0.001f, -1 }, { 0x4D, 4, false, 0.001f, -1 },
+    { 0x4E, 4, false, 0.001f, -1 }, { 0x4F, 4, false, 0.001f, -1 }, { 0x50, 4, false, 1, -1 },
+    { 0x51, 2, false, 0.001f, -1 }, { 0x52, 2, false, 0.001f, -1 },
+};
+
+static const BtHomeObject* findBtHomeObject(const uint8_t id)
+{
+    // Binary sensors are all one byte
+    static const BtHomeObject binary = { 0x0F, 1, false, 1, -1 };
+    if((id >= 0x0F && id <= 0x11) || (id >= 0x15 && id <= 0x2D))
+    {
+        return &binary;
+    }
+
+    for(const auto& object : btHomeObjects)
+    {
+        if(object.id == id)
+        {
+            return &object;
+        }
+    }
+    return nullptr;
+}
+
+static bool decodeBtHome(const uint8_t* data, const size_t length, SensorReading& reading)
+{
+    // device info: bit 0 encrypted, bits 5-7 version
+    if(length < 1 || (data[0] & 0x01) != 0 || (data[0] >> 5) != 2)
+    {
+        return false;
+    }
+
+    size_t index = 1;
+    while(index < length)
+    {
+        // An unknown object has an unknown length, nothing after it can be parsed
+        const BtHomeObject* object = findBtHomeObject(data[index]);
+        if(object == nullptr || index + 1 + object->length > length)
+        {
+            break;
+        }
+
+        int32_t raw = readLe(&data[index + 1], object->length, object->isSigned);
+        if(object->id == BTHOME_PACKET_ID)
+        {
+            reading.counter = raw;
+        }
+        else if(object->quantity >= 0)
+        {
+            reading.add((SensorQuantity)object->quantity, raw * object->factor);
+        }
+
+        index += 1 + object->length;
+    }
+
+    return reading.count > 0;
+}
+
+static bool decodeAtc1441(const uint8_t* data, const size_t length, SensorReading& reading)
+{
+    // mac (6), temperature (0.1 °C), humidity (%), battery (%), battery (mV), counter, big endian
+    if(length != 13)
+    {
+        return false;
+    }
+
+    reading.add(SensorQuantity::Temperature, readBe(&data[6], 2, true) * 0.1f);
+    reading.add(SensorQuantity::Humidity, data[8]);
+    reading.add(SensorQuantity::Battery, data[9]);
+    reading.add(SensorQuantity::Voltage, readBe(&data[10], 2, false) * 0.001f);
+    reading.counter = data[12];
+    return true;
+}
+
+static bool decodePvvx(const uint8_t* data, const size_t length, SensorReading& reading)
+{
+    // mac (6), temperature (0.01 °C), humidity (0.01 %), battery (mV), battery (%), counter, flags, little endian
+    if(length != 15)
+    {
+        return false;
+    }
+
+    reading.add(SensorQuantity::Temperature, readLe(&data[6], 2, true) * 0.01f);
+    reading.add(SensorQuantity::Humidity, readLe(&data[8], 2, false) * 0.01f);
+    reading.add(SensorQuantity::Voltage, readLe(&data[10], 2, false) * 0.001f);
+    reading.add(SensorQuantity::Battery, data[12]);
+    reading.counter = data[13];
+    return true;
+}
+
+struct MiBeaconObject
+{
+    uint16_t type;
+    uint8_t length;
+    bool isSigned;
+    float factor;
+    SensorQuantity quantity;
+};
+
+#define MIBEACON_TEMPERATURE_HUMIDITY 0x100D
+
+static const MiBeaconObject miBeaconObjects[] =
+{
+    { 0x1004, 2, true, 0.1f, SensorQuantity::Temperature },
+    { 0x1006, 2, false, 0.1f, SensorQuantity::Humidity },
+    { 0x1007, 3, false, 1, SensorQuantity::Illuminance },
+    { 0x1008, 1, false, 1, SensorQuantity::Moisture },
+    { 0x1009, 2, false, 1, SensorQuantity::Conductivity },
+    { 0x100A, 1, false, 1, SensorQuantity::Battery },
+};
+
+static bool decodeMiBeacon(const uint8_t* data, const size_t length, SensorReading& reading)
+{
+    // frame control, product id, frame counter, [mac], [capability, [io capability]], [object]
+    if(length < 5)
+    {
+        return false;
+    }
+
+    uint16_t frameControl = readLe(data, 2, false);
+    bool encrypted = frameControl & 0x0008;
+    bool hasMac = frameControl & 0x0010;
+    bool hasCapability = frameControl & 0x0020;
+    bool hasObject = frameControl & 0x0040;
+    if(encrypted || !hasObject)
+    {
+        return false;
+    }
+
+    size_t index = 5;
+    if(hasMac)
+    {
+        index += 6;
+    }
+    if(hasCapability)
+    {
+        if(index >= length)
+        {
+            return false;
+        }
+        index += (data[index] & 0x20) ? 3 : 1;
+    }
+
+    // object: type, length, value, little endian
+    while(index + 3 <= length)
+    {
+        uint16_t type = readLe(&data[index], 2, false);
+        uint8_t objectLength = data[index + 2];
+        const uint8_t* value = &data[index + 3];
+        if(index + 3 + objectLength > length)
+        {
+            break;
+        }
+
+        if(type == MIBEACON_TEMPERATURE_HUMIDITY && objectLength == 4)
+        {
+            reading.add(SensorQuantity::Temperature, readLe(value, 2, true) * 0.1f);
+            reading.add(SensorQuantity::Humidity, readLe(&value[2], 2, false) * 0.1f);
+        }
+        for(const auto& object : miBeaconObjects)
+        {
+            if(object.type == type && object.length == objectLength)
+            {
+                reading.add(object.quantity, readLe(value, object.length, object.isSigned) * object.factor);
+            }
+        }
+
+        index += 3 + objectLength;
+    }
+
+    reading.counter = data[4];
+    return reading.count > 0;
+}
+
+// ATC1441 and PVVX share the environmental sensing UUID and differ in length
+static const SensorFormat sensorFormats[] =
+{
+    { "bthome", BLE_HS_ADV_TYPE_SVC_DATA_UUID16, 0xFCD2, decodeBtHome },
+    { "atc1441", BLE_HS_ADV_TYPE_SVC_DATA_UUID16, 0x181A, decodeAtc1441 },
+    { "pvvx", BLE_HS_ADV_TYPE_SVC_DATA_UUID16, 0x181A, decodePvvx },
+    { "xiaomi", BLE_HS_ADV_TYPE_SVC_DATA_UUID16, 0xFE95, decodeMiBeacon },
+};
+
+void SensorReading::add(const SensorQuantity quantity, const float value)
+{
+    if(count < sensor_max_measurements)
+    {
+        measurements[count].quantity = quantity;
+        measurements[count].value = value;
+        ++count;
+    }
+}
+
+SensorDecoder::SensorDecoder(BeaconDecoder* beaconDecoder, Network* network)
+: _beaconDecoder(beaconDecoder),
+  _network(network)
+{
+    _queueMutex = xSemaphoreCreateMutex();
+    _beaconDecoder->subscribe(this);
+}
+
+SensorDecoder::~SensorDecoder()
+{
+    _beaconDecoder->unsubscribe(this);
+    _beaconDecoder = nullptr;
+    _network = nullptr;
+    vSemaphoreDelete(_queueMutex);
+}
+
+const SensorFormat* SensorDecoder::decode(const uint8_t* payload, const size_t length, SensorReading& reading)
+{
+    AdStructureIterator structures(payload, length);
+    uint8_t adType;
+    const uint8_t* data;
+    size_t dataLength;
+
+    while(structures.next(adType, data, dataLength))
+    {
+        if(dataLength >= 2)
+        {
+            uint16_t id = data[0] | (data[1] << 8);
+            for(const auto& format : sensorFormats)
+            {
+                if(format.adType == adType && format.id == id && format.decode(&data[2], dataLength - 2, reading))
+                {
+                    return &format;
+                }
+            }
+        }
+    }
+
+    return nullptr;
+}
+
+void SensorDecoder::onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon)
+{
+    if(beacon != nullptr)
+    {
+        return;
+    }
+
+    SensorReading reading;
+    const uint8_t* payload = advertisedDevice->getPayload();
+    size_t length = advertisedDevice->getPayloadLength();
+    const SensorFormat* format = decode(payload, length, reading);
+    if(format == nullptr)
+    {
+        return;
+    }
+
+    const uint8_t* native = advertisedDevice->getAddress().getNative();
+    for(int i = 5; i >= 0; i--)
+    {
+        reading.address = (reading.address << 8) | native[i];
+    }
+
+    // Sensors repeat each reading many times, only publish when the counter changed.
+    // Formats without counter are compared by their payload.
+    uint32_t fingerprint = 2166136261u;
+    if(reading.counter >= 0)
+    {
+        fingerprint = ((uint32_t)(format - sensorFormats) << 24) | (reading.counter & 0xFFFFFF);
+    }
+    else
+    {
+        for(size_t i = 0; i < length; i++)
+        {
+            fingerprint = (fingerprint ^ payload[i]) * 16777619u;
+        }
+    }
+
+    xSemaphoreTake(_queueMutex, portMAX_DELAY);
+    // Dropped if the network task falls behind, the sensor sends a new reading soon anyway
+    if(!isDuplicate(reading.address, fingerprint) && _queueCount < sensor_queue_size)
+    {
+        _queue[(_queueStart + _queueCount) % sensor_queue_size] = reading;
+        ++_queueCount;
+    }
+    xSemaphoreGive(_queueMutex);
+}
+
+void SensorDecoder::update()
+{
+    while(true)
+    {
+        SensorReading reading;
+
+        xSemaphoreTake(_queueMutex, portMAX_DELAY);
+        if(_queueCount == 0)
+        {
+            xSemaphoreGive(_queueMutex);
+            return;
+        }
+        reading = _queue[_queueStart];
+        _queueStart = (_queueStart + 1) % sensor_queue_size;
+        --_queueCount;
+        xSemaphoreGive(_queueMutex);
+
+        publish(reading);
+    }
+}
+
+bool SensorDecoder::isDuplicate(const long long address, const uint32_t fingerprint)
+{
+    DedupEntry& entry = _dedup[(address ^ (address >> 24)) % sensor_dedup_cache_size];
+    if(entry.address == address && entry.fingerprint == fingerprint)
+    {
+        return true;
+    }
+    entry.address = address;
+    entry.fingerprint = fingerprint;
+    return false;
+}
+
+void SensorDecoder::publish(const SensorReading& reading)
+{
+    if(_network->mqttConnectionState() == 0)
+    {
+        return;
+    }
+
+    char topic[60];
+    for(int i = 0; i < reading.count; i++)
+    {
+        const SensorMeasurement& measurement = reading.measurements[i];
+        snprintf(topic, sizeof(topic), "%s/%012llx/%s", mqtt_topic_sensors, reading.address,
+                 sensorQuantityNames[(int)measurement.quantity]);
+        _network->publishFloat(topic, measurement.value, sensorQuantityPrecision[(int)measurement.quantity]);
+    }
+}
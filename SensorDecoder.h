@@ -0,0 +1,83 @@
+#pragma once
+
+#include "BeaconDecoder.h"
+#include "Network.h"
+
+#define sensor_max_measurements 6
+// Readings wait here until the network task publishes them
+#define sensor_queue_size 16
+// Last packet counter per sensor, to drop repeated advertisements of the same reading
+#define sensor_dedup_cache_size 64
+
+enum class SensorQuantity : uint8_t
+{
+    Temperature = 0, // °C
+    Humidity, // %
+    Battery, // %
+    Voltage, // V
+    Pressure, // hPa
+    Illuminance, // lx
+    Moisture, // %
+    Conductivity, // µS/cm
+    Co2 // ppm
+};
+
+struct SensorMeasurement
+{
+    SensorQuantity quantity;
+    float value;
+};
+
+struct SensorReading
+{
+    long long address = 0;
+    int32_t counter = -1; // packet counter of the format, -1 if it has none
+    uint8_t count = 0;
+    SensorMeasurement measurements[sensor_max_measurements];
+
+    void add(const SensorQuantity quantity, const float value);
+};
+
+// Entry of the decoder registry. data points behind the service UUID or company id.
+struct SensorFormat
+{
+    const char* name;
+    uint8_t adType;
+    uint16_t id; // 16 bit service UUID or company id
+    bool (*decode)(const uint8_t* data, const size_t length, SensorReading& reading);
+};
+
+// Decodes measurements of BTHome v2, ATC1441/PVVX custom firmware and (unencrypted) Xiaomi MiBeacon sensors
+// in place from the advertisement payload, and publishes each new reading to <prefix>/sensors/<address>/<quantity>.
+class SensorDecoder : public BeaconSubscriber
+{
+public:
+    SensorDecoder(BeaconDecoder* beaconDecoder, Network* network);
+    virtual ~SensorDecoder();
+
+    // Publishes queued readings, called from the network task
+    void update();
+
+    void onResult(NimBLEAdvertisedDevice* advertisedDevice, const Beacon* beacon) override;
+
+    // Returns the matching format, or nullptr if the payload doesn't contain sensor data
+    static const SensorFormat* decode(const uint8_t* payload, const size_t length, SensorReading& reading);
+
+private:
+    bool isDuplicate(const long long address, const uint32_t fingerprint);
+    void publish(const SensorReading& reading);
+
+    BeaconDecoder* _beaconDecoder;
+    Network* _network;
+    SemaphoreHandle_t _queueMutex;
+    SensorReading _queue[sensor_queue_size];
+    uint8_t _queueStart = 0;
+    uint8_t _queueCount = 0;
+
+    struct DedupEntry
+    {
+        long long address = 0;
+        uint32_t fingerprint = 0;
+    };
+    DedupEntry _dedup[sensor_dedup_cache_size];
+};
@@ -0,0 +1,159 @@
+#include "TopicDispatcher.h"
+#include <string.h>
+
+TopicDispatcher::TopicDispatcher()
+{
+    _nodes.push_back(Node());
+}
+
+TopicDispatcher::~TopicDispatcher()
+{
+    for(auto& node : _nodes)
+    {
+        delete[] node.level;
+    }
+}
+
+void TopicDispatcher::add(const char* filter, const TopicHandle topic, MqttReceiver* receiver)
+{
+    const char* level = filter[0] == '/' ? &filter[1] : filter;
+    uint16_t node = 0;
+
+    while(true)
+    {
+        const char* end = strchr(level, '/');
+        size_t length = end != nullptr ? end - level : strlen(level);
+
+        if(length == 1 && level[0] == '#')
+        {
+            if(_nodes[node].multiLevelWildcard == 0)
+            {
+                // addChild() can move the nodes, the node is only looked up again afterwards
+                uint16_t wildcard = addChild(node, level, length);
+                _nodes[node].multiLevelWildcard = wildcard;
+            }
+            node = _nodes[node].multiLevelWildcard;
+            break;
+        }
+        else if(length == 1 && level[0] == '+')
+        {
+            if(_nodes[node].singleLevelWildcard == 0)
+            {
+                uint16_t wildcard = addChild(node, level, length);
+                _nodes[node].singleLevelWildcard = wildcard;
+            }
+            node = _nodes[node].singleLevelWildcard;
+        }
+        else
+        {
+            uint16_t next = child(node, level, length);
+            node = next != 0 ? next : addChild(node, level, length);
+        }
+
+        if(end == nullptr)
+        {
+            break;
+        }
+        level = end + 1;
+    }
+
+    _nodes[node].subscriptions.push_back({ topic, receiver });
+}
+
+size_t TopicDispatcher::match(const char* topic, TopicSubscription* out, const size_t max) const
+{
+    size_t count = 0;
+    match(0, topic[0] == '/' ? &topic[1] : topic, out, max, count);
+    return count;
+}
+
+void TopicDispatcher::match(const uint16_t node, const char* level, TopicSubscription* out, const size_t max, size_t& count) const
+{
+    const Node& current = _nodes[node];
+
+    // "#" also matches the level it follows, e.g. "gpio/#" matches "gpio"
+    if(current.multiLevelWildcard != 0)
+    {
+        collect(current.multiLevelWildcard, out, max, count);
+    }
+
+    if(level == nullptr)
+    {
+        collect(node, out, max, count);
+        return;
+    }
+
+    const char* end = strchr(level, '/');
+    size_t length = end != nullptr ? end - level : strlen(level);
+    const char* next = end != nullptr ? end + 1 : nullptr;
+
+    uint16_t exact = child(node, level, length);
+    if(exact != 0)
+    {
+        match(exact, next, out, max, count);
+    }
+    if(current.singleLevelWildcard != 0)
+    {
+        match(current.singleLevelWildcard, next, out, max, count);
+    }
+}
+
+void TopicDispatcher::collect(const uint16_t node, TopicSubscription* out, const size_t max, size_t& count) const
+{
+    for(const auto& subscription : _nodes[node].subscriptions)
+    {
+        if(count == max)
+        {
+            return;
+        }
+        out[count] = subscription;
+        ++count;
+    }
+}
+
+uint16_t TopicDispatcher::child(const uint16_t parent, const char* level, const size_t length) const
+{
+    auto range = _edges.equal_range(hash(parent, level, length));
+    for(auto it = range.first; it != range.second; ++it)
+    {
+        const Node& node = _nodes[it->second];
+        if(node.parent == parent && node.levelLength == length && memcmp(node.level, level, length) == 0)
+        {
+            return it->second;
+        }
+    }
+    return 0;
+}
+
+uint16_t TopicDispatcher::addChild(const uint16_t parent, const char* level, const size_t length)
+{
+    Node node;
+    node.level = new char[length + 1];
+    memcpy(node.level, level, length);
+    node.level[length] = 0x00;
+    node.levelLength = length;
+    node.parent = parent;
+
+    uint16_t index = _nodes.size();
+    _nodes.push_back(node);
+
+    // Wildcards are reached through their parent, not by name
+    if(!(length == 1 && (level[0] == '+' || level[0] == '#')))
+    {
+        _edges.insert({ hash(parent, level, length), index });
+    }
+    return index;
+}
+
+uint32_t TopicDispatcher::hash(const uint16_t parent, const char* level, const size_t length)
+{
+    // FNV-1a over the parent node and the level name
+    uint32_t value = 2166136261u;
+    value = (value ^ (parent & 0xFF)) * 16777619u;
+    value = (value ^ (parent >> 8)) * 16777619u;
+    for(size_t i = 0; i < length; i++)
+    {
+        value = (value ^ (uint8_t)level[i]) * 16777619u;
+    }
+    return value;
+}
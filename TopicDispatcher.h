@@ -0,0 +1,56 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+#include <unordered_map>
+#include "TopicRegistry.h"
+
+class MqttReceiver;
+
+// Most subscriptions a single inbound message is delivered to
+#define topic_dispatcher_max_matches 8
+
+struct TopicSubscription
+{
+    TopicHandle topic;
+    MqttReceiver* receiver;
+};
+
+// Matches inbound topics against the subscribed topic filters, MQTT wildcards included ("+" for one
+// level, "#" for the remaining levels). Filters are kept as a trie whose edges live in a hash table,
+// so matching costs one lookup per topic level however many filters are subscribed.
+// Filters are added during setup, before the tasks start, afterwards the dispatcher is only read.
+class TopicDispatcher
+{
+public:
+    TopicDispatcher();
+    TopicDispatcher(const TopicDispatcher&) = delete;
+    TopicDispatcher& operator=(const TopicDispatcher&) = delete;
+    virtual ~TopicDispatcher();
+
+    // filter is the topic relative to the prefix, e.g. "/gpio/output_4" or "/gpio/+"
+    void add(const char* filter, const TopicHandle topic, MqttReceiver* receiver);
+
+    // Writes the subscriptions matching the (unprefixed) topic to out, returns their number
+    size_t match(const char* topic, TopicSubscription* out, const size_t max) const;
+
+private:
+    struct Node
+    {
+        char* level = nullptr;
+        uint16_t levelLength = 0;
+        uint16_t parent = 0;
+        uint16_t singleLevelWildcard = 0; // "+" child, 0 if none
+        uint16_t multiLevelWildcard = 0; // "#" child, 0 if none
+        std::vector<TopicSubscription> subscriptions;
+    };
+
+    uint16_t child(const uint16_t parent, const char* level, const size_t length) const;
+    uint16_t addChild(const uint16_t parent, const char* level, const size_t length);
+    void match(const uint16_t node, const char* level, TopicSubscription* out, const size_t max, size_t& count) const;
+    void collect(const uint16_t node, TopicSubscription* out, const size_t max, size_t& count) const;
+    static uint32_t hash(const uint16_t parent, const char* level, const size_t length);
+
+    std::vector<Node> _nodes; // index 0 is the root
+    std::unordered_multimap<uint32_t, uint16_t> _edges;
+};
@@ -0,0 +1,100 @@
+#include "TopicRegistry.h"
+#include <string.h>
+
+TopicRegistry::~TopicRegistry()
+{
+    for(auto& entry : _entries)
+    {
+        delete[] entry.topic;
+    }
+}
+
+void TopicRegistry::setPrefix(const char* prefix)
+{
+    size_t oldPrefixLength = _prefixLength;
+
+    _prefixLength = strlen(prefix);
+    if(_prefixLength > topic_registry_max_prefix_length)
+    {
+        _prefixLength = topic_registry_max_prefix_length;
+    }
+    memcpy(_prefix, prefix, _prefixLength);
+    _prefix[_prefixLength] = 0x00;
+
+    for(auto& entry : _entries)
+    {
+        char* oldTopic = entry.topic;
+        resolve(entry, &oldTopic[oldPrefixLength], entry.length - oldPrefixLength);
+        delete[] oldTopic;
+    }
+}
+
+TopicHandle TopicRegistry::add(const char* suffix)
+{
+    size_t suffixLength = strlen(suffix);
+
+    for(size_t i = 0; i < _entries.size(); i++)
+    {
+        if(_entries[i].length == _prefixLength + suffixLength && strcmp(&_entries[i].topic[_prefixLength], suffix) == 0)
+        {
+            return i;
+        }
+    }
+
+    if(_entries.size() >= topic_handle_invalid)
+    {
+        return topic_handle_invalid;
+    }
+
+    Entry entry;
+    resolve(entry, suffix, suffixLength);
+    _entries.push_back(entry);
+    return _entries.size() - 1;
+}
+
+const char* TopicRegistry::get(const TopicHandle handle) const
+{
+    return handle < _entries.size() ? _entries[handle].topic : nullptr;
+}
+
+size_t TopicRegistry::length(const TopicHandle handle) const
+{
+    return handle < _entries.size() ? _entries[handle].length : 0;
+}
+
+bool TopicRegistry::matches(const TopicHandle handle, const char* topic) const
+{
+    return handle < _entries.size() && strcmp(_entries[handle].topic, topic) == 0;
+}
+
+const char* TopicRegistry::suffix(const TopicHandle handle) const
+{
+    return handle < _entries.size() ? &_entries[handle].topic[_prefixLength] : nullptr;
+}
+
+const char* TopicRegistry::stripPrefix(const char* topic) const
+{
+    return strncmp(topic, _prefix, _prefixLength) == 0 ? &topic[_prefixLength] : nullptr;
+}
+
+size_t TopicRegistry::build(const char* suffix, char* out, const size_t size) const
+{
+    size_t suffixLength = strlen(suffix);
+    if(_prefixLength + suffixLength >= size)
+    {
+        return 0;
+    }
+
+    memcpy(out, _prefix, _prefixLength);
+    memcpy(&out[_prefixLength], suffix, suffixLength + 1);
+    return _prefixLength + suffixLength;
+}
+
+void TopicRegistry::resolve(Entry& entry, const char* suffix, const size_t suffixLength)
+{
+    entry.length = _prefixLength + suffixLength;
+    entry.topic = new char[entry.length + 1];
+    memcpy(entry.topic, _prefix, _prefixLength);
+    memcpy(&entry.topic[_prefixLength], suffix, suffixLength);
+    entry.topic[entry.length] = 0x00;
+}
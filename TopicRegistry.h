@@ -0,0 +1,53 @@
+#pragma once
+
+#include <Arduino.h>
+#include <vector>
+
+#define topic_registry_max_prefix_length 180
+#define topic_handle_invalid 0xFFFF
+
+typedef uint16_t TopicHandle;
+
+// Resolves topic suffixes (mqtt_topic_*) to the full, prefixed topic once, so publishing and
+// comparing inbound topics doesn't build strings. Handles stay valid when the prefix changes.
+// Topics are registered during setup, before the tasks start, afterwards the registry is only read.
+class TopicRegistry
+{
+public:
+    TopicRegistry() = default;
+    TopicRegistry(const TopicRegistry&) = delete;
+    TopicRegistry& operator=(const TopicRegistry&) = delete;
+    virtual ~TopicRegistry();
+
+    // Resolves all registered topics again
+    void setPrefix(const char* prefix);
+
+    // Registering a suffix again returns the existing handle. The suffix is copied.
+    TopicHandle add(const char* suffix);
+
+    // Returns nullptr for unknown handles
+    const char* get(const TopicHandle handle) const;
+    size_t length(const TopicHandle handle) const;
+    bool matches(const TopicHandle handle, const char* topic) const;
+    // The topic as registered, without the prefix
+    const char* suffix(const TopicHandle handle) const;
+    // Returns the part of an inbound topic after the prefix, nullptr if the topic doesn't start with the prefix
+    const char* stripPrefix(const char* topic) const;
+
+    // For topics that can't be registered because they contain e.g. an address. Returns the length
+    // of the prefixed topic, 0 if it doesn't fit into size bytes.
+    size_t build(const char* suffix, char* out, const size_t size) const;
+
+private:
+    struct Entry
+    {
+        char* topic = nullptr;
+        uint16_t length = 0;
+    };
+
+    void resolve(Entry& entry, const char* suffix, const size_t suffixLength);
+
+    std::vector<Entry> _entries;
+    char _prefix[topic_registry_max_prefix_length + 1] = {0};
+    size_t _prefixLength = 0;
+};
@@ -5,6 +5,9 @@
 #include "hardware/WifiEthServer.h"
 #include "Logger.h"
 #include "RestartReason.h"
+#include "RpaResolver.h"
+#include "PresenceStateMachine.h"
+#include "ProximityZones.h"
 #include <esp_task_wdt.h>
 
 WebCfgServer::WebCfgServer(Network* network, EthServer* ethServer, Preferences* preferences, bool allowRestartToPortal)
@@ -220,6 +223,11 @@ bool WebCfgServer::processArgs(String& message)
             _preferences->putString(preference_mqtt_key, value);
             configChanged = true;
         }
+        else if(key == "MQTTV5")
+        {
+            _preferences->putBool(preference_mqtt_v5, (value == "1"));
+            configChanged = true;
+        }
         else if(key == "HOSTNAME")
         {
             _preferences->putString(preference_hostname, value);
@@ -240,6 +248,116 @@ bool WebCfgServer::processArgs(String& message)
             _preferences->putInt(preference_presence_detection_timeout, value.toInt());
             configChanged = true;
         }
+        else if(key == "PRDCBOR")
+        {
+            _preferences->putBool(preference_presence_format_cbor, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "PRDLAT")
+        {
+            _preferences->putInt(preference_presence_latency_budget, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDMIN")
+        {
+            _preferences->putInt(preference_presence_min_interval, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDMAX")
+        {
+            _preferences->putInt(preference_presence_max_interval, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDDIRTY")
+        {
+            _preferences->putInt(preference_presence_dirty_threshold, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDSNAP")
+        {
+            _preferences->putInt(preference_presence_snapshot_interval, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDBCNID")
+        {
+            _preferences->putBool(preference_presence_beacon_identity, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "PRDGRACE")
+        {
+            _preferences->putInt(preference_presence_grace_intervals, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDPROF")
+        {
+            _preferences->putString(preference_presence_profiles, value);
+            configChanged = true;
+        }
+        else if(key == "PRDZONES")
+        {
+            _preferences->putString(preference_presence_zones, value);
+            configChanged = true;
+        }
+        else if(key == "PRDMAXRATE")
+        {
+            _preferences->putInt(preference_presence_max_rate, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDINTV")
+        {
+            _preferences->putBool(preference_presence_report_intervals, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "PRDNOBC")
+        {
+            _preferences->putBool(preference_presence_broadcast_disabled, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "PRDCLASS")
+        {
+            _preferences->putBool(preference_presence_classify, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "SENSORS")
+        {
+            _preferences->putBool(preference_sensors_enabled, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "CROWD")
+        {
+            _preferences->putBool(preference_crowd_enabled, (value == "1"));
+            configChanged = true;
+        }
+        else if(key == "CROWDNEAR")
+        {
+            _preferences->putInt(preference_crowd_near_rssi, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "CROWDINT")
+        {
+            _preferences->putInt(preference_crowd_publish_interval, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "PRDIRK")
+        {
+            _preferences->putString(preference_presence_irks, value);
+            configChanged = true;
+        }
+        else if(key == "RSSIFLT")
+        {
+            _preferences->putInt(preference_rssi_filter, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "RSSIPWR")
+        {
+            _preferences->putInt(preference_rssi_measured_power, value.toInt());
+            configChanged = true;
+        }
+        else if(key == "RSSIPLE")
+        {
+            _preferences->putInt(preference_rssi_path_loss_exponent, value.toInt());
+            configChanged = true;
+        }
         else if(key == "RSBC")
         {
             _preferences->putInt(preference_restart_ble_beacon_lost, value.toInt());
@@ -318,6 +436,24 @@ void WebCfgServer::buildHtml(String& response)
     response.concat("<table>");
 
     printParameter(response, "MQTT Connected", _network->mqttConnectionState() >= 2 ? "Yes" : "No");
+    if(_network->mqttConnectionState() == 0)
+    {
+        printParameter(response, "MQTT failed connection attempts", String(_network->mqttConnectFailures()).c_str());
+        printParameter(response, "MQTT next connection attempt (ms)", String(_network->mqttNextReconnectIn()).c_str());
+    }
+    printParameter(response, "MQTT connects since boot", String(_network->mqttReconnectCount()).c_str());
+
+    const char* publishClassNames[publish_class_count] = { "Publish queue control", "Publish queue presence", "Publish queue telemetry" };
+    for(int i = 0; i < publish_class_count; i++)
+    {
+        const PublishClassStats stats = _network->publishStats((PublishClass)i);
+        char str[160];
+        snprintf(str, sizeof(str), "%u queued (%u bytes, peak %u), %u sent, %u replaced, %u dropped, latency %lu ms avg, %lu ms max",
+                 (unsigned int)stats.queuedMessages, (unsigned int)stats.queuedBytes, (unsigned int)stats.peakQueuedBytes,
+                 (unsigned int)stats.sent, (unsigned int)stats.replaced, (unsigned int)stats.dropped,
+                 stats.averageLatency, stats.maxLatency);
+        printParameter(response, publishClassNames[i], str);
+    }
 
     printParameter(response, "Firmware", version.c_str());
     response.concat("</table><br><br>");
@@ -402,8 +538,31 @@ void WebCfgServer::buildMqttConfigHtml(String &response)
     printTextarea(response, "MQTTCA", "MQTT SSL CA Certificate (*, optional)", _preferences->getString(preference_mqtt_ca).c_str(), TLS_CA_MAX_SIZE);
     printTextarea(response, "MQTTCRT", "MQTT SSL Client Certificate (*, optional)", _preferences->getString(preference_mqtt_crt).c_str(), TLS_CERT_MAX_SIZE);
     printTextarea(response, "MQTTKEY", "MQTT SSL Client Key (*, optional)", _preferences->getString(preference_mqtt_key).c_str(), TLS_KEY_MAX_SIZE);
+    printCheckBox(response, "MQTTV5", "Use MQTT 5 (topic aliases, expiring presence pages)", _preferences->getBool(preference_mqtt_v5));
     printCheckBox(response, "GPLCK", "Enable control via GPIO", _preferences->getBool(preference_gpio_enabled));
     printInputField(response, "PRDTMO", "Presence detection timeout (seconds; -1 to disable)", _preferences->getInt(preference_presence_detection_timeout), 10);
+    printInputField(response, "PRDLAT", "Presence report latency budget (ms)", _preferences->getInt(preference_presence_latency_budget), 6);
+    printInputField(response, "PRDMIN", "Minimum presence report interval (ms)", _preferences->getInt(preference_presence_min_interval), 6);
+    printInputField(response, "PRDMAX", "Maximum presence report interval (ms)", _preferences->getInt(preference_presence_max_interval), 6);
+    printInputField(response, "PRDDIRTY", "RSSI updates until presence report (-1 to disable)", _preferences->getInt(preference_presence_dirty_threshold), 6);
+    printCheckBox(response, "PRDNOBC", "Only publish presence on query (no periodic reports)", _preferences->getBool(preference_presence_broadcast_disabled));
+    printInputField(response, "PRDSNAP", "Known devices snapshot interval (minutes, -1 to disable)", _preferences->getInt(preference_presence_snapshot_interval), 4);
+    printCheckBox(response, "PRDBCNID", "Track iBeacon and Eddystone beacons by id instead of address", _preferences->getBool(preference_presence_beacon_identity));
+    printInputField(response, "PRDGRACE", "Missed advertisements until a device is leaving (-1 to use the timeout)", _preferences->getInt(preference_presence_grace_intervals), 4);
+    printTextarea(response, "PRDPROF", "Presence thresholds, one per line: address, class or default, enter RSSI, exit RSSI, enter ms, exit ms", _preferences->getString(preference_presence_profiles).c_str(), presence_max_profiles * 48);
+    printTextarea(response, "PRDZONES", "Proximity zones, one per line: address, class or default, immediate RSSI, near RSSI, hysteresis dB, zone and output GPIO to switch (optional)", _preferences->getString(preference_presence_zones).c_str(), proximity_max_rules * 48);
+    printInputField(response, "PRDMAXRATE", "Advertisements per second that raise an alert (-1 to disable)", _preferences->getInt(preference_presence_max_rate), 4);
+    printCheckBox(response, "PRDINTV", "Report advertising interval and jitter of devices", _preferences->getBool(preference_presence_report_intervals));
+    printCheckBox(response, "PRDCLASS", "Report vendor and class (phone, watch, tag, ...) of devices", _preferences->getBool(preference_presence_classify));
+    printCheckBox(response, "SENSORS", "Publish readings of BTHome, ATC/PVVX and Xiaomi sensors", _preferences->getBool(preference_sensors_enabled));
+    printCheckBox(response, "CROWD", "Publish number of distinct devices per minute, hour and day", _preferences->getBool(preference_crowd_enabled));
+    printInputField(response, "CROWDNEAR", "Minimum RSSI of near devices (dBm)", _preferences->getInt(preference_crowd_near_rssi), 4);
+    printInputField(response, "CROWDINT", "Device count publish interval (seconds)", _preferences->getInt(preference_crowd_publish_interval), 6);
+    printTextarea(response, "PRDIRK", "Identity resolving keys of phones with private addresses (32 hex digits each, one per line)", _preferences->getString(preference_presence_irks).c_str(), rpa_max_irks * (rpa_irk_length * 2 + 1));
+    printInputField(response, "RSSIFLT", "RSSI filter (0 = off, 1 = EMA, 2 = Kalman, 3 = median)", _preferences->getInt(preference_rssi_filter), 1);
+    printInputField(response, "RSSIPWR", "Default RSSI at 1 m (dBm)", _preferences->getInt(preference_rssi_measured_power), 4);
+    printInputField(response, "RSSIPLE", "Path loss exponent (x10)", _preferences->getInt(preference_rssi_path_loss_exponent), 3);
+    printCheckBox(response, "PRDCBOR", "Publish presence as compact binary (CBOR)", _preferences->getBool(preference_presence_format_cbor));
     printInputField(response, "NETTIMEOUT", "Network Timeout until restart (seconds; -1 to disable)", _preferences->getInt(preference_network_timeout), 5);
     printCheckBox(response, "RSTDISC", "Restart on disconnect", _preferences->getBool(preference_restart_on_disconnect));
     printInputField(response, "RSBC", "Restart if bluetooth beacons not received (seconds; -1 to disable)", _preferences->getInt(preference_restart_ble_beacon_lost), 10);
@@ -20,6 +20,15 @@ the LICENSE file.
 #define EMC_TX_BUFFER_SIZE 1440
 #endif
 
+#ifndef EMC_TX_COALESCE
+#define EMC_TX_COALESCE 1
+#endif
+
+#ifndef EMC_TX_COALESCE_DEADLINE
+// ms a partly filled TX buffer waits for more packets, 0 only gathers the packets that are already queued
+#define EMC_TX_COALESCE_DEADLINE 0
+#endif
+
 #ifndef EMC_MAX_TOPIC_LENGTH
 #define EMC_MAX_TOPIC_LENGTH 128
 #endif
@@ -56,3 +65,42 @@ the LICENSE file.
 #ifndef EMC_USE_WATCHDOG
 #define EMC_USE_WATCHDOG 0
 #endif
+
+#ifndef EMC_OUTBOX_POOL_SIZE
+#define EMC_OUTBOX_POOL_SIZE 16
+#endif
+
+#ifndef EMC_OUTBOX_MAX_BYTES
+// 0 doesn't limit the outbox
+#define EMC_OUTBOX_MAX_BYTES 0
+#endif
+
+#ifndef EMC_MAX_TOPIC_ALIASES
+// MQTT 5: topic aliases the client assigns, limited further by the server. 0 disables them
+#define EMC_MAX_TOPIC_ALIASES 10
+#endif
+
+#ifndef EMC_POOL_SMALL_BLOCK_SIZE
+#define EMC_POOL_SMALL_BLOCK_SIZE 32
+#endif
+
+#ifndef EMC_POOL_SMALL_BLOCKS
+#define EMC_POOL_SMALL_BLOCKS 16
+#endif
+
+#ifndef EMC_POOL_MEDIUM_BLOCK_SIZE
+#define EMC_POOL_MEDIUM_BLOCK_SIZE 256
+#endif
+
+#ifndef EMC_POOL_MEDIUM_BLOCKS
+#define EMC_POOL_MEDIUM_BLOCKS 8
+#endif
+
+#ifndef EMC_POOL_LARGE_BLOCK_SIZE
+// a chunked publish with a full length topic
+#define EMC_POOL_LARGE_BLOCK_SIZE (EMC_RX_BUFFER_SIZE + EMC_MAX_TOPIC_LENGTH + 16)
+#endif
+
+#ifndef EMC_POOL_LARGE_BLOCKS
+#define EMC_POOL_LARGE_BLOCKS 2
+#endif
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2022 Bert Melis. All rights reserved.
+
+This work is licensed under the terms of the MIT license.  
+For a copy, see <https://opensource.org/licenses/MIT> or
+the LICENSE file.
+*/
+
+#include <stdlib.h>  // malloc, free
+#include <cstddef>  // std::max_align_t
+
+#include "MemoryPool.h"
+#include "Helpers.h"
+#include "Logging.h"
+
+namespace espMqttClientInternals {
+
+MemoryPool::MemoryPool(size_t blockSize, size_t capacity)
+: _storage(nullptr)
+, _blockSize(0)
+, _capacity(0)
+, _free(nullptr)
+, _used(0)
+, _peak(0)
+, _exhausted(0) {
+  // every block has to hold the free list pointer and keep the alignment of the blocks after it
+  const size_t alignment = alignof(std::max_align_t);
+  _blockSize = blockSize < sizeof(void*) ? sizeof(void*) : blockSize;
+  _blockSize = (_blockSize + alignment - 1) / alignment * alignment;
+
+  if (capacity == 0) return;
+  _storage = reinterpret_cast<uint8_t*>(malloc(_blockSize * capacity));
+  if (!_storage) {
+    emc_log_e("Pool not allocated (%zu x %zu)", capacity, _blockSize);
+    return;
+  }
+  _capacity = capacity;
+
+  // chain the blocks, first block at the head
+  for (size_t i = capacity; i > 0; --i) {
+    void* block = &_storage[(i - 1) * _blockSize];
+    *reinterpret_cast<void**>(block) = _free;
+    _free = block;
+  }
+}
+
+MemoryPool::~MemoryPool() {
+  free(_storage);
+}
+
+void* MemoryPool::allocate() {
+  if (!_free) {
+    ++_exhausted;
+    return nullptr;
+  }
+  void* block = _free;
+  _free = *reinterpret_cast<void**>(block);
+  ++_used;
+  if (_used > _peak) _peak = _used;
+  return block;
+}
+
+void MemoryPool::release(void* block) {
+  if (!block) return;
+  *reinterpret_cast<void**>(block) = _free;
+  _free = block;
+  --_used;
+}
+
+bool MemoryPool::owns(const void* block) const {
+  const uint8_t* b = reinterpret_cast<const uint8_t*>(block);
+  return _storage && b >= _storage && b < _storage + _blockSize * _capacity;
+}
+
+espMqttClientTypes::MemoryPoolStats MemoryPool::stats() const {
+  return {_blockSize, _capacity, _used, _peak, _exhausted};
+}
+
+namespace PacketBuffer {
+
+#if defined(ARDUINO_ARCH_ESP32)
+static portMUX_TYPE poolMux = portMUX_INITIALIZER_UNLOCKED;
+#define EMC_POOL_LOCK() portENTER_CRITICAL(&poolMux)
+#define EMC_POOL_UNLOCK() portEXIT_CRITICAL(&poolMux)
+#elif defined(__linux__)
+static std::mutex poolMutex;
+#define EMC_POOL_LOCK() poolMutex.lock()
+#define EMC_POOL_UNLOCK() poolMutex.unlock()
+#else
+#define EMC_POOL_LOCK()
+#define EMC_POOL_UNLOCK()
+#endif
+
+static MemoryPool* pools() {
+  // constructed on first use, the blocks are taken from the heap before it fragments
+  static MemoryPool sizeClasses[3] = {
+    {EMC_POOL_SMALL_BLOCK_SIZE, EMC_POOL_SMALL_BLOCKS},
+    {EMC_POOL_MEDIUM_BLOCK_SIZE, EMC_POOL_MEDIUM_BLOCKS},
+    {EMC_POOL_LARGE_BLOCK_SIZE, EMC_POOL_LARGE_BLOCKS}
+  };
+  return sizeClasses;
+}
+
+uint8_t* allocate(size_t size) {
+  MemoryPool* sizeClasses = pools();
+  void* buffer = nullptr;
+
+  EMC_POOL_LOCK();
+  for (size_t i = 0; i < 3 && !buffer; ++i) {
+    if (size <= sizeClasses[i].stats().blockSize) {
+      buffer = sizeClasses[i].allocate();
+    }
+  }
+  EMC_POOL_UNLOCK();
+
+  if (buffer) return reinterpret_cast<uint8_t*>(buffer);
+
+  if (EMC_GET_FREE_MEMORY() < EMC_MIN_FREE_MEMORY) {
+    emc_log_w("Packet buffer not allocated: low memory");
+    return nullptr;
+  }
+  return reinterpret_cast<uint8_t*>(malloc(size));
+}
+
+void release(uint8_t* buffer) {
+  if (!buffer) return;
+  MemoryPool* sizeClasses = pools();
+
+  EMC_POOL_LOCK();
+  for (size_t i = 0; i < 3; ++i) {
+    if (sizeClasses[i].owns(buffer)) {
+      sizeClasses[i].release(buffer);
+      EMC_POOL_UNLOCK();
+      return;
+    }
+  }
+  EMC_POOL_UNLOCK();
+
+  free(buffer);
+}
+
+espMqttClientTypes::MemoryPoolStats stats(espMqttClientTypes::PacketBufferSize size) {
+  EMC_POOL_LOCK();
+  espMqttClientTypes::MemoryPoolStats result = pools()[static_cast<uint8_t>(size)].stats();
+  EMC_POOL_UNLOCK();
+  return result;
+}
+
+}  // end namespace PacketBuffer
+
+}  // end namespace espMqttClientInternals
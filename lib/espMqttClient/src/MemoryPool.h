@@ -0,0 +1,66 @@
+/*
+Copyright (c) 2022 Bert Melis. All rights reserved.
+
+This work is licensed under the terms of the MIT license.  
+For a copy, see <https://opensource.org/licenses/MIT> or
+the LICENSE file.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "Config.h"
+#include "TypeDefs.h"
+
+namespace espMqttClientInternals {
+
+/**
+ * @brief Fixed size block allocator
+ *
+ * All blocks are allocated at once on construction, so long running clients
+ * don't fragment the heap with every queued packet.
+ * Not thread safe.
+ */
+
+class MemoryPool {
+ public:
+  MemoryPool(size_t blockSize, size_t capacity);
+  ~MemoryPool();
+  MemoryPool(const MemoryPool&) = delete;
+  MemoryPool& operator=(const MemoryPool&) = delete;
+
+  // returns nullptr when all blocks are in use
+  void* allocate();
+  void release(void* block);
+  bool owns(const void* block) const;
+
+  espMqttClientTypes::MemoryPoolStats stats() const;
+
+ private:
+  uint8_t* _storage;
+  size_t _blockSize;
+  size_t _capacity;
+  void* _free;  // singly linked through the free blocks
+  size_t _used;
+  size_t _peak;
+  uint32_t _exhausted;
+};
+
+/**
+ * @brief Size classed packet buffers, shared by all clients
+ *
+ * Buffers come from the smallest pool with a free block large enough,
+ * from the heap if there is none. Thread safe.
+ */
+
+namespace PacketBuffer {
+
+uint8_t* allocate(size_t size);
+void release(uint8_t* buffer);
+espMqttClientTypes::MemoryPoolStats stats(espMqttClientTypes::PacketBufferSize size);
+
+}  // end namespace PacketBuffer
+
+}  // end namespace espMqttClientInternals
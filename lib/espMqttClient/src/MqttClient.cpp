@@ -42,6 +42,7 @@ MqttClient::MqttClient(espMqttClientTypes::UseInternalTask useInternalTask, uint
 , _willQos(0)
 , _willRetain(false)
 , _timeout(10000)
+, _protocolVersion(espMqttClientTypes::ProtocolVersion::V3_1_1)
 , _state(State::disconnected)
 , _generatedClientId{0}
 , _packetId(0)
@@ -51,12 +52,24 @@ MqttClient::MqttClient(espMqttClientTypes::UseInternalTask useInternalTask, uint
 #endif
 , _rxBuffer{0}
 , _outbox()
+, _outboxBytes(0)
 , _bytesSent(0)
+#if EMC_TX_COALESCE
+, _txBuffer{0}
+, _txLength(0)
+, _txWritten(0)
+, _txStaged(0)
+#endif
 , _parser()
 , _lastClientActivity(0)
 , _lastServerActivity(0)
 , _pingSent(false)
 , _disconnectReason(DisconnectReason::TCP_DISCONNECTED)
+#if EMC_MAX_TOPIC_ALIASES
+, _topicAliases()
+, _topicAliasCount(0)
+, _topicAliasMaximum(0)
+#endif
 #if defined(ARDUINO_ARCH_ESP32) && ARDUHAL_LOG_LEVEL >= ARDUHAL_LOG_LEVEL_INFO
 , _highWaterMark(4294967295)
 #endif
@@ -79,6 +92,7 @@ MqttClient::MqttClient(espMqttClientTypes::UseInternalTask useInternalTask, uint
 MqttClient::~MqttClient() {
   disconnect(true);
   _clearQueue(2);
+  _clearTopicAliases();
 #if defined(ARDUINO_ARCH_ESP32)
   vSemaphoreDelete(_xSemaphore);
   if (_useInternalTask == espMqttClientTypes::UseInternalTask::YES) {
@@ -104,7 +118,8 @@ bool MqttClient::connect() {
   bool result = true;
   if (_state == State::disconnected) {
     EMC_SEMAPHORE_TAKE();
-    if (_addPacketFront(_cleanSession,
+    if (_addPacketFront(_protocolVersion,
+                        _cleanSession,
                         _username,
                         _password,
                         _willTopic,
@@ -143,47 +158,79 @@ bool MqttClient::disconnect(bool force) {
   return false;
 }
 
-uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length) {
-  #if !EMC_ALLOW_NOT_CONNECTED_PUBLISH
-  if (_state != State::connected) {
-  #else
-  if (_state > State::connected) {
-  #endif
+uint16_t MqttClient::subscribe(const espMqttClientTypes::SubscribeItem* list, size_t numberTopics) {
+  if (numberTopics == 0 || numberTopics >= EMC_PAYLOAD_BUFFER_SIZE) {
+    emc_log_e("Invalid number of topics: %zu", numberTopics);
     return 0;
   }
-  uint16_t packetId = (qos > 0) ? _getNextPacketId() : 1;
-  EMC_SEMAPHORE_TAKE();
-  if (!_addPacket(packetId, topic, payload, length, qos, retain)) {
-    emc_log_e("Could not create PUBLISH packet");
-    _onError(packetId, Error::OUT_OF_MEMORY);
+  uint16_t packetId = _getNextPacketId();
+  if (_state != State::connected) {
     packetId = 0;
+  } else {
+    EMC_SEMAPHORE_TAKE();
+    if (!_addPacket(_protocolVersion, packetId, list, numberTopics)) {
+      emc_log_e("Could not create SUBSCRIBE packet");
+      packetId = 0;
+    }
+    EMC_SEMAPHORE_GIVE();
   }
-  EMC_SEMAPHORE_GIVE();
   return packetId;
 }
 
+uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length) {
+  return _publish(false, 0, topic, qos, retain, payload, length);
+}
+
 uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, const char* payload) {
   size_t len = strlen(payload);
   return publish(topic, qos, retain, reinterpret_cast<const uint8_t*>(payload), len);
 }
 
 uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::PayloadCallback callback, size_t length) {
-  #if !EMC_ALLOW_NOT_CONNECTED_PUBLISH
-  if (_state != State::connected) {
-  #else
-  if (_state > State::connected) {
-  #endif
-    return 0;
-  }
-  uint16_t packetId = (qos > 0) ? _getNextPacketId() : 1;
-  EMC_SEMAPHORE_TAKE();
-  if (!_addPacket(packetId, topic, callback, length, qos, retain)) {
-    emc_log_e("Could not create PUBLISH packet");
-    _onError(packetId, Error::OUT_OF_MEMORY);
-    packetId = 0;
-  }
-  EMC_SEMAPHORE_GIVE();
-  return packetId;
+  return _publish(false, 0, topic, qos, retain, callback, length);
+}
+
+uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) {
+  return _publish(false, 0, topic, qos, retain, payload);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length) {
+  return _publish(true, 0, topic, qos, retain, payload, length);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, const char* payload) {
+  size_t len = strlen(payload);
+  return publishLatest(topic, qos, retain, reinterpret_cast<const uint8_t*>(payload), len);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) {
+  return _publish(true, 0, topic, qos, retain, payload);
+}
+
+uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const uint8_t* payload, size_t length) {
+  return _publish(false, messageExpiry, topic, qos, retain, payload, length);
+}
+
+uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const char* payload) {
+  size_t len = strlen(payload);
+  return publish(topic, qos, retain, messageExpiry, reinterpret_cast<const uint8_t*>(payload), len);
+}
+
+uint16_t MqttClient::publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload) {
+  return _publish(false, messageExpiry, topic, qos, retain, payload);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const uint8_t* payload, size_t length) {
+  return _publish(true, messageExpiry, topic, qos, retain, payload, length);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const char* payload) {
+  size_t len = strlen(payload);
+  return publishLatest(topic, qos, retain, messageExpiry, reinterpret_cast<const uint8_t*>(payload), len);
+}
+
+uint16_t MqttClient::publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload) {
+  return _publish(true, messageExpiry, topic, qos, retain, payload);
 }
 
 void MqttClient::clearQueue(bool deleteSessionData) {
@@ -194,6 +241,24 @@ const char* MqttClient::getClientId() const {
   return _clientId;
 }
 
+espMqttClientTypes::MemoryPoolStats MqttClient::getOutboxPoolStats() {
+  EMC_SEMAPHORE_TAKE();
+  espMqttClientTypes::MemoryPoolStats stats = _outbox.poolStats();
+  EMC_SEMAPHORE_GIVE();
+  return stats;
+}
+
+size_t MqttClient::getOutboxBytes() {
+  EMC_SEMAPHORE_TAKE();
+  size_t bytes = _outboxBytes;
+  EMC_SEMAPHORE_GIVE();
+  return bytes;
+}
+
+espMqttClientTypes::MemoryPoolStats MqttClient::getPacketBufferStats(espMqttClientTypes::PacketBufferSize size) {
+  return espMqttClientInternals::PacketBuffer::stats(size);
+}
+
 void MqttClient::loop() {
   switch (_state) {
     case State::disconnected:
@@ -216,6 +281,7 @@ void MqttClient::loop() {
     case State::connectingTcp2:
       if (_transport->connected()) {
         _parser.reset();
+        _parser.setProtocolVersion(_protocolVersion);
         _lastClientActivity = _lastServerActivity = millis();
         _state = State::connectingMqtt;
       }
@@ -275,7 +341,12 @@ void MqttClient::loop() {
     case State::disconnectingTcp2:
       if (_transport->disconnected()) {
         _clearQueue(0);
+        _clearTopicAliases();
         _bytesSent = 0;
+        #if EMC_TX_COALESCE
+        _txLength = 0;
+        _txWritten = 0;
+        #endif
         _state = State::disconnected;
         if (_onDisconnectCallback) _onDisconnectCallback(_disconnectReason);
       }
@@ -317,14 +388,153 @@ uint16_t MqttClient::_getNextPacketId() {
   return packetId;
 }
 
+void MqttClient::_removeUnsentPublish(const char* topic) {
+  // the packet being written can't be taken back, gathered packets were already advanced
+  size_t topicLength = strlen(topic);
+  espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.current();
+  if (it && _bytesSent > 0) ++it;
+  while (it) {
+    // a packet that got a topic alias may be the one that tells the server about it
+    if (it.get()->packet.topicAlias() == 0 && it.get()->packet.hasTopic(topic, topicLength)) {
+      emc_log_i("Superseded PUBLISH removed (%u)", it.get()->packet.packetId());
+      _outbox.remove(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
 void MqttClient::_checkOutbox() {
+  #if EMC_TX_COALESCE
+  for (;;) {
+    TxStage stage = _stagePacket();
+    if (stage == TxStage::staged) continue;
+    // gathered packets go first, when nothing else is waiting they can wait for their deadline
+    if (!_flushTxBuffer(stage != TxStage::none)) return;
+    if (stage == TxStage::none) return;
+    if (stage == TxStage::full) continue;
+    if (_sendPacket() <= 0) return;
+    if (!_advanceOutbox()) return;
+  }
+  #else
   while (_sendPacket() > 0) {
     if (!_advanceOutbox()) {
       break;
     }
   }
+  #endif
+}
+
+void MqttClient::_applyTopicAlias(OutgoingPacket* packet) {
+  // called with the semaphore taken, before the first byte of the packet is sent
+  #if EMC_MAX_TOPIC_ALIASES
+  if (_topicAliasMaximum == 0 || _bytesSent > 0 || packet->packet.topicAlias() != 0) return;
+  size_t length = 0;
+  const char* topic = packet->packet.topic(&length);
+  if (!topic) return;
+  size_t size = packet->packet.size();
+  uint16_t index = 0;
+  while (index < _topicAliasCount &&
+         (_topicAliases[index].length != length || memcmp(_topicAliases[index].topic, topic, length) != 0)) {
+    ++index;
+  }
+  if (index < _topicAliasCount) {
+    packet->packet.setTopicAlias(index + 1, true);
+  } else if (_topicAliasCount < _topicAliasMaximum) {
+    // packets leave in order, so the ones after this can use the alias without the topic
+    char* copy = reinterpret_cast<char*>(malloc(length));
+    if (!copy) return;
+    if (!packet->packet.setTopicAlias(index + 1, false)) {
+      free(copy);
+      return;
+    }
+    memcpy(copy, topic, length);
+    _topicAliases[index] = {copy, length};
+    ++_topicAliasCount;
+  }
+  _outboxBytes = _outboxBytes - size + packet->packet.size();
+  #else
+  (void) packet;
+  #endif
+}
+
+void MqttClient::_clearTopicAliases() {
+  #if EMC_MAX_TOPIC_ALIASES
+  EMC_SEMAPHORE_TAKE();
+  // aliases end with the connection, queued packets go out with their topic again
+  espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.front();
+  while (it) {
+    size_t size = it.get()->packet.size();
+    it.get()->packet.clearTopicAlias();
+    _outboxBytes = _outboxBytes - size + it.get()->packet.size();
+    ++it;
+  }
+  for (uint16_t i = 0; i < _topicAliasCount; ++i) {
+    free(_topicAliases[i].topic);
+  }
+  _topicAliasCount = 0;
+  _topicAliasMaximum = 0;
+  EMC_SEMAPHORE_GIVE();
+  #endif
+}
+
+#if EMC_TX_COALESCE
+MqttClient::TxStage MqttClient::_stagePacket() {
+  EMC_SEMAPHORE_TAKE();
+  OutgoingPacket* packet = _outbox.getCurrent();
+  if (!packet) {
+    EMC_SEMAPHORE_GIVE();
+    return TxStage::none;
+  }
+  _applyTopicAlias(packet);
+  // CONNECT and DISCONNECT change the connection state once they're sent, so they're never held back.
+  // Large packets aren't worth the copy, they fill a segment on their own.
+  size_t size = packet->packet.size();
+  if (_bytesSent > 0 ||
+      size > EMC_TX_BUFFER_SIZE / 2 ||
+      packet->packet.packetType() == PacketType.CONNECT ||
+      packet->packet.packetType() == PacketType.DISCONNECT) {
+    EMC_SEMAPHORE_GIVE();
+    return TxStage::direct;
+  }
+  if (_txLength + size > EMC_TX_BUFFER_SIZE) {
+    EMC_SEMAPHORE_GIVE();
+    return TxStage::full;
+  }
+  if (_txLength == 0) _txStaged = millis();
+  // chunked payloads come in several parts
+  size_t available = 0;
+  while ((available = packet->packet.available(_bytesSent)) > 0) {
+    memcpy(&_txBuffer[_txLength], packet->packet.data(_bytesSent), available);
+    _txLength += available;
+    _bytesSent += available;
+  }
+  packet->timeSent = millis();
+  emc_log_i("tx staged %zu/%zu (%02x)", _bytesSent, packet->packet.size(), packet->packet.packetType());
+  EMC_SEMAPHORE_GIVE();
+  _advanceOutbox();
+  return TxStage::staged;
 }
 
+bool MqttClient::_flushTxBuffer(bool force) {
+  if (_txLength == 0) return true;
+  // once writing started, the rest follows as soon as the transport takes it
+  if (!force && _txWritten == 0 && millis() - _txStaged < EMC_TX_COALESCE_DEADLINE) return false;
+  int32_t written = _transport->write(&_txBuffer[_txWritten], _txLength - _txWritten);
+  if (written < 0) {
+    emc_log_w("Write error, check connection");
+    return false;
+  }
+  _lastClientActivity = millis();
+  _txWritten += written;
+  emc_log_i("tx %zu/%zu (coalesced)", _txWritten, _txLength);
+  if (_txWritten < _txLength) return false;
+  _txLength = 0;
+  _txWritten = 0;
+  return true;
+}
+#endif
+
 int MqttClient::_sendPacket() {
   EMC_SEMAPHORE_TAKE();
   OutgoingPacket* packet = _outbox.getCurrent();
@@ -332,6 +542,7 @@ int MqttClient::_sendPacket() {
   int32_t wantToWrite = 0;
   int32_t written = 0;
   if (packet && (wantToWrite == written)) {
+    _applyTopicAlias(packet);
     // mixing signed with unsigned here but safe because of MQTT packet size limits
     wantToWrite = packet->packet.available(_bytesSent);
     if (wantToWrite == 0) {
@@ -423,6 +634,11 @@ void MqttClient::_checkIncoming() {
           case PacketType.PINGRESP:
             _pingSent = false;
             break;
+          case PacketType.DISCONNECT:  // MQTT 5 only, the parser rejects it otherwise
+            emc_log_w("Disconnected by server (0x%02x)", _parser.getPacket().variableHeader.reasonCode);
+            _state = State::disconnectingTcp1;
+            _disconnectReason = DisconnectReason::TCP_DISCONNECTED;
+            return;
         }
       } else if (result ==  espMqttClientInternals::ParserResult::protocolError) {
         emc_log_w("Disconnecting, protocol error");
@@ -472,7 +688,11 @@ void MqttClient::_checkTimeout() {
   espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.front();
   // check that we're not busy sending
   // don't check when first item hasn't been sent yet
+  #if EMC_TX_COALESCE
+  if (it && _bytesSent == 0 && _txLength == 0 && it.get() != _outbox.getCurrent()) {
+  #else
   if (it && _bytesSent == 0 && it.get() != _outbox.getCurrent()) {
+  #endif
     if (millis() - it.get()->timeSent > _timeout) {
       emc_log_w("Packet ack timeout, retrying");
       _outbox.resetCurrent();
@@ -484,6 +704,11 @@ void MqttClient::_checkTimeout() {
 void MqttClient::_onConnack() {
   if (_parser.getPacket().variableHeader.fixed.connackVarHeader.returnCode == 0x00) {
     _pingSent = false;  // reset after keepalive timeout disconnect
+    #if EMC_MAX_TOPIC_ALIASES
+    if (_protocolVersion == espMqttClientTypes::ProtocolVersion::V5) {
+      _topicAliasMaximum = std::min<uint16_t>(_parser.getPacket().properties.topicAliasMaximum, EMC_MAX_TOPIC_ALIASES);
+    }
+    #endif
     _state = State::connected;
     _advanceOutbox();
     if (_parser.getPacket().variableHeader.fixed.connackVarHeader.sessionPresent == 0) {
@@ -37,7 +37,7 @@ class MqttClient {
       packetId = 0;
     } else {
       EMC_SEMAPHORE_TAKE();
-      if (!_addPacket(packetId, topic, qos, std::forward<Args>(args) ...)) {
+      if (!_addPacket(_protocolVersion, packetId, topic, qos, std::forward<Args>(args) ...)) {
         emc_log_e("Could not create SUBSCRIBE packet");
         packetId = 0;
       }
@@ -45,6 +45,8 @@ class MqttClient {
     }
     return packetId;
   }
+  // all filters in one packet, at most EMC_PAYLOAD_BUFFER_SIZE - 1 so the return codes fit the SUBACK buffer
+  uint16_t subscribe(const espMqttClientTypes::SubscribeItem* list, size_t numberTopics);
   template <typename... Args>
   uint16_t unsubscribe(const char* topic, Args&&... args) {
     uint16_t packetId = _getNextPacketId();
@@ -52,7 +54,7 @@ class MqttClient {
       packetId = 0;
     } else {
       EMC_SEMAPHORE_TAKE();
-      if (!_addPacket(packetId, topic, std::forward<Args>(args) ...)) {
+      if (!_addPacket(_protocolVersion, packetId, topic, std::forward<Args>(args) ...)) {
         emc_log_e("Could not create UNSUBSCRIBE packet");
         packetId = 0;
       }
@@ -63,8 +65,25 @@ class MqttClient {
   uint16_t publish(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length);
   uint16_t publish(const char* topic, uint8_t qos, bool retain, const char* payload);
   uint16_t publish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::PayloadCallback callback, size_t length);
+  // the payload isn't copied, the client takes its own reference. The caller keeps (and releases) theirs.
+  uint16_t publish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload);
+  // replaces messages on the same topic that haven't been sent yet, for values where only the latest matters
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length);
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, const char* payload);
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload);
+  // MQTT 5: the server discards the message when it can't be delivered within messageExpiry seconds
+  uint16_t publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const uint8_t* payload, size_t length);
+  uint16_t publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const char* payload);
+  uint16_t publish(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload);
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const uint8_t* payload, size_t length);
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, const char* payload);
+  uint16_t publishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload);
   void clearQueue(bool deleteSessionData = false);  // Not MQTT compliant and may cause unpredictable results when `deleteSessionData` = true!
   const char* getClientId() const;
+  espMqttClientTypes::MemoryPoolStats getOutboxPoolStats();
+  // bytes of all queued packets, including those waiting for their acknowledgement
+  size_t getOutboxBytes();
+  static espMqttClientTypes::MemoryPoolStats getPacketBufferStats(espMqttClientTypes::PacketBufferSize size);
   void loop();
 
  protected:
@@ -95,6 +114,7 @@ class MqttClient {
   uint8_t _willQos;
   bool _willRetain;
   uint32_t _timeout;
+  espMqttClientTypes::ProtocolVersion _protocolVersion;
 
   // state is protected to allow state changes by the transport system, defined in child classes
   // eg. to allow AsyncTCP
@@ -129,39 +149,110 @@ class MqttClient {
   struct OutgoingPacket {
     uint32_t timeSent;
     espMqttClientInternals::Packet packet;
+    size_t* queuedBytes;  // the client's count, however the packet leaves the outbox
     template <typename... Args>
-    OutgoingPacket(uint32_t t, espMqttClientTypes::Error error, Args&&... args) :
+    OutgoingPacket(uint32_t t, size_t* bytes, espMqttClientTypes::Error& error, Args&&... args) :  // NOLINT(runtime/references)
       timeSent(t),
-      packet(error, std::forward<Args>(args) ...) {}
+      packet(error, std::forward<Args>(args) ...),
+      queuedBytes(bytes) {
+      *queuedBytes += packet.size();
+    }
+    ~OutgoingPacket() {
+      *queuedBytes -= packet.size();
+    }
   };
   espMqttClientInternals::Outbox<OutgoingPacket> _outbox;
+  size_t _outboxBytes;
   size_t _bytesSent;
+  #if EMC_TX_COALESCE
+  // small packets are gathered here and written at once
+  uint8_t _txBuffer[EMC_TX_BUFFER_SIZE];
+  size_t _txLength;
+  size_t _txWritten;
+  uint32_t _txStaged;  // when the first packet was gathered
+  #endif
   espMqttClientInternals::Parser _parser;
   uint32_t _lastClientActivity;
   uint32_t _lastServerActivity;
   bool _pingSent;
   espMqttClientTypes::DisconnectReason _disconnectReason;
+  #if EMC_MAX_TOPIC_ALIASES
+  // MQTT 5: topics with an alias on the current connection, the alias is index + 1
+  struct TopicAlias {
+    char* topic;  // not null terminated
+    size_t length;
+  };
+  TopicAlias _topicAliases[EMC_MAX_TOPIC_ALIASES];
+  uint16_t _topicAliasCount;
+  uint16_t _topicAliasMaximum;  // as agreed with the server
+  #endif
 
   uint16_t _getNextPacketId();
+  void _removeUnsentPublish(const char* topic);
 
   template <typename... Args>
   bool _addPacket(Args&&... args) {
     espMqttClientTypes::Error error(espMqttClientTypes::Error::SUCCESS);
-    espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.emplace(0, error, std::forward<Args>(args) ...);
+    espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.emplace(0, &_outboxBytes, error, std::forward<Args>(args) ...);
     if (it && error == espMqttClientTypes::Error::SUCCESS) return true;
+    if (it) _outbox.remove(it);
     return false;
   }
 
   template <typename... Args>
   bool _addPacketFront(Args&&... args) {
     espMqttClientTypes::Error error(espMqttClientTypes::Error::SUCCESS);
-    espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.emplaceFront(0, error, std::forward<Args>(args) ...);
+    espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.emplaceFront(0, &_outboxBytes, error, std::forward<Args>(args) ...);
     if (it && error == espMqttClientTypes::Error::SUCCESS) return true;
+    if (it) _outbox.remove(it);
     return false;
   }
 
+  template <typename... Args>
+  uint16_t _publish(bool latest, uint32_t messageExpiry, const char* topic, uint8_t qos, bool retain, Args&&... payload) {
+    #if !EMC_ALLOW_NOT_CONNECTED_PUBLISH
+    if (_state != State::connected) {
+    #else
+    if (_state > State::connected) {
+    #endif
+      return 0;
+    }
+    uint16_t packetId = (qos > 0) ? _getNextPacketId() : 1;
+    espMqttClientTypes::Error error(espMqttClientTypes::Error::SUCCESS);
+    EMC_SEMAPHORE_TAKE();
+    if (latest) _removeUnsentPublish(topic);
+    espMqttClientInternals::Outbox<OutgoingPacket>::Iterator it = _outbox.emplace(0, &_outboxBytes, error, _protocolVersion, messageExpiry, packetId, topic, std::forward<Args>(payload) ..., qos, retain);
+    if (!it) error = espMqttClientTypes::Error::OUT_OF_MEMORY;
+    #if EMC_OUTBOX_MAX_BYTES
+    if (error == espMqttClientTypes::Error::SUCCESS && _outboxBytes > EMC_OUTBOX_MAX_BYTES) {
+      emc_log_w("Outbox full (%zu bytes)", _outboxBytes);
+      error = espMqttClientTypes::Error::OUTBOX_FULL;
+    }
+    #endif
+    if (error != espMqttClientTypes::Error::SUCCESS) {
+      if (it) _outbox.remove(it);
+      emc_log_e("Could not create PUBLISH packet");
+      _onError(packetId, error);
+      packetId = 0;
+    }
+    EMC_SEMAPHORE_GIVE();
+    return packetId;
+  }
+
   void _checkOutbox();
+  void _applyTopicAlias(OutgoingPacket* packet);
+  void _clearTopicAliases();
   int _sendPacket();
+  #if EMC_TX_COALESCE
+  enum class TxStage {
+    none,    // nothing to send
+    staged,  // copied to the TX buffer
+    full,    // doesn't fit into what's left of the TX buffer
+    direct   // to be written by _sendPacket
+  };
+  TxStage _stagePacket();
+  bool _flushTxBuffer(bool force);
+  #endif
   bool _advanceOutbox();
   void _checkIncoming();
   void _checkPing();
@@ -12,6 +12,8 @@ the LICENSE file.
 #include <new>  // new (std::nothrow)
 #include <utility>  // std::forward
 
+#include "MemoryPool.h"
+
 namespace espMqttClientInternals {
 
 /**
@@ -19,6 +21,7 @@ namespace espMqttClientInternals {
  * 
  * Queue items can only be emplaced, at front and back of the queue.
  * Remove items using an iterator or the builtin iterator.
+ * Nodes come from a pool of EMC_OUTBOX_POOL_SIZE blocks, from the heap when it's exhausted.
  */
 
 template <typename T>
@@ -28,11 +31,12 @@ class Outbox {
   : _first(nullptr)
   , _last(nullptr)
   , _current(nullptr)
-  , _prev(nullptr) {}
+  , _prev(nullptr)
+  , _pool(sizeof(Node), EMC_OUTBOX_POOL_SIZE) {}
   ~Outbox() {
     while (_first) {
       Node* n = _first->next;
-      delete _first;
+      _deleteNode(_first);
       _first = n;
     }
   }
@@ -79,7 +83,7 @@ class Outbox {
   template <class... Args>
   Iterator emplace(Args&&... args) {
     Iterator it;
-    Node* node = new (std::nothrow) Node(std::forward<Args>(args) ...);
+    Node* node = _createNode(std::forward<Args>(args) ...);
     if (node != nullptr) {
       if (!_first) {
         // queue is empty
@@ -103,7 +107,7 @@ class Outbox {
   template <class... Args>
   Iterator emplaceFront(Args&&... args) {
     Iterator it;
-    Node* node = new (std::nothrow) Node(std::forward<Args>(args) ...);
+    Node* node = _createNode(std::forward<Args>(args) ...);
     if (node != nullptr) {
       if (!_first) {
         // queue is empty
@@ -141,6 +145,7 @@ class Outbox {
 
   void resetCurrent() {
     _current = _first;
+    _prev = nullptr;
   }
 
   Iterator front() const {
@@ -149,6 +154,14 @@ class Outbox {
     return it;
   }
 
+  // iterates the items that haven't been sent yet
+  Iterator current() const {
+    Iterator it;
+    it._node = _current;
+    it._prev = _prev;
+    return it;
+  }
+
   // Advance current item
   void next() {
     if (_current) {
@@ -163,11 +176,33 @@ class Outbox {
     return false;
   }
 
+  espMqttClientTypes::MemoryPoolStats poolStats() const {
+    return _pool.stats();
+  }
+
  private:
   Node* _first;
   Node* _last;
   Node* _current;
   Node* _prev;  // element just before _current
+  MemoryPool _pool;
+
+  template <class... Args>
+  Node* _createNode(Args&&... args) {
+    void* block = _pool.allocate();
+    if (!block) block = ::operator new(sizeof(Node), std::nothrow);
+    if (!block) return nullptr;
+    return new (block) Node(std::forward<Args>(args) ...);
+  }
+
+  void _deleteNode(Node* node) {
+    node->~Node();
+    if (_pool.owns(node)) {
+      _pool.release(node);
+    } else {
+      ::operator delete(node);
+    }
+  }
 
   void _remove(Node* prev, Node* node) {
     if (!node) return;
@@ -200,7 +235,7 @@ class Outbox {
     }
 
     // finally, delete the node
-    delete node;
+    _deleteNode(node);
   }
 };
 
@@ -17,6 +17,7 @@ namespace espMqttClientInternals {
 
 constexpr const char PROTOCOL[] = "MQTT";
 constexpr const uint8_t PROTOCOL_LEVEL = 0b00000100;
+constexpr const uint8_t PROTOCOL_LEVEL_5 = 0b00000101;
 
 typedef uint8_t MQTTPacketType;
 
@@ -74,4 +75,13 @@ constexpr struct {
   const uint8_t RESERVED      = 0x00;
 } ConnectFlag;
 
+// MQTT 5 property identifiers
+constexpr struct {
+  const uint8_t MESSAGE_EXPIRY_INTERVAL = 0x02;
+  const uint8_t SESSION_EXPIRY_INTERVAL = 0x11;
+  const uint8_t RECEIVE_MAXIMUM         = 0x21;
+  const uint8_t TOPIC_ALIAS_MAXIMUM     = 0x22;
+  const uint8_t TOPIC_ALIAS             = 0x23;
+} Property;
+
 }  // end namespace espMqttClientInternals
@@ -11,16 +11,37 @@ the LICENSE file.
 namespace espMqttClientInternals {
 
 Packet::~Packet() {
-  free(_data);
+  PacketBuffer::release(_data);
+  PacketBuffer::release(_aliasHeader);
+  if (_sharedPayload) _sharedPayload->release();
 }
 
 size_t Packet::available(size_t index) {
+  if (_aliasHeader) {
+    // the alias header stands in for everything in front of the payload
+    if (index < _aliasHeaderLength) return _aliasHeaderLength - index;
+    index = index - _aliasHeaderLength + _payloadIndex;
+  }
   if (index >= _size) return 0;
+  if (_sharedPayload) {
+    // header and payload are written as separate segments
+    if (index < _payloadIndex) return _payloadIndex - index;
+    return _size - index;
+  }
   if (!_getPayload) return _size - index;
   return _chunkedAvailable(index);
 }
 
 const uint8_t* Packet::data(size_t index) const {
+  if (_aliasHeader) {
+    if (index < _aliasHeaderLength) return &_aliasHeader[index];
+    index = index - _aliasHeaderLength + _payloadIndex;
+  }
+  if (_sharedPayload) {
+    if (index >= _size) return nullptr;
+    if (index < _payloadIndex) return &_data[index];
+    return &_sharedPayload->data()[index - _payloadIndex];
+  }
   if (!_getPayload) {
     if (!_data) return nullptr;
     if (index >= _size) return nullptr;
@@ -30,6 +51,7 @@ const uint8_t* Packet::data(size_t index) const {
 }
 
 size_t Packet::size() const {
+  if (_aliasHeader) return _aliasHeaderLength + _size - _payloadIndex;
   return _size;
 }
 
@@ -38,6 +60,7 @@ void Packet::setDup() {
   if (packetType() != PacketType.PUBLISH) return;
   if (_packetId == 0) return;
   _data[0] |= 0x08;
+  if (_aliasHeader) _aliasHeader[0] |= 0x08;
 }
 
 uint16_t Packet::packetId() const {
@@ -55,7 +78,110 @@ bool Packet::removable() const {
   return false;
 }
 
+bool Packet::hasTopic(const char* topic, size_t length) const {
+  size_t topicLength = 0;
+  const char* packetTopic = this->topic(&topicLength);
+  return packetTopic && topicLength == length && memcmp(packetTopic, topic, length) == 0;
+}
+
+const char* Packet::topic(size_t* length) const {
+  if (packetType() != PacketType.PUBLISH) return nullptr;
+  // the topic follows the fixed header, the remaining length takes 1 to 4 bytes
+  size_t index = 1;
+  while (_data[index++] & 0x80) {}
+  *length = (_data[index] << 8) | _data[index + 1];
+  return reinterpret_cast<const char*>(&_data[index + 2]);
+}
+
+bool Packet::setTopicAlias(uint16_t alias, bool omitTopic) {
+  if (_protocolVersion != espMqttClientTypes::ProtocolVersion::V5) return false;
+  if (_getPayload || alias == 0) return false;  // chunked payloads are read from _data
+  size_t topicLength = 0;
+  const char* packetTopic = topic(&topicLength);
+  if (!packetTopic) return false;
+
+  // the properties follow the topic and the packet ID, their length fits in a single byte
+  size_t index = reinterpret_cast<const uint8_t*>(packetTopic) - _data + topicLength + (_packetId ? 2 : 0);
+  size_t propertiesLength = _data[index];
+  size_t payloadLength = _size - _payloadIndex;
+  size_t remainingLength =
+    2 + (omitTopic ? 0 : topicLength) +
+    (_packetId ? 2 : 0) +
+    1 + propertiesLength + 3 +  // existing properties + topic alias
+    payloadLength;
+  size_t headerLength = 1 + remainingLengthLength(remainingLength) + remainingLength - payloadLength;
+  uint8_t* header = PacketBuffer::allocate(headerLength);
+  if (!header) return false;
+
+  size_t pos = 0;
+  header[pos++] = _data[0];
+  pos += encodeRemainingLength(remainingLength, &header[pos]);
+  if (omitTopic) {
+    header[pos++] = 0;
+    header[pos++] = 0;
+  } else {
+    header[pos++] = topicLength >> 8;
+    header[pos++] = topicLength & 0xFF;
+    memcpy(&header[pos], packetTopic, topicLength);
+    pos += topicLength;
+  }
+  if (_packetId) {
+    header[pos++] = _packetId >> 8;
+    header[pos++] = _packetId & 0xFF;
+  }
+  header[pos++] = propertiesLength + 3;
+  memcpy(&header[pos], &_data[index + 1], propertiesLength);
+  pos += propertiesLength;
+  header[pos++] = Property.TOPIC_ALIAS;
+  header[pos++] = alias >> 8;
+  header[pos] = alias & 0xFF;
+
+  PacketBuffer::release(_aliasHeader);
+  _aliasHeader = header;
+  _aliasHeaderLength = headerLength;
+  _topicAlias = alias;
+  return true;
+}
+
+void Packet::clearTopicAlias() {
+  PacketBuffer::release(_aliasHeader);
+  _aliasHeader = nullptr;
+  _aliasHeaderLength = 0;
+  _topicAlias = 0;
+}
+
+uint16_t Packet::topicAlias() const {
+  return _topicAlias;
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               bool cleanSession,
+               const char* username,
+               const char* password,
+               const char* willTopic,
+               bool willRetain,
+               uint8_t willQos,
+               const uint8_t* willPayload,
+               uint16_t willPayloadLength,
+               uint16_t keepAlive,
+               const char* clientId)
+: Packet(error,
+         espMqttClientTypes::ProtocolVersion::V3_1_1,
+         cleanSession,
+         username,
+         password,
+         willTopic,
+         willRetain,
+         willQos,
+         willPayload,
+         willPayloadLength,
+         keepAlive,
+         clientId) {
+  // empty body
+}
+
 Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
                bool cleanSession,
                const char* username,
                const char* password,
@@ -72,7 +198,12 @@ Packet::Packet(espMqttClientTypes::Error& error,
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   if (willPayload && willPayloadLength == 0) {
     size_t length = strlen(reinterpret_cast<const char*>(willPayload));
     if (length > UINT16_MAX) {
@@ -88,14 +219,20 @@ Packet::Packet(espMqttClientTypes::Error& error,
     return;
   }
 
+  // MQTT 5 ends a session when the connection closes unless it's given an expiry interval,
+  // never expiring keeps the 3.1.1 behaviour of cleanSession = false
+  bool v5 = version == espMqttClientTypes::ProtocolVersion::V5;
+  size_t propertiesLength = cleanSession ? 0 : 5;
+
   // Calculate size
   size_t remainingLength =
   6 +  // protocol
   1 +  // protocol level
   1 +  // connect flags
   2 +  // keepalive
+  (v5 ? 1 + propertiesLength : 0) +
   2 + strlen(clientId) +
-  (willTopic ? 2 + strlen(willTopic) + 2 + willPayloadLength : 0) +
+  (willTopic ? (v5 ? 1 : 0) + 2 + strlen(willTopic) + 2 + willPayloadLength : 0) +
   (username ? 2 + strlen(username) : 0) +
   (password ? 2 + strlen(password) : 0);
 
@@ -112,7 +249,7 @@ Packet::Packet(espMqttClientTypes::Error& error,
   _data[pos++] = PacketType.CONNECT | HeaderFlag.CONNECT_RESERVED;
   pos += encodeRemainingLength(remainingLength, &_data[pos]);
   pos += encodeString(PROTOCOL, &_data[pos]);
-  _data[pos++] = PROTOCOL_LEVEL;
+  _data[pos++] = v5 ? PROTOCOL_LEVEL_5 : PROTOCOL_LEVEL;
   uint8_t connectFlags = 0;
   if (cleanSession) connectFlags |= espMqttClientInternals::ConnectFlag.CLEAN_SESSION;
   if (username != nullptr) connectFlags |= espMqttClientInternals::ConnectFlag.USERNAME;
@@ -135,12 +272,21 @@ Packet::Packet(espMqttClientTypes::Error& error,
   _data[pos++] = connectFlags;
   _data[pos++] = keepAlive >> 8;
   _data[pos++] = keepAlive & 0xFF;
+  if (v5) {
+    _data[pos++] = propertiesLength;
+    if (!cleanSession) {
+      _data[pos++] = Property.SESSION_EXPIRY_INTERVAL;
+      memset(&_data[pos], 0xFF, 4);
+      pos += 4;
+    }
+  }
 
   // PAYLOAD
   // client ID
   pos += encodeString(clientId, &_data[pos]);
   // will
   if (willTopic != nullptr && willPayload != nullptr) {
+    if (v5) _data[pos++] = 0;  // no will properties
     pos += encodeString(willTopic, &_data[pos]);
     _data[pos++] = willPayloadLength >> 8;
     _data[pos++] = willPayloadLength & 0xFF;
@@ -161,16 +307,35 @@ Packet::Packet(espMqttClientTypes::Error& error,
                size_t payloadLength,
                uint8_t qos,
                bool retain)
+: Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, 0, packetId, topic, payload, payloadLength, qos, retain) {
+  // empty body
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint32_t messageExpiry,
+               uint16_t packetId,
+               const char* topic,
+               const uint8_t* payload,
+               size_t payloadLength,
+               uint8_t qos,
+               bool retain)
 : _packetId(packetId)
 , _data(nullptr)
 , _size(0)
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   size_t remainingLength =
     2 + strlen(topic) +  // topic length + topic
     2 +                  // packet ID
+    _publishPropertiesLength(messageExpiry) +
     payloadLength;
 
   if (qos == 0) {
@@ -183,7 +348,8 @@ Packet::Packet(espMqttClientTypes::Error& error,
     return;
   }
 
-  size_t pos = _fillPublishHeader(packetId, topic, remainingLength, qos, retain);
+  size_t pos = _fillPublishHeader(packetId, topic, remainingLength, qos, retain, messageExpiry);
+  _payloadIndex = pos;
 
   // PAYLOAD
   memcpy(&_data[pos], payload, payloadLength);
@@ -198,16 +364,35 @@ Packet::Packet(espMqttClientTypes::Error& error,
                size_t payloadLength,
                uint8_t qos,
                bool retain)
+: Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, 0, packetId, topic, payloadCallback, payloadLength, qos, retain) {
+  // empty body
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint32_t messageExpiry,
+               uint16_t packetId,
+               const char* topic,
+               espMqttClientTypes::PayloadCallback payloadCallback,
+               size_t payloadLength,
+               uint8_t qos,
+               bool retain)
 : _packetId(packetId)
 , _data(nullptr)
 , _size(0)
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(payloadCallback) {
+, _getPayload(payloadCallback)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   size_t remainingLength =
     2 + strlen(topic) +  // topic length + topic
     2 +                  // packet ID
+    _publishPropertiesLength(messageExpiry) +
     payloadLength;
 
   if (qos == 0) {
@@ -220,7 +405,7 @@ Packet::Packet(espMqttClientTypes::Error& error,
     return;
   }
 
-  size_t pos = _fillPublishHeader(packetId, topic, remainingLength, qos, retain);
+  size_t pos = _fillPublishHeader(packetId, topic, remainingLength, qos, retain, messageExpiry);
 
   // payload will be added by 'Packet::available'
   _size = pos + payloadLength;
@@ -231,18 +416,115 @@ Packet::Packet(espMqttClientTypes::Error& error,
   error = espMqttClientTypes::Error::SUCCESS;
 }
 
+Packet::Packet(espMqttClientTypes::Error& error,
+               uint16_t packetId,
+               const char* topic,
+               espMqttClientTypes::SharedPayload* payload,
+               uint8_t qos,
+               bool retain)
+: Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, 0, packetId, topic, payload, qos, retain) {
+  // empty body
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint32_t messageExpiry,
+               uint16_t packetId,
+               const char* topic,
+               espMqttClientTypes::SharedPayload* payload,
+               uint8_t qos,
+               bool retain)
+: _packetId(packetId)
+, _data(nullptr)
+, _size(0)
+, _payloadIndex(0)
+, _payloadStartIndex(0)
+, _payloadEndIndex(0)
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
+  size_t payloadLength = payload ? payload->length() : 0;
+  size_t remainingLength =
+    2 + strlen(topic) +  // topic length + topic
+    2 +                  // packet ID
+    _publishPropertiesLength(messageExpiry) +
+    payloadLength;
+
+  if (qos == 0) {
+    remainingLength -= 2;
+    _packetId = 0;
+  }
+
+  // only the header is allocated, the payload is referenced
+  if (!_allocate(remainingLength, payloadLength)) {
+    error = espMqttClientTypes::Error::OUT_OF_MEMORY;
+    return;
+  }
+
+  _payloadIndex = _fillPublishHeader(packetId, topic, remainingLength, qos, retain, messageExpiry);
+
+  // released by the destructor: after sending for QoS 0, after the acknowledgement otherwise
+  if (payload) {
+    payload->retain();
+    _sharedPayload = payload;
+  }
+
+  error = espMqttClientTypes::Error::SUCCESS;
+}
+
 Packet::Packet(espMqttClientTypes::Error& error, uint16_t packetId, const char* topic, uint8_t qos)
+: Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, topic, qos) {
+  // empty body
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint16_t packetId,
+               const char* topic,
+               uint8_t qos)
 : _packetId(packetId)
 , _data(nullptr)
 , _size(0)
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   SubscribeItem list[1] = {topic, qos};
   _createSubscribe(error, list, 1);
 }
 
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint16_t packetId,
+               const SubscribeItem* list,
+               size_t numberTopics)
+: _packetId(packetId)
+, _data(nullptr)
+, _size(0)
+, _payloadIndex(0)
+, _payloadStartIndex(0)
+, _payloadEndIndex(0)
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
+  if (numberTopics == 0) {
+    error = espMqttClientTypes::Error::MALFORMED_PARAMETER;
+    return;
+  }
+  _createSubscribe(error, list, numberTopics);
+}
+
 Packet::Packet(espMqttClientTypes::Error& error, MQTTPacketType type, uint16_t packetId)
 : _packetId(packetId)
 , _data(nullptr)
@@ -250,7 +532,12 @@ Packet::Packet(espMqttClientTypes::Error& error, MQTTPacketType type, uint16_t p
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(espMqttClientTypes::ProtocolVersion::V3_1_1)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   if (!_allocate(2)) {
     error = espMqttClientTypes::Error::OUT_OF_MEMORY;
     return;
@@ -271,13 +558,26 @@ Packet::Packet(espMqttClientTypes::Error& error, MQTTPacketType type, uint16_t p
 }
 
 Packet::Packet(espMqttClientTypes::Error& error, uint16_t packetId, const char* topic)
+: Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, topic) {
+  // empty body
+}
+
+Packet::Packet(espMqttClientTypes::Error& error,
+               espMqttClientTypes::ProtocolVersion version,
+               uint16_t packetId,
+               const char* topic)
 : _packetId(packetId)
 , _data(nullptr)
 , _size(0)
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(version)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   const char* list[1] = {topic};
   _createUnsubscribe(error, list, 1);
 }
@@ -289,7 +589,12 @@ Packet::Packet(espMqttClientTypes::Error& error, MQTTPacketType type)
 , _payloadIndex(0)
 , _payloadStartIndex(0)
 , _payloadEndIndex(0)
-, _getPayload(nullptr) {
+, _getPayload(nullptr)
+, _sharedPayload(nullptr)
+, _protocolVersion(espMqttClientTypes::ProtocolVersion::V3_1_1)
+, _aliasHeader(nullptr)
+, _aliasHeaderLength(0)
+, _topicAlias(0) {
   if (!_allocate(0)) {
     error = espMqttClientTypes::Error::OUT_OF_MEMORY;
     return;
@@ -300,28 +605,32 @@ Packet::Packet(espMqttClientTypes::Error& error, MQTTPacketType type)
 }
 
 
-bool Packet::_allocate(size_t remainingLength) {
-  if (EMC_GET_FREE_MEMORY() < EMC_MIN_FREE_MEMORY) {
-    emc_log_w("Packet buffer not allocated: low memory");
-    return false;
-  }
+bool Packet::_allocate(size_t remainingLength, size_t externalLength) {
   _size = 1 + remainingLengthLength(remainingLength) + remainingLength;
-  _data = reinterpret_cast<uint8_t*>(malloc(_size));
+  size_t bufferSize = _size - externalLength;
+  // pooled when a block is free, the heap is only checked for free memory when it's needed
+  _data = PacketBuffer::allocate(bufferSize);
   if (!_data) {
     _size = 0;
-    emc_log_w("Alloc failed (l:%zu)", _size);
+    emc_log_w("Alloc failed (l:%zu)", bufferSize);
     return false;
   }
-  emc_log_i("Alloc (l:%zu)", _size);
-  memset(_data, 0, _size);
+  emc_log_i("Alloc (l:%zu)", bufferSize);
+  memset(_data, 0, bufferSize);
   return true;
 }
 
+size_t Packet::_publishPropertiesLength(uint32_t messageExpiry) const {
+  if (_protocolVersion != espMqttClientTypes::ProtocolVersion::V5) return 0;
+  return 1 + (messageExpiry ? 5 : 0);
+}
+
 size_t Packet::_fillPublishHeader(uint16_t packetId,
                                   const char* topic,
                                   size_t remainingLength,
                                   uint8_t qos,
-                                  bool retain) {
+                                  bool retain,
+                                  uint32_t messageExpiry) {
   size_t index = 0;
 
   // FIXED HEADER
@@ -342,19 +651,30 @@ size_t Packet::_fillPublishHeader(uint16_t packetId,
     _data[index++] = packetId >> 8;
     _data[index++] = packetId & 0xFF;
   }
+  if (_protocolVersion == espMqttClientTypes::ProtocolVersion::V5) {
+    _data[index++] = _publishPropertiesLength(messageExpiry) - 1;
+    if (messageExpiry) {
+      _data[index++] = Property.MESSAGE_EXPIRY_INTERVAL;
+      _data[index++] = messageExpiry >> 24;
+      _data[index++] = (messageExpiry >> 16) & 0xFF;
+      _data[index++] = (messageExpiry >> 8) & 0xFF;
+      _data[index++] = messageExpiry & 0xFF;
+    }
+  }
 
   return index;
 }
 
 void Packet::_createSubscribe(espMqttClientTypes::Error& error,
-                              SubscribeItem* list,
+                              const SubscribeItem* list,
                               size_t numberTopics) {
   // Calculate size
   size_t payload = 0;
   for (size_t i = 0; i < numberTopics; ++i) {
     payload += 2 + strlen(list[i].topic) + 1;  // length bytes, string, qos
   }
-  size_t remainingLength = 2 + payload;  // packetId + payload
+  bool v5 = _protocolVersion == espMqttClientTypes::ProtocolVersion::V5;
+  size_t remainingLength = 2 + (v5 ? 1 : 0) + payload;  // packetId + properties + payload
 
   // allocate memory
   if (!_allocate(remainingLength)) {
@@ -368,6 +688,7 @@ void Packet::_createSubscribe(espMqttClientTypes::Error& error,
   pos += encodeRemainingLength(remainingLength, &_data[pos]);
   _data[pos++] = _packetId >> 8;
   _data[pos++] = _packetId & 0xFF;
+  if (v5) _data[pos++] = 0;  // no properties
   for (size_t i = 0; i < numberTopics; ++i) {
     pos += encodeString(list[i].topic, &_data[pos]);
     _data[pos++] = list[i].qos;
@@ -384,7 +705,8 @@ void Packet::_createUnsubscribe(espMqttClientTypes::Error& error,
   for (size_t i = 0; i < numberTopics; ++i) {
     payload += 2 + strlen(list[i]);  // length bytes, string
   }
-  size_t remainingLength = 2 + payload;  // packetId + payload
+  bool v5 = _protocolVersion == espMqttClientTypes::ProtocolVersion::V5;
+  size_t remainingLength = 2 + (v5 ? 1 : 0) + payload;  // packetId + properties + payload
 
   // allocate memory
   if (!_allocate(remainingLength)) {
@@ -398,6 +720,7 @@ void Packet::_createUnsubscribe(espMqttClientTypes::Error& error,
   pos += encodeRemainingLength(remainingLength, &_data[pos]);
   _data[pos++] = _packetId >> 8;
   _data[pos++] = _packetId & 0xFF;
+  if (v5) _data[pos++] = 0;  // no properties
   for (size_t i = 0; i < numberTopics; ++i) {
     pos += encodeString(list[i], &_data[pos]);
   }
@@ -10,6 +10,7 @@ the LICENSE file.
 
 #include <stdint.h>
 #include <stddef.h>
+#include <utility>  // std::forward
 
 #include "Constants.h"
 #include "Config.h"
@@ -18,6 +19,8 @@ the LICENSE file.
 #include "../Logging.h"
 #include "RemainingLength.h"
 #include "String.h"
+#include "../MemoryPool.h"
+#include "../SharedPayload.h"
 
 namespace espMqttClientInternals {
 
@@ -32,6 +35,16 @@ class Packet {
   uint16_t packetId() const;
   MQTTPacketType packetType() const;
   bool removable() const;
+  // PUBLISH to this topic
+  bool hasTopic(const char* topic, size_t length) const;
+  // PUBLISH topic, not null terminated
+  const char* topic(size_t* length) const;
+
+  // MQTT 5 PUBLISH: sends a rewritten header carrying the alias, without the topic when omitTopic.
+  // Aliases are only valid on the connection they were set up on, clear them when it closes.
+  bool setTopicAlias(uint16_t alias, bool omitTopic);
+  void clearTopicAlias();
+  uint16_t topicAlias() const;
 
  protected:
   uint16_t _packetId;  // save as separate variable: will be accessed frequently
@@ -44,10 +57,16 @@ class Packet {
   size_t _payloadEndIndex;
   espMqttClientTypes::PayloadCallback _getPayload;
 
-  struct SubscribeItem {
-    const char* topic;
-    uint8_t qos;
-  };
+  // referenced payload, only the header is in _data
+  espMqttClientTypes::SharedPayload* _sharedPayload;
+
+  espMqttClientTypes::ProtocolVersion _protocolVersion;
+  // replaces _data up to _payloadIndex while a topic alias is set
+  uint8_t* _aliasHeader;
+  size_t _aliasHeaderLength;
+  uint16_t _topicAlias;
+
+  typedef espMqttClientTypes::SubscribeItem SubscribeItem;
 
  public:
   // CONNECT
@@ -62,6 +81,18 @@ class Packet {
          uint16_t willPayloadLength,
          uint16_t keepAlive,
          const char* clientId);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         bool cleanSession,
+         const char* username,
+         const char* password,
+         const char* willTopic,
+         bool willRetain,
+         uint8_t willQos,
+         const uint8_t* willPayload,
+         uint16_t willPayloadLength,
+         uint16_t keepAlive,
+         const char* clientId);
   // PUBLISH
   Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
          uint16_t packetId,
@@ -77,13 +108,69 @@ class Packet {
          size_t payloadLength,
          uint8_t qos,
          bool retain);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         uint16_t packetId,
+         const char* topic,
+         espMqttClientTypes::SharedPayload* payload,
+         uint8_t qos,
+         bool retain);
+  // messageExpiry in seconds, 0 doesn't expire. Ignored by MQTT 3.1.1.
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint32_t messageExpiry,
+         uint16_t packetId,
+         const char* topic,
+         const uint8_t* payload,
+         size_t payloadLength,
+         uint8_t qos,
+         bool retain);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint32_t messageExpiry,
+         uint16_t packetId,
+         const char* topic,
+         espMqttClientTypes::PayloadCallback payloadCallback,
+         size_t payloadLength,
+         uint8_t qos,
+         bool retain);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint32_t messageExpiry,
+         uint16_t packetId,
+         const char* topic,
+         espMqttClientTypes::SharedPayload* payload,
+         uint8_t qos,
+         bool retain);
   // SUBSCRIBE
   Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
          uint16_t packetId,
          const char* topic,
          uint8_t qos);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint16_t packetId,
+         const char* topic,
+         uint8_t qos);
+  // list built at runtime, all filters in one packet
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint16_t packetId,
+         const SubscribeItem* list,
+         size_t numberTopics);
+  template<typename ... Args>
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         uint16_t packetId,
+         const char* topic1,
+         uint8_t qos1,
+         const char* topic2,
+         uint8_t qos2,
+         Args&& ... args)
+  : Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, topic1, qos1, topic2, qos2, std::forward<Args>(args) ...) {
+    // empty body
+  }
   template<typename ... Args>
   Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
          uint16_t packetId,
          const char* topic1,
          uint8_t qos1,
@@ -96,7 +183,12 @@ class Packet {
   , _payloadIndex(0)
   , _payloadStartIndex(0)
   , _payloadEndIndex(0)
-  , _getPayload(nullptr) {
+  , _getPayload(nullptr)
+  , _sharedPayload(nullptr)
+  , _protocolVersion(version)
+  , _aliasHeader(nullptr)
+  , _aliasHeaderLength(0)
+  , _topicAlias(0) {
     static_assert(sizeof...(Args) % 2 == 0);
     size_t numberTopics = 2 + (sizeof...(Args) / 2);
     SubscribeItem list[numberTopics] = {topic1, qos1, topic2, qos2, args...};
@@ -106,19 +198,38 @@ class Packet {
   Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
          uint16_t packetId,
          const char* topic);
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint16_t packetId,
+         const char* topic);
   template<typename ... Args>
   Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
          uint16_t packetId,
          const char* topic1,
          const char* topic2,
          Args&& ... args)
+  : Packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, topic1, topic2, std::forward<Args>(args) ...) {
+    // empty body
+  }
+  template<typename ... Args>
+  Packet(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
+         espMqttClientTypes::ProtocolVersion version,
+         uint16_t packetId,
+         const char* topic1,
+         const char* topic2,
+         Args&& ... args)
   : _packetId(packetId)
   , _data(nullptr)
   , _size(0)
   , _payloadIndex(0)
   , _payloadStartIndex(0)
   , _payloadEndIndex(0)
-  , _getPayload(nullptr) {
+  , _getPayload(nullptr)
+  , _sharedPayload(nullptr)
+  , _protocolVersion(version)
+  , _aliasHeader(nullptr)
+  , _aliasHeaderLength(0)
+  , _topicAlias(0) {
     size_t numberTopics = 2 + sizeof...(Args);
     const char* list[numberTopics] = {topic1, topic2, args...};
     _createUnsubscribe(error, list, numberTopics);
@@ -133,16 +244,21 @@ class Packet {
 
  private:
   // pass remainingLength = total size - header - remainingLengthLength!
-  bool _allocate(size_t remainingLength);
+  // the last externalLength bytes of the packet are not allocated
+  bool _allocate(size_t remainingLength, size_t externalLength = 0);
+
+  // property length and properties of a PUBLISH, 0 for MQTT 3.1.1
+  size_t _publishPropertiesLength(uint32_t messageExpiry) const;
 
   // fills header and returns index of next available byte in buffer
   size_t _fillPublishHeader(uint16_t packetId,
                             const char* topic,
                             size_t remainingLength,
                             uint8_t qos,
-                            bool retain);
+                            bool retain,
+                            uint32_t messageExpiry);
   void _createSubscribe(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
-                        SubscribeItem* list,
+                        const SubscribeItem* list,
                         size_t numberTopics);
   void _createUnsubscribe(espMqttClientTypes::Error& error,  // NOLINT(runtime/references)
                           const char** list,
@@ -10,6 +10,21 @@ the LICENSE file.
 
 namespace espMqttClientInternals {
 
+// MQTT 5 CONNACK reason codes mapped to the 3.1.1 return codes that are reported to the user
+static uint8_t connackReturnCode(uint8_t reasonCode) {
+  switch (reasonCode) {
+    case 0x00: return 0;  // success
+    case 0x84: return 1;  // unsupported protocol version
+    case 0x85: return 2;  // client identifier not valid
+    case 0x86: return 4;  // bad user name or password
+    case 0x87:            // not authorized
+    case 0x8A:            // banned
+    case 0x8C:            // bad authentication method
+      return 5;
+    default: return 3;    // server unavailable, busy, moved...
+  }
+}
+
 uint8_t IncomingPacket::qos() const {
   if ((fixedHeader.packetType & 0xF0) != PacketType.PUBLISH) return 0;
   return (fixedHeader.packetType & 0x06) >> 1;  // mask 0x00000110
@@ -29,6 +44,9 @@ void IncomingPacket::reset() {
   fixedHeader.packetType = 0;
   variableHeader.topicLength = 0;
   variableHeader.fixed.packetId = 0;
+  variableHeader.reasonCode = 0;
+  properties.topicAliasMaximum = 0;
+  properties.messageExpiry = 0;
   payload.index = 0;
   payload.length = 0;
 }
@@ -40,7 +58,9 @@ Parser::Parser()
 , _bytePos(0)
 , _parse(_fixedHeader)
 , _packet()
-, _payloadBuffer{0} {
+, _payloadBuffer{0}
+, _protocolVersion(espMqttClientTypes::ProtocolVersion::V3_1_1)
+, _property() {
   // empty
 }
 
@@ -68,6 +88,14 @@ void Parser::reset() {
   _packet.reset();
 }
 
+void Parser::setProtocolVersion(espMqttClientTypes::ProtocolVersion version) {
+  _protocolVersion = version;
+}
+
+bool Parser::_v5() const {
+  return _protocolVersion == espMqttClientTypes::ProtocolVersion::V5;
+}
+
 ParserResult Parser::_fixedHeader(Parser* p) {
   p->_packet.reset();
   p->_packet.fixedHeader.packetType = p->_data[p->_bytesRead];
@@ -101,7 +129,12 @@ ParserResult Parser::_fixedHeader(Parser* p) {
       case PacketType.PUBREL | HeaderFlag.PUBREL_RESERVED:
       case PacketType.PUBCOMP | HeaderFlag.PUBCOMP_RESERVED:
       case PacketType.UNSUBACK | HeaderFlag.UNSUBACK_RESERVED:
-        p->_parse = _remainingLengthFixed;
+        if (p->_v5()) {  // reason codes and properties follow
+          p->_parse = _remainingLengthVariable;
+          p->_bytePos = 0;
+        } else {
+          p->_parse = _remainingLengthFixed;
+        }
         break;
       case PacketType.SUBACK | HeaderFlag.SUBACK_RESERVED:
         p->_parse = _remainingLengthVariable;
@@ -110,6 +143,13 @@ ParserResult Parser::_fixedHeader(Parser* p) {
       case PacketType.PINGRESP | HeaderFlag.PINGRESP_RESERVED:
         p->_parse = _remainingLengthNone;
         break;
+      case PacketType.DISCONNECT | HeaderFlag.DISCONNECT_RESERVED:
+        if (p->_v5()) {  // MQTT 5 servers may disconnect
+          p->_parse = _remainingLengthVariable;
+          p->_bytePos = 0;
+          break;
+        }
+        [[fallthrough]];
       default:
         emc_log_w("Invalid packet header: 0x%02x", p->_packet.fixedHeader.packetType);
         return ParserResult::protocolError;
@@ -155,6 +195,27 @@ ParserResult Parser::_remainingLengthVariable(Parser* p) {
     p->_parse = _varHeaderTopicLength1;
     emc_log_i("Remaining length: %zu", p->_packet.fixedHeader.remainingLength.remainingLength);
     return ParserResult::awaitData;
+  } else if (p->_v5()) {
+    MQTTPacketType type = p->_packet.fixedHeader.packetType & 0xF0;
+    size_t remainingLength = p->_packet.fixedHeader.remainingLength.remainingLength;
+    // SUBACK and UNSUBACK: packet ID, properties and at least one reason code
+    size_t minimum = (type == PacketType.DISCONNECT) ? 0 : (type == PacketType.SUBACK || type == PacketType.UNSUBACK) ? 4 : 2;
+    if (remainingLength >= minimum) {
+      emc_log_i("Remaining length: %zu", remainingLength);
+      p->_bytePos = 0;
+      if (type == PacketType.CONNACK) {
+        p->_parse = _varHeaderConnack1;
+      } else if (type != PacketType.DISCONNECT) {
+        p->_parse = _varHeaderPacketId1;
+      } else if (remainingLength > 0) {
+        p->_parse = _varHeaderReasonCode;
+      } else {
+        p->_parse = _fixedHeader;
+        return ParserResult::packet;
+      }
+      return ParserResult::awaitData;
+    }
+    emc_log_w("Invalid remaining length (variable)");
   } else {
     int32_t payloadSize = p->_packet.fixedHeader.remainingLength.remainingLength - 2;  // total - packet ID
     if (0 < payloadSize && payloadSize < EMC_PAYLOAD_BUFFER_SIZE) {
@@ -200,7 +261,17 @@ ParserResult Parser::_varHeaderConnack1(Parser* p) {
 ParserResult Parser::_varHeaderConnack2(Parser* p) {
   uint8_t data = p->_data[p->_bytesRead];
   p->_parse = _fixedHeader;
-  if (data <= 5) {  // connect return code max is 5
+  if (p->_v5() && (data == 0x00 || data >= 0x80)) {
+    p->_packet.variableHeader.reasonCode = data;
+    p->_packet.variableHeader.fixed.connackVarHeader.returnCode = connackReturnCode(data);
+    if (p->_packet.fixedHeader.remainingLength.remainingLength > 2) {
+      p->_parse = _propertyLength;
+      p->_bytePos = 0;
+      return ParserResult::awaitData;
+    }
+    emc_log_i("Packet complete");
+    return ParserResult::packet;
+  } else if (!p->_v5() && data <= 5) {  // connect return code max is 5
     p->_packet.variableHeader.fixed.connackVarHeader.returnCode = data;
     emc_log_i("Packet complete");
     return ParserResult::packet;
@@ -220,18 +291,29 @@ ParserResult Parser::_varHeaderPacketId2(Parser* p) {
   p->_parse = _fixedHeader;
   if (p->_packet.variableHeader.fixed.packetId != 0) {
     emc_log_i("Packet variable header complete");
-    if ((p->_packet.fixedHeader.packetType & 0xF0) == PacketType.SUBACK) {
+    MQTTPacketType type = p->_packet.fixedHeader.packetType & 0xF0;
+    if (p->_v5() && (type == PacketType.SUBACK || type == PacketType.UNSUBACK)) {
+      p->_parse = _propertyLength;
+      p->_bytePos = 0;
+      return ParserResult::awaitData;
+    } else if (type == PacketType.SUBACK) {
       p->_parse = _payloadSuback;
       return ParserResult::awaitData;
-    } else if ((p->_packet.fixedHeader.packetType & 0xF0) == PacketType.PUBLISH) {
+    } else if (type == PacketType.PUBLISH) {
       p->_packet.payload.total -= 2;  // substract packet id length from payload
-      if (p->_packet.payload.total == 0) {
+      if (p->_v5()) {
+        p->_parse = _propertyLength;
+        p->_bytePos = 0;
+      } else if (p->_packet.payload.total == 0) {
         p->_parse = _fixedHeader;
         return ParserResult::packet;
       } else {
         p->_parse = _payloadPublish;
       }
       return ParserResult::awaitData;
+    } else if (p->_v5() && p->_packet.fixedHeader.remainingLength.remainingLength > 2) {
+      p->_parse = _varHeaderReasonCode;
+      return ParserResult::awaitData;
     } else {
       return ParserResult::packet;
     }
@@ -273,6 +355,9 @@ ParserResult Parser::_varHeaderTopic(Parser* p) {
     emc_log_i("Packet variable header topic complete");
     if (p->_packet.fixedHeader.packetType & (HeaderFlag.PUBLISH_QOS1 | HeaderFlag.PUBLISH_QOS2)) {
       p->_parse = _varHeaderPacketId1;
+    } else if (p->_v5()) {
+      p->_parse = _propertyLength;
+      p->_bytePos = 0;
     } else if (p->_packet.payload.total == 0) {
       p->_parse = _fixedHeader;
       return ParserResult::packet;
@@ -283,9 +368,241 @@ ParserResult Parser::_varHeaderTopic(Parser* p) {
   return ParserResult::awaitData;
 }
 
+ParserResult Parser::_varHeaderReasonCode(Parser* p) {
+  p->_packet.variableHeader.reasonCode = p->_data[p->_bytesRead];
+  p->_parse = _fixedHeader;
+  // the reason code follows the packet ID, DISCONNECT has none
+  size_t headerLength = ((p->_packet.fixedHeader.packetType & 0xF0) == PacketType.DISCONNECT) ? 1 : 3;
+  if (p->_packet.fixedHeader.remainingLength.remainingLength > headerLength) {
+    p->_parse = _propertyLength;
+    p->_bytePos = 0;
+    return ParserResult::awaitData;
+  }
+  emc_log_i("Packet complete");
+  return ParserResult::packet;
+}
+
+ParserResult Parser::_propertyLength(Parser* p) {
+  p->_property.lengthRaw[p->_bytePos] = p->_data[p->_bytesRead];
+  if (p->_property.lengthRaw[p->_bytePos] & 0x80) {
+    p->_bytePos++;
+    if (p->_bytePos < 4) return ParserResult::awaitData;
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  size_t lengthBytes = p->_bytePos + 1;
+  size_t propertiesLength = decodeRemainingLength(p->_property.lengthRaw);
+
+  // bytes that follow the variable header: properties, then the payload of PUBLISH, SUBACK and UNSUBACK
+  MQTTPacketType type = p->_packet.fixedHeader.packetType & 0xF0;
+  size_t remainingLength = p->_packet.fixedHeader.remainingLength.remainingLength;
+  size_t remaining = 0;
+  bool payload = true;
+  if (type == PacketType.PUBLISH) {
+    remaining = p->_packet.payload.total;
+  } else if (type == PacketType.SUBACK || type == PacketType.UNSUBACK) {
+    remaining = remainingLength - 2;
+  } else {
+    payload = false;
+    if (type == PacketType.CONNACK) {
+      remaining = remainingLength - 2;
+    } else if (type == PacketType.DISCONNECT) {
+      remaining = remainingLength - 1;
+    } else {
+      remaining = remainingLength - 3;
+    }
+  }
+  if (lengthBytes + propertiesLength > remaining || (!payload && lengthBytes + propertiesLength != remaining)) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length: %zu", propertiesLength);
+    return ParserResult::protocolError;
+  }
+  p->_packet.payload.total = remaining - lengthBytes - propertiesLength;
+  p->_property.remaining = propertiesLength;
+  if (propertiesLength == 0) return _propertiesComplete(p);
+  p->_parse = _propertyIdentifier;
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyIdentifier(Parser* p) {
+  p->_property.identifier = p->_data[p->_bytesRead];
+  p->_property.remaining--;
+  p->_property.value = 0;
+  p->_property.valueLength = 0;
+  p->_property.strings = 0;
+  switch (p->_property.identifier) {
+    case 0x01:  // payload format indicator
+    case 0x17:  // request problem information
+    case 0x19:  // request response information
+    case 0x24:  // maximum QoS
+    case 0x25:  // retain available
+    case 0x28:  // wildcard subscription available
+    case 0x29:  // subscription identifiers available
+    case 0x2A:  // shared subscription available
+      p->_property.valueLength = 1;
+      p->_parse = _propertyFixed;
+      break;
+    case 0x13:  // server keep alive
+    case 0x21:  // receive maximum
+    case 0x22:  // topic alias maximum
+    case 0x23:  // topic alias
+      p->_property.valueLength = 2;
+      p->_parse = _propertyFixed;
+      break;
+    case 0x02:  // message expiry interval
+    case 0x11:  // session expiry interval
+    case 0x18:  // will delay interval
+    case 0x27:  // maximum packet size
+      p->_property.valueLength = 4;
+      p->_parse = _propertyFixed;
+      break;
+    case 0x0B:  // subscription identifier
+      p->_parse = _propertyVarInt;
+      break;
+    case 0x03:  // content type
+    case 0x08:  // response topic
+    case 0x09:  // correlation data
+    case 0x12:  // assigned client identifier
+    case 0x15:  // authentication method
+    case 0x16:  // authentication data
+    case 0x1A:  // response information
+    case 0x1C:  // server reference
+    case 0x1F:  // reason string
+      p->_property.strings = 1;
+      p->_parse = _propertyStringLength1;
+      break;
+    case 0x26:  // user property
+      p->_property.strings = 2;
+      p->_parse = _propertyStringLength1;
+      break;
+    default:
+      p->_parse = _fixedHeader;
+      emc_log_w("Invalid property: 0x%02x", p->_property.identifier);
+      return ParserResult::protocolError;
+  }
+  if (p->_property.remaining == 0) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyFixed(Parser* p) {
+  p->_property.value = (p->_property.value << 8) | p->_data[p->_bytesRead];
+  p->_property.remaining--;
+  if (--p->_property.valueLength == 0) return _propertyComplete(p);
+  if (p->_property.remaining == 0) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyVarInt(Parser* p) {
+  // the value isn't used, it's skipped
+  p->_property.remaining--;
+  if (!(p->_data[p->_bytesRead] & 0x80)) return _propertyComplete(p);
+  if (p->_property.remaining == 0 || ++p->_property.valueLength == 4) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyStringLength1(Parser* p) {
+  p->_property.valueLength = p->_data[p->_bytesRead] << 8;
+  p->_property.remaining--;
+  if (p->_property.remaining == 0) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  p->_parse = _propertyStringLength2;
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyStringLength2(Parser* p) {
+  p->_property.valueLength |= p->_data[p->_bytesRead];
+  p->_property.remaining--;
+  if (p->_property.valueLength > p->_property.remaining) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  if (p->_property.valueLength > 0) {
+    p->_parse = _propertyString;
+    return ParserResult::awaitData;
+  }
+  return _propertyStringComplete(p);
+}
+
+ParserResult Parser::_propertyString(Parser* p) {
+  // strings aren't used, skip what's available at once
+  size_t skip = std::min(p->_len - p->_bytesRead, p->_property.valueLength);
+  p->_bytesRead += skip - 1;  // compensate for increment in _parse-loop
+  p->_property.valueLength -= skip;
+  p->_property.remaining -= skip;
+  if (p->_property.valueLength > 0) return ParserResult::awaitData;
+  return _propertyStringComplete(p);
+}
+
+ParserResult Parser::_propertyStringComplete(Parser* p) {
+  if (--p->_property.strings == 0) return _propertyComplete(p);
+  if (p->_property.remaining == 0) {
+    p->_parse = _fixedHeader;
+    emc_log_w("Invalid property length");
+    return ParserResult::protocolError;
+  }
+  p->_parse = _propertyStringLength1;
+  return ParserResult::awaitData;
+}
+
+ParserResult Parser::_propertyComplete(Parser* p) {
+  if (p->_property.identifier == Property.TOPIC_ALIAS_MAXIMUM) {
+    p->_packet.properties.topicAliasMaximum = p->_property.value;
+  } else if (p->_property.identifier == Property.MESSAGE_EXPIRY_INTERVAL) {
+    p->_packet.properties.messageExpiry = p->_property.value;
+  }
+  if (p->_property.remaining > 0) {
+    p->_parse = _propertyIdentifier;
+    return ParserResult::awaitData;
+  }
+  return _propertiesComplete(p);
+}
+
+ParserResult Parser::_propertiesComplete(Parser* p) {
+  p->_parse = _fixedHeader;
+  MQTTPacketType type = p->_packet.fixedHeader.packetType & 0xF0;
+  if (type == PacketType.PUBLISH) {
+    if (p->_packet.payload.total == 0) return ParserResult::packet;
+    p->_parse = _payloadPublish;
+    return ParserResult::awaitData;
+  } else if (type == PacketType.SUBACK || type == PacketType.UNSUBACK) {
+    // reason codes, one per topic
+    if (0 < p->_packet.payload.total && p->_packet.payload.total < EMC_PAYLOAD_BUFFER_SIZE) {
+      p->_bytePos = 0;
+      p->_packet.payload.data = p->_payloadBuffer;
+      p->_packet.payload.index = 0;
+      p->_packet.payload.length = p->_packet.payload.total;
+      p->_parse = _payloadSuback;
+      return ParserResult::awaitData;
+    }
+    emc_log_w("Invalid payload length");
+    return ParserResult::protocolError;
+  }
+  emc_log_i("Packet complete");
+  return ParserResult::packet;
+}
+
 ParserResult Parser::_payloadSuback(Parser* p) {
   uint8_t data = p->_data[p->_bytesRead];
-  if (data < 0x03 || data == 0x80) {
+  // MQTT 5 has more reasons to fail a subscription, they're all reported as FAIL
+  if (p->_v5() && data >= 0x80) data = 0x80;
+  if (p->_v5() || data < 0x03 || data == 0x80) {
     p->_payloadBuffer[p->_bytePos] = data;
     p->_bytePos++;
   } else {
@@ -13,6 +13,7 @@ the LICENSE file.
 #include <algorithm>
 
 #include "../Config.h"
+#include "../TypeDefs.h"
 #include "Constants.h"
 #include "../Logging.h"
 #include "RemainingLength.h"
@@ -37,7 +38,13 @@ struct IncomingPacket {
       } connackVarHeader;
       uint16_t packetId;
     } fixed;
+    uint8_t reasonCode;  // MQTT 5 acknowledgements and DISCONNECT
   } variableHeader;
+  // MQTT 5, only the properties the client acts upon
+  struct {
+    uint16_t topicAliasMaximum;
+    uint32_t messageExpiry;
+  } properties;
   struct {
     const uint8_t* data;
     size_t length;
@@ -66,6 +73,7 @@ class Parser {
   ParserResult parse(const uint8_t* data, size_t len, size_t* bytesRead);
   const IncomingPacket& getPacket() const;
   void reset();
+  void setProtocolVersion(espMqttClientTypes::ProtocolVersion version);
 
  private:
   // keep data variables in class to avoid copying on every iteration of the parser
@@ -76,6 +84,17 @@ class Parser {
   ParserFunc _parse;
   IncomingPacket _packet;
   uint8_t _payloadBuffer[EMC_PAYLOAD_BUFFER_SIZE];
+  espMqttClientTypes::ProtocolVersion _protocolVersion;
+  struct {
+    uint8_t lengthRaw[4];
+    size_t remaining;     // bytes left in the properties
+    uint8_t identifier;
+    size_t valueLength;   // bytes left in the current value
+    uint32_t value;
+    uint8_t strings;      // length prefixed strings left in the current value
+  } _property;
+
+  bool _v5() const;
 
   static ParserResult _fixedHeader(Parser* p);
   static ParserResult _remainingLengthFixed(Parser* p);
@@ -93,6 +112,20 @@ class Parser {
   static ParserResult _varHeaderTopicLength2(Parser* p);
   static ParserResult _varHeaderTopic(Parser* p);
 
+  static ParserResult _varHeaderReasonCode(Parser* p);
+
+  static ParserResult _propertyLength(Parser* p);
+  static ParserResult _propertyIdentifier(Parser* p);
+  static ParserResult _propertyFixed(Parser* p);
+  static ParserResult _propertyVarInt(Parser* p);
+  static ParserResult _propertyStringLength1(Parser* p);
+  static ParserResult _propertyStringLength2(Parser* p);
+  static ParserResult _propertyString(Parser* p);
+  // not states: called on the last byte of a string, a property and of the properties
+  static ParserResult _propertyStringComplete(Parser* p);
+  static ParserResult _propertyComplete(Parser* p);
+  static ParserResult _propertiesComplete(Parser* p);
+
   static ParserResult _payloadSuback(Parser* p);
   static ParserResult _payloadPublish(Parser* p);
 };
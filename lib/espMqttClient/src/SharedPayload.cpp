@@ -0,0 +1,79 @@
+/*
+Copyright (c) 2022 Bert Melis. All rights reserved.
+
+This work is licensed under the terms of the MIT license.  
+For a copy, see <https://opensource.org/licenses/MIT> or
+the LICENSE file.
+*/
+
+#include <new>  // std::nothrow, placement new
+
+#include "SharedPayload.h"
+#include "Config.h"
+#include "Helpers.h"
+#include "Logging.h"
+
+namespace espMqttClientTypes {
+
+SharedPayload* SharedPayload::create(size_t length) {
+  // header and data in one allocation, the data follows the header
+  if (EMC_GET_FREE_MEMORY() < EMC_MIN_FREE_MEMORY + length) {
+    emc_log_w("Payload not allocated (l:%zu)", length);
+    return nullptr;
+  }
+  void* block = ::operator new(sizeof(SharedPayload) + length, std::nothrow);
+  if (!block) {
+    emc_log_w("Payload not allocated (l:%zu)", length);
+    return nullptr;
+  }
+  uint8_t* data = reinterpret_cast<uint8_t*>(block) + sizeof(SharedPayload);
+  return new (block) SharedPayload(data, length, nullptr);
+}
+
+SharedPayload* SharedPayload::borrow(const uint8_t* data, size_t length, OnReleaseCallback onRelease) {
+  void* block = ::operator new(sizeof(SharedPayload), std::nothrow);
+  if (!block) return nullptr;
+  // never written through, data() only hands out what the caller passed in
+  return new (block) SharedPayload(const_cast<uint8_t*>(data), length, onRelease);
+}
+
+SharedPayload::SharedPayload(uint8_t* data, size_t length, OnReleaseCallback onRelease)
+: _data(data)
+, _length(length)
+, _references(1)
+, _onRelease(onRelease) {
+  // empty body
+}
+
+uint8_t* SharedPayload::data() {
+  return _data;
+}
+
+const uint8_t* SharedPayload::data() const {
+  return _data;
+}
+
+size_t SharedPayload::length() const {
+  return _length;
+}
+
+void SharedPayload::setLength(size_t length) {
+  if (length < _length) _length = length;
+}
+
+void SharedPayload::retain() {
+  ++_references;
+}
+
+void SharedPayload::release() {
+  if (--_references > 0) return;
+  if (_onRelease) _onRelease(_data, _length);
+  this->~SharedPayload();
+  ::operator delete(this);
+}
+
+uint16_t SharedPayload::references() const {
+  return _references;
+}
+
+}  // end namespace espMqttClientTypes
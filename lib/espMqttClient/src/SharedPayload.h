@@ -0,0 +1,59 @@
+/*
+Copyright (c) 2022 Bert Melis. All rights reserved.
+
+This work is licensed under the terms of the MIT license.  
+For a copy, see <https://opensource.org/licenses/MIT> or
+the LICENSE file.
+*/
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <functional>
+
+namespace espMqttClientTypes {
+
+/**
+ * @brief Reference counted publish payload
+ *
+ * Publishing a SharedPayload doesn't copy it, the packet keeps a reference
+ * until it is sent (QoS 0) or acknowledged (QoS 1 and 2).
+ * The payload must not be changed while it is referenced by a packet.
+ */
+
+class SharedPayload {
+ public:
+  typedef std::function<void(const uint8_t* data, size_t length)> OnReleaseCallback;
+
+  // allocates length bytes to be filled by the caller, returns nullptr when out of memory
+  static SharedPayload* create(size_t length);
+  // wraps memory owned by the caller, onRelease is called when the last reference is released
+  static SharedPayload* borrow(const uint8_t* data, size_t length, OnReleaseCallback onRelease = nullptr);
+
+  SharedPayload(const SharedPayload&) = delete;
+  SharedPayload& operator=(const SharedPayload&) = delete;
+
+  uint8_t* data();
+  const uint8_t* data() const;
+  size_t length() const;
+  // shortens the payload, e.g. when it was rendered into a worst case sized buffer
+  void setLength(size_t length);
+
+  // both are thread safe, the payload is freed by the last release()
+  void retain();
+  void release();
+  uint16_t references() const;
+
+ private:
+  SharedPayload(uint8_t* data, size_t length, OnReleaseCallback onRelease);
+  ~SharedPayload() = default;
+
+  uint8_t* _data;
+  size_t _length;
+  std::atomic<uint16_t> _references;
+  OnReleaseCallback _onRelease;
+};
+
+}  // end namespace espMqttClientTypes
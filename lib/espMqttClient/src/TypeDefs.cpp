@@ -44,6 +44,7 @@ const char* errorToString(Error error) {
     case Error::MAX_RETRIES:         return "Maximum retries exceeded";
     case Error::MALFORMED_PARAMETER: return "Malformed parameters";
     case Error::MISC_ERROR:          return "Misc error";
+    case Error::OUTBOX_FULL:         return "Outbox full";
     default:                         return "";
   }
 }
@@ -44,11 +44,18 @@ enum class Error : uint8_t {
   OUT_OF_MEMORY = 1,
   MAX_RETRIES = 2,
   MALFORMED_PARAMETER = 3,
-  MISC_ERROR = 4
+  MISC_ERROR = 4,
+  OUTBOX_FULL = 5
 };
 
 const char* errorToString(Error error);
 
+// topic filter and QoS of a SUBSCRIBE built from a list
+struct SubscribeItem {
+  const char* topic;
+  uint8_t qos;
+};
+
 struct MessageProperties {
   uint8_t qos;
   bool dup;
@@ -56,6 +63,20 @@ struct MessageProperties {
   uint16_t packetId;
 };
 
+enum class PacketBufferSize : uint8_t {
+  SMALL = 0,
+  MEDIUM = 1,
+  LARGE = 2
+};
+
+struct MemoryPoolStats {
+  size_t blockSize;
+  size_t capacity;  // blocks
+  size_t used;
+  size_t peak;
+  uint32_t exhausted;  // allocations that found all blocks in use, they went to a larger size class or the heap
+};
+
 typedef std::function<void(bool sessionPresent)> OnConnectCallback;
 typedef std::function<void(DisconnectReason reason)> OnDisconnectCallback;
 typedef std::function<void(uint16_t packetId, const SubscribeReturncode* returncodes, size_t len)> OnSubscribeCallback;
@@ -65,6 +86,11 @@ typedef std::function<void(uint16_t packetId)> OnPublishCallback;
 typedef std::function<size_t(uint8_t* data, size_t maxSize, size_t index)> PayloadCallback;
 typedef std::function<void(uint16_t packetId, Error error)> OnErrorCallback;
 
+enum class ProtocolVersion : uint8_t {
+  V3_1_1 = 4,
+  V5 = 5
+};
+
 enum class UseInternalTask {
   NO = 0,
   YES = 1,
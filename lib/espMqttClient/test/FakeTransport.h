@@ -0,0 +1,83 @@
+#pragma once
+
+#include <unity.h>
+
+#include <vector>
+
+#include <MqttClientSetup.h>
+
+// records every write, answers CONNECT with a CONNACK
+class FakeTransport : public espMqttClientInternals::Transport {
+ public:
+  bool connect(IPAddress ip, uint16_t port) override {
+    (void) ip;
+    (void) port;
+    up = true;
+    connackSent = false;
+    return true;
+  }
+  bool connect(const char* host, uint16_t port) override {
+    (void) host;
+    (void) port;
+    up = true;
+    connackSent = false;
+    return true;
+  }
+  size_t write(const uint8_t* buf, size_t size) override {
+    if (blocked) return 0;
+    writes.push_back(std::vector<uint8_t>(buf, buf + size));
+    sent.insert(sent.end(), buf, buf + size);
+    return size;
+  }
+  int read(uint8_t* buf, size_t size) override {
+    if (connackSent || sent.empty() || size < connack.size()) return 0;
+    connectPacket = sent;
+    memcpy(buf, connack.data(), connack.size());
+    connackSent = true;
+    return connack.size();
+  }
+  void stop() override {
+    up = false;
+  }
+  bool connected() override {
+    return up;
+  }
+  bool disconnected() override {
+    return !up;
+  }
+
+  void clear() {
+    writes.clear();
+    sent.clear();
+  }
+
+  std::vector<std::vector<uint8_t>> writes;  // one entry per write
+  std::vector<uint8_t> sent;  // all bytes written
+  std::vector<uint8_t> connectPacket;  // bytes written before the last CONNACK
+  std::vector<uint8_t> connack = {0x20, 0x02, 0x00, 0x00};  // MQTT 3.1.1, accepted
+  bool connackSent = false;
+  bool blocked = false;  // a slow broker, writes return 0
+  bool up = false;  // set to false to drop the connection
+};
+
+class TestClient : public MqttClientSetup<TestClient> {
+ public:
+  TestClient()
+  : MqttClientSetup(espMqttClientTypes::UseInternalTask::NO)
+  , transport() {
+    _transport = &transport;
+    setServer("localhost", 1883);
+  }
+
+  FakeTransport transport;
+};
+
+// connects and forgets the bytes written so far
+inline void connectClient(TestClient& client) {
+  client.connect();
+  for (int i = 0; i < 10 && !client.connected(); ++i) {
+    client.loop();
+  }
+  TEST_ASSERT_TRUE(client.connected());
+  client.transport.clear();
+}
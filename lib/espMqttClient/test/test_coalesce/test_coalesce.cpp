@@ -0,0 +1,57 @@
+#include <unity.h>
+
+#include "../FakeTransport.h"
+
+void setUp() {}
+void tearDown() {}
+
+void test_coalesce_small_packets() {
+  TestClient client;
+  connectClient(client);
+
+  // QoS 0, topic "a", no payload: 5 bytes each
+  client.publish("a", 0, false, reinterpret_cast<const uint8_t*>(""), 0);
+  client.publish("b", 0, false, reinterpret_cast<const uint8_t*>(""), 0);
+  client.publish("c", 0, false, reinterpret_cast<const uint8_t*>(""), 0);
+  TEST_ASSERT_EQUAL_UINT32(15, client.getOutboxBytes());
+  client.loop();
+  TEST_ASSERT_EQUAL_UINT32(0, client.getOutboxBytes());
+
+  // the first two fill the TX buffer, the third goes out on its own
+  TEST_ASSERT_EQUAL_UINT32(2, client.transport.writes.size());
+  TEST_ASSERT_EQUAL_UINT32(10, client.transport.writes[0].size());
+  TEST_ASSERT_EQUAL_UINT32(5, client.transport.writes[1].size());
+  const uint8_t check[] = {
+    0x30, 0x03, 0x00, 0x01, 'a',
+    0x30, 0x03, 0x00, 0x01, 'b'
+  };
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, client.transport.writes[0].data(), 10);
+  TEST_ASSERT_EQUAL_UINT8('c', client.transport.writes[1][4]);
+}
+
+void test_coalesce_large_packet() {
+  TestClient client;
+  connectClient(client);
+
+  const uint8_t payload[20] = {0};
+  client.publish("a", 0, false, reinterpret_cast<const uint8_t*>(""), 0);
+  client.publish("b", 0, false, payload, sizeof(payload));
+  client.loop();
+
+  // gathered bytes are written before a packet that is too large to gather
+  TEST_ASSERT_TRUE(client.transport.writes.size() >= 2);
+  TEST_ASSERT_EQUAL_UINT32(5, client.transport.writes[0].size());
+  TEST_ASSERT_EQUAL_UINT8('a', client.transport.writes[0][4]);
+  size_t written = 0;
+  for (size_t i = 1; i < client.transport.writes.size(); ++i) {
+    written += client.transport.writes[i].size();
+  }
+  TEST_ASSERT_EQUAL_UINT32(1 + 1 + 3 + sizeof(payload), written);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_coalesce_small_packets);
+  RUN_TEST(test_coalesce_large_packet);
+  return UNITY_END();
+}
@@ -0,0 +1,133 @@
+#include <unity.h>
+
+#include <cstddef>  // std::max_align_t
+
+#include <MemoryPool.h>
+#include <Outbox.h>
+
+using espMqttClientInternals::MemoryPool;
+using espMqttClientInternals::Outbox;
+namespace PacketBuffer = espMqttClientInternals::PacketBuffer;
+using espMqttClientTypes::MemoryPoolStats;
+using espMqttClientTypes::PacketBufferSize;
+
+void setUp() {}
+void tearDown() {}
+
+void test_pool_allocate() {
+  MemoryPool pool(20, 3);
+  void* a = pool.allocate();
+  void* b = pool.allocate();
+  void* c = pool.allocate();
+  TEST_ASSERT_NOT_NULL(a);
+  TEST_ASSERT_NOT_NULL(b);
+  TEST_ASSERT_NOT_NULL(c);
+  TEST_ASSERT_TRUE(a != b && b != c && a != c);
+  TEST_ASSERT_TRUE(pool.owns(a));
+  TEST_ASSERT_TRUE(pool.owns(c));
+
+  // blocks keep the alignment of the platform
+  MemoryPoolStats stats = pool.stats();
+  TEST_ASSERT_EQUAL_UINT32(0, stats.blockSize % alignof(std::max_align_t));
+  TEST_ASSERT_TRUE(stats.blockSize >= 20);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.capacity);
+  TEST_ASSERT_EQUAL_UINT32(3, stats.used);
+  TEST_ASSERT_EQUAL_UINT32(0, stats.exhausted);
+}
+
+void test_pool_exhausted() {
+  MemoryPool pool(20, 2);
+  void* a = pool.allocate();
+  void* b = pool.allocate();
+  TEST_ASSERT_NULL(pool.allocate());
+  TEST_ASSERT_EQUAL_UINT32(1, pool.stats().exhausted);
+
+  // released blocks are reused
+  pool.release(a);
+  TEST_ASSERT_EQUAL_PTR(a, pool.allocate());
+  pool.release(a);
+  pool.release(b);
+
+  MemoryPoolStats stats = pool.stats();
+  TEST_ASSERT_EQUAL_UINT32(0, stats.used);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.peak);
+
+  int heap = 0;
+  TEST_ASSERT_FALSE(pool.owns(&heap));
+}
+
+void test_pool_empty() {
+  MemoryPool pool(20, 0);
+  TEST_ASSERT_NULL(pool.allocate());
+  TEST_ASSERT_EQUAL_UINT32(1, pool.stats().exhausted);
+}
+
+void test_outbox_pool() {
+  Outbox<uint32_t> outbox;
+  for (uint32_t i = 0; i < EMC_OUTBOX_POOL_SIZE + 2; ++i) {
+    outbox.emplace(i);
+  }
+
+  // nodes beyond the pool come from the heap
+  MemoryPoolStats stats = outbox.poolStats();
+  TEST_ASSERT_EQUAL_UINT32(EMC_OUTBOX_POOL_SIZE, stats.used);
+  TEST_ASSERT_EQUAL_UINT32(2, stats.exhausted);
+
+  uint32_t expected = 0;
+  while (outbox.getCurrent()) {
+    TEST_ASSERT_EQUAL_UINT32(expected, *(outbox.getCurrent()));
+    outbox.removeCurrent();
+    ++expected;
+  }
+  TEST_ASSERT_EQUAL_UINT32(EMC_OUTBOX_POOL_SIZE + 2, expected);
+  TEST_ASSERT_EQUAL_UINT32(0, outbox.poolStats().used);
+}
+
+void test_packet_buffer() {
+  uint8_t* small = PacketBuffer::allocate(4);
+  TEST_ASSERT_NOT_NULL(small);
+  TEST_ASSERT_EQUAL_UINT32(1, PacketBuffer::stats(PacketBufferSize::SMALL).used);
+
+  uint8_t* medium = PacketBuffer::allocate(EMC_POOL_SMALL_BLOCK_SIZE + 1);
+  TEST_ASSERT_NOT_NULL(medium);
+  TEST_ASSERT_EQUAL_UINT32(1, PacketBuffer::stats(PacketBufferSize::MEDIUM).used);
+
+  // too large for every size class
+  uint8_t* heap = PacketBuffer::allocate(4096);
+  TEST_ASSERT_NOT_NULL(heap);
+
+  PacketBuffer::release(small);
+  PacketBuffer::release(medium);
+  PacketBuffer::release(heap);
+  TEST_ASSERT_EQUAL_UINT32(0, PacketBuffer::stats(PacketBufferSize::SMALL).used);
+  TEST_ASSERT_EQUAL_UINT32(0, PacketBuffer::stats(PacketBufferSize::MEDIUM).used);
+}
+
+void test_packet_buffer_spill() {
+  // a full size class spills into the next larger one
+  uint8_t* buffers[EMC_POOL_SMALL_BLOCKS + 1];
+  for (size_t i = 0; i < EMC_POOL_SMALL_BLOCKS + 1; ++i) {
+    buffers[i] = PacketBuffer::allocate(4);
+    TEST_ASSERT_NOT_NULL(buffers[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(EMC_POOL_SMALL_BLOCKS, PacketBuffer::stats(PacketBufferSize::SMALL).used);
+  TEST_ASSERT_EQUAL_UINT32(1, PacketBuffer::stats(PacketBufferSize::MEDIUM).used);
+  TEST_ASSERT_EQUAL_UINT32(1, PacketBuffer::stats(PacketBufferSize::SMALL).exhausted);
+
+  for (size_t i = 0; i < EMC_POOL_SMALL_BLOCKS + 1; ++i) {
+    PacketBuffer::release(buffers[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, PacketBuffer::stats(PacketBufferSize::SMALL).used);
+  TEST_ASSERT_EQUAL_UINT32(0, PacketBuffer::stats(PacketBufferSize::MEDIUM).used);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pool_allocate);
+  RUN_TEST(test_pool_exhausted);
+  RUN_TEST(test_pool_empty);
+  RUN_TEST(test_outbox_pool);
+  RUN_TEST(test_packet_buffer);
+  RUN_TEST(test_packet_buffer_spill);
+  return UNITY_END();
+}
@@ -0,0 +1,86 @@
+#include <unity.h>
+
+#include "../FakeTransport.h"
+
+// MQTT 5 CONNACK allowing two topic aliases
+const std::vector<uint8_t> connackV5 = {0x20, 0x06, 0x01, 0x00, 0x03, 0x22, 0x00, 0x02};
+
+void setUp() {}
+void tearDown() {}
+
+void test_topicAlias() {
+  TestClient client;
+  client.setProtocolVersion(espMqttClientTypes::ProtocolVersion::V5);
+  client.transport.connack = connackV5;
+  connectClient(client);
+  TEST_ASSERT_EQUAL_UINT8(0x05, client.transport.connectPacket[8]);  // protocol level
+
+  client.publish("x/y", 0, false, "1");
+  client.publish("x/y", 0, false, "2");
+  client.publish("z", 0, false, "3");
+  client.publish("w", 0, false, "4");  // the server allows two aliases
+  client.loop();
+
+  const uint8_t check[] = {
+    0x30, 0x0A, 0x00, 0x03, 'x', '/', 'y', 0x03, 0x23, 0x00, 0x01, '1',  // topic and alias
+    0x30, 0x07, 0x00, 0x00, 0x03, 0x23, 0x00, 0x01, '2',                 // alias only
+    0x30, 0x08, 0x00, 0x01, 'z', 0x03, 0x23, 0x00, 0x02, '3',
+    0x30, 0x05, 0x00, 0x01, 'w', 0x00, '4'                                // no alias left
+  };
+  TEST_ASSERT_EQUAL_UINT32(sizeof(check), client.transport.sent.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, client.transport.sent.data(), sizeof(check));
+}
+
+void test_topicAliasReconnect() {
+  TestClient client;
+  client.setProtocolVersion(espMqttClientTypes::ProtocolVersion::V5);
+  client.transport.connack = connackV5;
+  connectClient(client);
+
+  // not acknowledged, both are sent again after reconnecting
+  client.publish("x/y", 1, false, "1");
+  client.publish("x/y", 1, false, "2");
+  client.loop();
+  TEST_ASSERT_EQUAL_UINT32(14 + 11, client.transport.sent.size());
+
+  client.transport.up = false;
+  for (int i = 0; i < 10 && !client.disconnected(); ++i) {
+    client.loop();
+  }
+  TEST_ASSERT_TRUE(client.disconnected());
+  client.transport.clear();
+  connectClient(client);
+  client.loop();
+
+  // the new connection has no aliases, the first packet sets it up again
+  const uint8_t check[] = {
+    0x3A, 0x0C, 0x00, 0x03, 'x', '/', 'y', 0x00, 0x01, 0x03, 0x23, 0x00, 0x01, '1',
+    0x3A, 0x09, 0x00, 0x00, 0x00, 0x02, 0x03, 0x23, 0x00, 0x01, '2'
+  };
+  TEST_ASSERT_EQUAL_UINT32(sizeof(check), client.transport.sent.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, client.transport.sent.data(), sizeof(check));
+}
+
+void test_messageExpiry() {
+  TestClient client;
+  client.setProtocolVersion(espMqttClientTypes::ProtocolVersion::V5);
+  client.transport.connack = connackV5;
+  connectClient(client);
+
+  client.publishLatest("z", 0, true, 60, "1");
+  client.loop();
+
+  const uint8_t check[] = {
+    0x31, 0x0D, 0x00, 0x01, 'z', 0x08, 0x02, 0x00, 0x00, 0x00, 0x3C, 0x23, 0x00, 0x01, '1'
+  };
+  TEST_ASSERT_EQUAL_UINT32(sizeof(check), client.transport.sent.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, client.transport.sent.data(), sizeof(check));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_topicAlias);
+  RUN_TEST(test_topicAliasReconnect);
+  RUN_TEST(test_messageExpiry);
+  return UNITY_END();
+}
@@ -479,6 +479,33 @@ void test_encodeMultiSubscribe3() {
   TEST_ASSERT_EQUAL_UINT16(packetId, packet.packetId());
 }
 
+void test_encodeListSubscribe() {
+  const uint8_t check[] = {
+    0b10000010,                 // header
+    0x0E,                       // remaining length
+    0x00,0x17,                  // packet Id
+    0x00, 0x03, 'a', '/', 'b',  // topic1
+    0x01,                       // qos1
+    0x00, 0x03, 'c', '/', '#',  // topic2
+    0x00                        // qos2
+  };
+  const uint32_t length = 16;
+  espMqttClientTypes::SubscribeItem list[] = {{"a/b", 1}, {"c/#", 0}};
+  uint16_t packetId = 23;
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  Packet packet(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, list, 2);
+
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+  TEST_ASSERT_EQUAL_UINT8(PacketType.SUBSCRIBE, packet.packetType());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, packet.data(0), length);
+  TEST_ASSERT_EQUAL_UINT16(packetId, packet.packetId());
+
+  Packet empty(error, espMqttClientTypes::ProtocolVersion::V3_1_1, packetId, list, 0);
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::MALFORMED_PARAMETER, error);
+}
+
 void test_encodeUnsubscribe() {
   const uint8_t check[] = {
     0b10100010,                 // header
@@ -688,6 +715,245 @@ void test_encodeChunkedPublish() {
   TEST_ASSERT_EQUAL_UINT8_ARRAY(payloadChunk, packet.data(index), available);
 }
 
+void test_encodeSharedPublish() {
+  const uint8_t check[] = {
+    0b00110011,                 // header, dup, qos, retain
+    0x0B,
+    0x00,0x03,'t','o','p',      // topic
+    0x00,0x16                   // packet Id
+  };
+  const uint8_t payloadData[] = {0x01, 0x02, 0x03, 0x04};
+  size_t headerLength = 9;
+  size_t length = 13;
+  const char* topic = "top";
+  uint8_t qos = 1;
+  bool retain = true;
+  uint16_t packetId = 22;
+  bool released = false;
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  espMqttClientTypes::SharedPayload* payload = espMqttClientTypes::SharedPayload::borrow(payloadData, 4, [&released](const uint8_t* data, size_t length) {
+    (void) data;
+    (void) length;
+    released = true;
+  });
+  TEST_ASSERT_NOT_NULL(payload);
+
+  {
+    Packet packet(error,
+                  packetId,
+                  topic,
+                  payload,
+                  qos,
+                  retain);
+
+    TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+    TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+    TEST_ASSERT_EQUAL_UINT16(packetId, packet.packetId());
+    TEST_ASSERT_EQUAL_UINT16(2, payload->references());
+
+    // header and payload are separate segments, the payload isn't copied
+    TEST_ASSERT_EQUAL_UINT32(headerLength, packet.available(0));
+    TEST_ASSERT_EQUAL_UINT8_ARRAY(check, packet.data(0), headerLength);
+    TEST_ASSERT_EQUAL_UINT32(headerLength - 2, packet.available(2));
+    TEST_ASSERT_EQUAL_UINT32(4, packet.available(headerLength));
+    TEST_ASSERT_EQUAL_PTR(payloadData, packet.data(headerLength));
+    TEST_ASSERT_EQUAL_UINT32(1, packet.available(length - 1));
+    TEST_ASSERT_EQUAL_PTR(&payloadData[3], packet.data(length - 1));
+    TEST_ASSERT_EQUAL_UINT32(0, packet.available(length));
+
+    packet.setDup();
+    TEST_ASSERT_EQUAL_UINT8(0b00111011, packet.data(0)[0]);
+
+    payload->release();
+    TEST_ASSERT_FALSE(released);
+  }
+
+  // the packet held the last reference
+  TEST_ASSERT_TRUE(released);
+}
+
+void test_sharedPayloadCreate() {
+  espMqttClientTypes::SharedPayload* payload = espMqttClientTypes::SharedPayload::create(200);
+  TEST_ASSERT_NOT_NULL(payload);
+  TEST_ASSERT_EQUAL_UINT32(200, payload->length());
+  memset(payload->data(), 0x05, payload->length());
+  payload->setLength(150);
+  TEST_ASSERT_EQUAL_UINT32(150, payload->length());
+  payload->setLength(300);
+  TEST_ASSERT_EQUAL_UINT32(150, payload->length());
+
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+  Packet* packet = new Packet(error, 0, "top", payload, 0, false);
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  TEST_ASSERT_EQUAL_UINT16(0, packet->packetId());
+  TEST_ASSERT_TRUE(packet->removable());
+  // remaining length 155 takes two bytes
+  TEST_ASSERT_EQUAL_UINT32(8 + 150, packet->size());
+  TEST_ASSERT_EQUAL_UINT32(8, packet->available(0));
+  TEST_ASSERT_EQUAL_UINT32(150, packet->available(8));
+  TEST_ASSERT_EQUAL_UINT8(0x05, packet->data(8 + 149)[0]);
+
+  payload->release();
+  TEST_ASSERT_EQUAL_UINT16(1, payload->references());
+  delete packet;
+}
+
+void test_encodeConnect5() {
+  const uint8_t check[] = {
+    0b00010000,                 // header
+    0x15,                       // remaining length
+    0x00,0x04,'M','Q','T','T',  // protocol
+    0b00000101,                 // protocol level
+    0b00000000,                 // connect flags
+    0x00,0x10,                  // keepalive (16)
+    0x05,                       // properties length
+    0x11,0xFF,0xFF,0xFF,0xFF,   // session expiry interval
+    0x00,0x03,'c','l','i'       // client id
+  };
+  const size_t length = sizeof(check);
+
+  bool cleanSession = false;  // the session doesn't expire
+  const char* username = nullptr;
+  const char* password = nullptr;
+  const char* willTopic = nullptr;
+  bool willRemain = false;
+  uint8_t willQoS = 0;
+  const uint8_t* willPayload = nullptr;
+  uint16_t willPayloadLength = 0;
+  uint16_t keepalive = 16;
+  const char* clientId = "cli";
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  Packet packet(error,
+                espMqttClientTypes::ProtocolVersion::V5,
+                cleanSession,
+                username,
+                password,
+                willTopic,
+                willRemain,
+                willQoS,
+                willPayload,
+                willPayloadLength,
+                keepalive,
+                clientId);
+
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, packet.data(0), length);
+}
+
+void test_encodePublish5() {
+  const uint8_t check[] = {
+    0b00110010,                 // header, dup, qos, retain
+    0x0C,
+    0x00,0x01,'t',              // topic
+    0x00,0x16,                  // packet Id
+    0x05,                       // properties length
+    0x02,0x00,0x00,0x0E,0x10,   // message expiry interval (3600)
+    0x01                        // payload
+  };
+  const size_t length = sizeof(check);
+  const uint8_t payload[] = {0x01};
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  Packet packet(error, espMqttClientTypes::ProtocolVersion::V5, 3600, 22, "t", payload, 1, 1, false);
+
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, packet.data(0), length);
+
+  // no expiry: empty properties
+  Packet packet2(error, espMqttClientTypes::ProtocolVersion::V5, 0, 22, "t", payload, 1, 1, false);
+  TEST_ASSERT_EQUAL_UINT32(length - 5, packet2.size());
+  TEST_ASSERT_EQUAL_UINT8(0x07, packet2.data(0)[1]);
+  TEST_ASSERT_EQUAL_UINT8(0x00, packet2.data(0)[7]);
+}
+
+void test_encodeSubscribe5() {
+  const uint8_t check[] = {
+    0b10000010,                 // header
+    0x09,                       // remaining length
+    0x00,0x0A,                  // packet id
+    0x00,                       // properties length
+    0x00,0x03,'a','/','b',      // topic
+    0x01                        // qos
+  };
+  const size_t length = sizeof(check);
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  Packet packet(error, espMqttClientTypes::ProtocolVersion::V5, 10, "a/b", 1);
+
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(check, packet.data(0), length);
+}
+
+// collects a packet the way the client writes it
+static size_t readPacket(Packet* packet, uint8_t* buffer) {
+  size_t index = 0;
+  size_t available = 0;
+  while ((available = packet->available(index)) > 0) {
+    memcpy(&buffer[index], packet->data(index), available);
+    index += available;
+  }
+  return index;
+}
+
+void test_topicAlias5() {
+  const uint8_t checkAliasOnly[] = {
+    0b00110010,                 // header, dup, qos, retain
+    0x0F,
+    0x00,0x00,                  // empty topic
+    0x00,0x16,                  // packet Id
+    0x08,                       // properties length
+    0x02,0x00,0x00,0x0E,0x10,   // message expiry interval (3600)
+    0x23,0x00,0x01,             // topic alias
+    0x01,0x02                   // payload
+  };
+  const uint8_t checkAliasTopic[] = {
+    0b00110010,                 // header, dup, qos, retain
+    0x12,
+    0x00,0x03,'t','o','p',      // topic
+    0x00,0x16,                  // packet Id
+    0x08,                       // properties length
+    0x02,0x00,0x00,0x0E,0x10,   // message expiry interval (3600)
+    0x23,0x00,0x02,             // topic alias
+    0x01,0x02                   // payload
+  };
+  const uint8_t payloadData[] = {0x01, 0x02};
+  uint8_t buffer[32];
+  espMqttClientTypes::Error error = espMqttClientTypes::Error::MISC_ERROR;
+
+  espMqttClientTypes::SharedPayload* payload = espMqttClientTypes::SharedPayload::borrow(payloadData, 2);
+  Packet packet(error, espMqttClientTypes::ProtocolVersion::V5, 3600, 22, "top", payload, 1, false);
+  payload->release();
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientTypes::Error::SUCCESS, error);
+  size_t length = packet.size();
+
+  TEST_ASSERT_TRUE(packet.setTopicAlias(1, true));
+  TEST_ASSERT_EQUAL_UINT16(1, packet.topicAlias());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(checkAliasOnly), packet.size());
+  TEST_ASSERT_EQUAL_UINT32(sizeof(checkAliasOnly), readPacket(&packet, buffer));
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(checkAliasOnly, buffer, sizeof(checkAliasOnly));
+
+  packet.setDup();
+  TEST_ASSERT_TRUE(packet.setTopicAlias(2, false));
+  TEST_ASSERT_EQUAL_UINT32(sizeof(checkAliasTopic), readPacket(&packet, buffer));
+  TEST_ASSERT_EQUAL_UINT8(0b00111010, buffer[0]);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(&checkAliasTopic[1], &buffer[1], sizeof(checkAliasTopic) - 1);
+
+  // back to the packet as it was built
+  packet.clearTopicAlias();
+  TEST_ASSERT_EQUAL_UINT16(0, packet.topicAlias());
+  TEST_ASSERT_EQUAL_UINT32(length, packet.size());
+  TEST_ASSERT_TRUE(packet.hasTopic("top", 3));
+
+  // MQTT 3.1.1 has no aliases
+  Packet packet311(error, 22, "top", payloadData, 2, 1, false);
+  TEST_ASSERT_FALSE(packet311.setTopicAlias(1, true));
+}
+
 int main() {
   UNITY_BEGIN();
   RUN_TEST(test_encodeConnect0);
@@ -704,11 +970,18 @@ int main() {
   RUN_TEST(test_encodeSubscribe);
   RUN_TEST(test_encodeMultiSubscribe2);
   RUN_TEST(test_encodeMultiSubscribe3);
+  RUN_TEST(test_encodeListSubscribe);
   RUN_TEST(test_encodeUnsubscribe);
   RUN_TEST(test_encodeMultiUnsubscribe2);
   RUN_TEST(test_encodeMultiUnsubscribe3);
   RUN_TEST(test_encodePingReq);
   RUN_TEST(test_encodeDisconnect);
   RUN_TEST(test_encodeChunkedPublish);
+  RUN_TEST(test_encodeSharedPublish);
+  RUN_TEST(test_sharedPayloadCreate);
+  RUN_TEST(test_encodeConnect5);
+  RUN_TEST(test_encodePublish5);
+  RUN_TEST(test_encodeSubscribe5);
+  RUN_TEST(test_topicAlias5);
   return UNITY_END();
 }
@@ -336,6 +336,178 @@ void test_longStream() {
   TEST_ASSERT_FALSE(parser.getPacket().dup());
 }
 
+Parser parser5;
+
+void test_Connack5() {
+  const uint8_t stream[] = {
+    0x20,                           // header
+    0x13,                           // remaining length
+    0x00,                           // session present
+    0x00,                           // reason code
+    0x10,                           // properties length
+    0x22, 0x00, 0x0A,               // topic alias maximum
+    0x1F, 0x00, 0x03, 'a', 'b', 'c',  // reason string
+    0x26, 0x00, 0x01, 'k', 0x00, 0x01, 'v'  // user property
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT8(0, parser5.getPacket().variableHeader.fixed.connackVarHeader.returnCode);
+  TEST_ASSERT_EQUAL_UINT16(10, parser5.getPacket().properties.topicAliasMaximum);
+}
+
+void test_ConnackRefused5() {
+  const uint8_t stream[] = {
+    0x20,
+    0x03,
+    0x00,
+    0x87,  // not authorized
+    0x00
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT8(0x87, parser5.getPacket().variableHeader.reasonCode);
+  TEST_ASSERT_EQUAL_UINT8(5, parser5.getPacket().variableHeader.fixed.connackVarHeader.returnCode);
+}
+
+void test_Publish5() {
+  const uint8_t stream[] = {
+    0x32,                           // header
+    0x0F,                           // remaining length
+    0x00, 0x03, 'a', '/', 'b',      // topic
+    0x00, 0x0A,                     // packet id
+    0x05,                           // properties length
+    0x02, 0x00, 0x00, 0x0E, 0x10,   // message expiry interval (3600)
+    0x01, 0x02                      // payload
+  };
+  const size_t length = sizeof(stream);
+
+  // split inside the properties
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, 10, &bytesRead);
+  TEST_ASSERT_EQUAL_INT32(ParserResult::awaitData, result);
+  result = parser5.parse(&stream[bytesRead], length - bytesRead, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_STRING("a/b", parser5.getPacket().variableHeader.topic);
+  TEST_ASSERT_EQUAL_UINT16(10, parser5.getPacket().variableHeader.fixed.packetId);
+  TEST_ASSERT_EQUAL_UINT32(3600, parser5.getPacket().properties.messageExpiry);
+  TEST_ASSERT_EQUAL_UINT32(2, parser5.getPacket().payload.total);
+  TEST_ASSERT_EQUAL_UINT32(2, parser5.getPacket().payload.length);
+  TEST_ASSERT_EQUAL_UINT8_ARRAY(&stream[15], parser5.getPacket().payload.data, 2);
+}
+
+void test_PubAck5() {
+  const uint8_t stream[] = {
+    0x40, 0x02, 0x00, 0x0A,        // success, reason code omitted
+    0x40, 0x04, 0x00, 0x0B, 0x10, 0x00  // no matching subscribers, no properties
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(4, bytesRead);
+  TEST_ASSERT_EQUAL_UINT16(10, parser5.getPacket().variableHeader.fixed.packetId);
+
+  result = parser5.parse(&stream[bytesRead], length - bytesRead, &bytesRead);
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT16(11, parser5.getPacket().variableHeader.fixed.packetId);
+  TEST_ASSERT_EQUAL_UINT8(0x10, parser5.getPacket().variableHeader.reasonCode);
+}
+
+void test_SubAck5() {
+  const uint8_t stream[] = {
+    0x90,
+    0x05,
+    0x00, 0x0A,  // packet id
+    0x00,        // properties length
+    0x01,        // granted QoS 1
+    0x97         // quota exceeded
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT16(10, parser5.getPacket().variableHeader.fixed.packetId);
+  TEST_ASSERT_EQUAL_UINT32(2, parser5.getPacket().payload.length);
+  TEST_ASSERT_EQUAL_UINT8(0x01, parser5.getPacket().payload.data[0]);
+  TEST_ASSERT_EQUAL_UINT8(0x80, parser5.getPacket().payload.data[1]);
+}
+
+void test_UnsubAck5() {
+  const uint8_t stream[] = {
+    0xB0,
+    0x04,
+    0x00, 0x0A,  // packet id
+    0x00,        // properties length
+    0x11         // no subscription existed
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT16(10, parser5.getPacket().variableHeader.fixed.packetId);
+}
+
+void test_Disconnect5() {
+  const uint8_t stream[] = {
+    0xE0,
+    0x01,
+    0x8E  // session taken over
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::packet, result);
+  TEST_ASSERT_EQUAL_UINT32(length, bytesRead);
+  TEST_ASSERT_EQUAL_UINT8(espMqttClientInternals::PacketType.DISCONNECT, parser5.getPacket().fixedHeader.packetType & 0xF0);
+  TEST_ASSERT_EQUAL_UINT8(0x8E, parser5.getPacket().variableHeader.reasonCode);
+
+  // not sent by MQTT 3.1.1 servers
+  bytesRead = 0;
+  result = parser.parse(stream, length, &bytesRead);
+  TEST_ASSERT_EQUAL_INT32(ParserResult::protocolError, result);
+}
+
+void test_InvalidProperty5() {
+  const uint8_t stream[] = {
+    0x20,
+    0x05,
+    0x00,
+    0x00,
+    0x02,        // properties length
+    0x7F, 0x00   // unknown property
+  };
+  const size_t length = sizeof(stream);
+
+  size_t bytesRead = 0;
+  ParserResult result = parser5.parse(stream, length, &bytesRead);
+
+  TEST_ASSERT_EQUAL_INT32(ParserResult::protocolError, result);
+  TEST_ASSERT_EQUAL_UINT32(6, bytesRead);
+  parser5.reset();
+}
+
 int main() {
   UNITY_BEGIN();
   RUN_TEST(test_Connack);
@@ -351,5 +523,14 @@ int main() {
   RUN_TEST(test_UnsubAck);
   RUN_TEST(test_PingResp);
   RUN_TEST(test_longStream);
+  parser5.setProtocolVersion(espMqttClientTypes::ProtocolVersion::V5);
+  RUN_TEST(test_Connack5);
+  RUN_TEST(test_ConnackRefused5);
+  RUN_TEST(test_Publish5);
+  RUN_TEST(test_PubAck5);
+  RUN_TEST(test_SubAck5);
+  RUN_TEST(test_UnsubAck5);
+  RUN_TEST(test_Disconnect5);
+  RUN_TEST(test_InvalidProperty5);
   return UNITY_END();
 }
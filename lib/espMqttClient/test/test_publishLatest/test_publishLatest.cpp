@@ -0,0 +1,85 @@
+#include <unity.h>
+
+#include "../FakeTransport.h"
+
+void setUp() {}
+void tearDown() {}
+
+size_t countPublishes(const TestClient& client, char topic, char value) {
+  size_t count = 0;
+  for (const std::vector<uint8_t>& write : client.transport.writes) {
+    // QoS 0, one character topic and payload: 6 bytes each
+    for (size_t i = 0; i + 6 <= write.size(); i += 6) {
+      if (write[i] == 0x30 && write[i + 4] == topic && write[i + 5] == value) ++count;
+    }
+  }
+  return count;
+}
+
+void test_publishLatest_replaces_unsent() {
+  TestClient client;
+  connectClient(client);
+
+  client.transport.blocked = true;
+  TEST_ASSERT_EQUAL_UINT16(1, client.publishLatest("a", 0, false, "1"));
+  TEST_ASSERT_EQUAL_UINT16(1, client.publishLatest("a", 0, false, "2"));
+  TEST_ASSERT_EQUAL_UINT16(1, client.publish("b", 0, false, "1"));
+  TEST_ASSERT_EQUAL_UINT16(1, client.publish("b", 0, false, "2"));
+  TEST_ASSERT_EQUAL_UINT16(1, client.publishLatest("a", 0, false, "3"));
+  client.loop();
+  TEST_ASSERT_EQUAL_UINT32(0, client.transport.writes.size());
+
+  client.transport.blocked = false;
+  client.loop();
+
+  // only the latest "a" is left, plain publishes are all kept
+  TEST_ASSERT_EQUAL_UINT32(0, countPublishes(client, 'a', '1'));
+  TEST_ASSERT_EQUAL_UINT32(0, countPublishes(client, 'a', '2'));
+  TEST_ASSERT_EQUAL_UINT32(1, countPublishes(client, 'a', '3'));
+  TEST_ASSERT_EQUAL_UINT32(1, countPublishes(client, 'b', '1'));
+  TEST_ASSERT_EQUAL_UINT32(1, countPublishes(client, 'b', '2'));
+}
+
+void test_publishLatest_replaces_plain() {
+  TestClient client;
+  connectClient(client);
+
+  client.transport.blocked = true;
+  client.publish("a", 0, false, "1");
+  client.publish("ab", 0, false, "1");
+  client.publishLatest("a", 0, false, "2");
+  client.transport.blocked = false;
+  client.loop();
+
+  TEST_ASSERT_EQUAL_UINT32(0, countPublishes(client, 'a', '1'));
+  TEST_ASSERT_EQUAL_UINT32(1, countPublishes(client, 'a', '2'));
+  // a longer topic with the same start is another topic
+  size_t written = 0;
+  for (const std::vector<uint8_t>& write : client.transport.writes) {
+    written += write.size();
+  }
+  TEST_ASSERT_EQUAL_UINT32(6 + 7, written);
+}
+
+void test_publishLatest_keeps_sent() {
+  TestClient client;
+  connectClient(client);
+
+  // sent, waiting for PUBACK
+  uint16_t first = client.publishLatest("a", 1, false, "1");
+  client.loop();
+  TEST_ASSERT_EQUAL_UINT32(1, client.transport.writes.size());
+
+  uint16_t second = client.publishLatest("a", 1, false, "2");
+  TEST_ASSERT_TRUE(second > first);
+  client.loop();
+  TEST_ASSERT_EQUAL_UINT32(2, client.transport.writes.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_publishLatest_replaces_unsent);
+  RUN_TEST(test_publishLatest_replaces_plain);
+  RUN_TEST(test_publishLatest_keeps_sent);
+  return UNITY_END();
+}
@@ -4,6 +4,8 @@
 #include <RTOS.h>
 #include "PreferencesKeys.h"
 #include "PresenceDetection.h"
+#include "SensorDecoder.h"
+#include "CrowdCounter.h"
 #include "hardware/W5500EthServer.h"
 #include "hardware/WifiEthServer.h"
 #include "Gpio.h"
@@ -13,6 +15,9 @@ Network* network = nullptr;
 Gpio* gpio = nullptr;
 WebCfgServer* webCfgServer = nullptr;
 BleScanner::Scanner* bleScanner = nullptr;
+BeaconDecoder* beaconDecoder = nullptr;
+SensorDecoder* sensorDecoder = nullptr;
+CrowdCounter* crowdCounter = nullptr;
 PresenceDetection* presenceDetection = nullptr;
 Preferences* preferences = nullptr;
 EthServer* ethServer = nullptr;
@@ -32,6 +37,14 @@ void networkTask(void *pvParameters)
             case 1:
                 network->update();
                 webCfgServer->update();
+                if(sensorDecoder != nullptr)
+                {
+                    sensorDecoder->update();
+                }
+                if(crowdCounter != nullptr)
+                {
+                    crowdCounter->update();
+                }
                 break;
                 // Neither Network Devicce or MQTT is connected
             default:
@@ -82,7 +95,7 @@ void setupTasks()
 
     xTaskCreatePinnedToCore(networkTask, "ntw", 8192, NULL, 3, NULL, 1);
     xTaskCreatePinnedToCore(bleScannerTask, "scan", 4096, NULL, 2, NULL, 1);
-    xTaskCreatePinnedToCore(presenceDetectionTask, "prdet", 1024, NULL, 5, NULL, 1);
+    xTaskCreatePinnedToCore(presenceDetectionTask, "prdet", 2048, NULL, 5, NULL, 1);
     xTaskCreatePinnedToCore(checkMillisTask, "mlchk", 768, NULL, 1, NULL, 1);
 }
 
@@ -151,7 +164,33 @@ void setup()
     webCfgServer = new WebCfgServer(network, ethServer, preferences, networkDevice == NetworkDeviceType::WiFi);
     webCfgServer->initialize();
 
-    presenceDetection = new PresenceDetection(preferences, bleScanner, network);
+    beaconDecoder = new BeaconDecoder(bleScanner);
+
+    if(preferences->getBool(preference_sensors_enabled))
+    {
+        sensorDecoder = new SensorDecoder(beaconDecoder, network);
+    }
+
+    if(preferences->getBool(preference_crowd_enabled))
+    {
+        int nearRssi = preferences->getInt(preference_crowd_near_rssi);
+        if(nearRssi == 0)
+        {
+            nearRssi = -70;
+            preferences->putInt(preference_crowd_near_rssi, nearRssi);
+        }
+
+        int publishInterval = preferences->getInt(preference_crowd_publish_interval);
+        if(publishInterval <= 0)
+        {
+            publishInterval = 60;
+            preferences->putInt(preference_crowd_publish_interval, publishInterval);
+        }
+
+        crowdCounter = new CrowdCounter(beaconDecoder, network, nearRssi, publishInterval * 1000);
+    }
+
+    presenceDetection = new PresenceDetection(preferences, beaconDecoder, network, gpio);
     presenceDetection->initialize();
 
     setupTasks();
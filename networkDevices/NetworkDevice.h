@@ -34,9 +34,18 @@ public:
 
     virtual void mqttSetClientId(const char* clientId) = 0;
     virtual void mqttSetCleanSession(bool cleanSession) = 0;
+    virtual void mqttSetProtocolVersion(espMqttClientTypes::ProtocolVersion version) = 0;
     virtual uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, const char* payload) = 0;
     virtual uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length) = 0;
+    virtual uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) = 0;
+    // Replaces messages on the same topic that are still queued, for state where only the latest value matters
+    virtual uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, const char* payload) = 0;
+    virtual uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) = 0;
+    // messageExpiry in seconds, the broker drops the message afterwards. Ignored by MQTT 3.1.1
+    virtual uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload) = 0;
     virtual bool mqttConnected() const = 0;
+    // Bytes queued in the MQTT client, including messages waiting for their acknowledgement
+    virtual size_t mqttOutboxBytes() = 0;
     virtual void mqttSetServer(const char* host, uint16_t port) = 0;
     virtual bool mqttConnect() = 0;
     virtual bool mqttDisonnect(bool force) = 0;
@@ -45,9 +54,12 @@ public:
     virtual void mqttOnMessage(espMqttClientTypes::OnMessageCallback callback) = 0;
     virtual void mqttOnConnect(espMqttClientTypes::OnConnectCallback callback) = 0;
     virtual void mqttOnDisconnect(espMqttClientTypes::OnDisconnectCallback callback) = 0;
+    virtual void mqttOnSubscribe(espMqttClientTypes::OnSubscribeCallback callback) = 0;
     virtual void disableMqtt() = 0;
 
     virtual uint16_t mqttSubscribe(const char* topic, uint8_t qos) = 0;
+    // All filters in one SUBSCRIBE, at most EMC_PAYLOAD_BUFFER_SIZE - 1
+    virtual uint16_t mqttSubscribe(const espMqttClientTypes::SubscribeItem* list, size_t count) = 0;
 
 protected:
     const uint16_t _mqttMaxBufferSize = 6144;
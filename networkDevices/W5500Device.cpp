@@ -230,6 +230,11 @@ void W5500Device::mqttSetCleanSession(bool cleanSession)
     _mqttClient.setCleanSession(cleanSession);
 }
 
+void W5500Device::mqttSetProtocolVersion(espMqttClientTypes::ProtocolVersion version)
+{
+    _mqttClient.setProtocolVersion(version);
+}
+
 uint16_t W5500Device::mqttPublish(const char *topic, uint8_t qos, bool retain, const char *payload)
 {
     return _mqttClient.publish(topic, qos, retain, payload);
@@ -240,6 +245,11 @@ bool W5500Device::mqttConnected() const
     return _mqttClient.connected();
 }
 
+size_t W5500Device::mqttOutboxBytes()
+{
+    return _mqttClient.getOutboxBytes();
+}
+
 void W5500Device::mqttSetServer(const char *host, uint16_t port)
 {
     _mqttClient.setServer(host, port);
@@ -280,16 +290,46 @@ void W5500Device::mqttOnDisconnect(espMqttClientTypes::OnDisconnectCallback call
     _mqttClient.onDisconnect(callback);
 }
 
+void W5500Device::mqttOnSubscribe(espMqttClientTypes::OnSubscribeCallback callback)
+{
+    _mqttClient.onSubscribe(callback);
+}
+
 uint16_t W5500Device::mqttSubscribe(const char *topic, uint8_t qos)
 {
     return _mqttClient.subscribe(topic, qos);
 }
 
+uint16_t W5500Device::mqttSubscribe(const espMqttClientTypes::SubscribeItem *list, size_t count)
+{
+    return _mqttClient.subscribe(list, count);
+}
+
 uint16_t W5500Device::mqttPublish(const char *topic, uint8_t qos, bool retain, const uint8_t *payload, size_t length)
 {
     return _mqttClient.publish(topic, qos, retain, payload, length);
 }
 
+uint16_t W5500Device::mqttPublish(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload)
+{
+    return _mqttClient.publish(topic, qos, retain, payload);
+}
+
+uint16_t W5500Device::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, const char *payload)
+{
+    return _mqttClient.publishLatest(topic, qos, retain, payload);
+}
+
+uint16_t W5500Device::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload)
+{
+    return _mqttClient.publishLatest(topic, qos, retain, payload);
+}
+
+uint16_t W5500Device::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload)
+{
+    return _mqttClient.publishLatest(topic, qos, retain, messageExpiry, payload);
+}
+
 void W5500Device::disableMqtt()
 {
     _mqttClient.disconnect();
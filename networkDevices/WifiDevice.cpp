@@ -191,6 +191,18 @@ void WifiDevice::mqttSetCleanSession(bool cleanSession)
     }
 }
 
+void WifiDevice::mqttSetProtocolVersion(espMqttClientTypes::ProtocolVersion version)
+{
+    if(_useEncryption)
+    {
+        _mqttClientSecure->setProtocolVersion(version);
+    }
+    else
+    {
+        _mqttClient->setProtocolVersion(version);
+    }
+}
+
 uint16_t WifiDevice::mqttPublish(const char *topic, uint8_t qos, bool retain, const char *payload)
 {
     if(_useEncryption)
@@ -203,6 +215,42 @@ uint16_t WifiDevice::mqttPublish(const char *topic, uint8_t qos, bool retain, co
     }
 }
 
+uint16_t WifiDevice::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, const char *payload)
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->publishLatest(topic, qos, retain, payload);
+    }
+    else
+    {
+        return _mqttClient->publishLatest(topic, qos, retain, payload);
+    }
+}
+
+uint16_t WifiDevice::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload)
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->publishLatest(topic, qos, retain, payload);
+    }
+    else
+    {
+        return _mqttClient->publishLatest(topic, qos, retain, payload);
+    }
+}
+
+uint16_t WifiDevice::mqttPublishLatest(const char *topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload)
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->publishLatest(topic, qos, retain, messageExpiry, payload);
+    }
+    else
+    {
+        return _mqttClient->publishLatest(topic, qos, retain, messageExpiry, payload);
+    }
+}
+
 uint16_t WifiDevice::mqttPublish(const char *topic, uint8_t qos, bool retain, const uint8_t *payload, size_t length)
 {
     if(_useEncryption)
@@ -215,6 +263,18 @@ uint16_t WifiDevice::mqttPublish(const char *topic, uint8_t qos, bool retain, co
     }
 }
 
+uint16_t WifiDevice::mqttPublish(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload)
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->publish(topic, qos, retain, payload);
+    }
+    else
+    {
+        return _mqttClient->publish(topic, qos, retain, payload);
+    }
+}
+
 bool WifiDevice::mqttConnected() const
 {
     if(_useEncryption)
@@ -227,6 +287,18 @@ bool WifiDevice::mqttConnected() const
     }
 }
 
+size_t WifiDevice::mqttOutboxBytes()
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->getOutboxBytes();
+    }
+    else
+    {
+        return _mqttClient->getOutboxBytes();
+    }
+}
+
 void WifiDevice::mqttSetServer(const char *host, uint16_t port)
 {
     if(_useEncryption)
@@ -324,6 +396,18 @@ void WifiDevice::mqttOnDisconnect(espMqttClientTypes::OnDisconnectCallback callb
     }
 }
 
+void WifiDevice::mqttOnSubscribe(espMqttClientTypes::OnSubscribeCallback callback)
+{
+    if(_useEncryption)
+    {
+        _mqttClientSecure->onSubscribe(callback);
+    }
+    else
+    {
+        _mqttClient->onSubscribe(callback);
+    }
+}
+
 
 uint16_t WifiDevice::mqttSubscribe(const char *topic, uint8_t qos)
 {
@@ -337,6 +421,18 @@ uint16_t WifiDevice::mqttSubscribe(const char *topic, uint8_t qos)
     }
 }
 
+uint16_t WifiDevice::mqttSubscribe(const espMqttClientTypes::SubscribeItem *list, size_t count)
+{
+    if(_useEncryption)
+    {
+        return _mqttClientSecure->subscribe(list, count);
+    }
+    else
+    {
+        return _mqttClient->subscribe(list, count);
+    }
+}
+
 void WifiDevice::disableMqtt()
 {
     if (_useEncryption)
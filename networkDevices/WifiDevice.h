@@ -31,12 +31,25 @@ public:
 
     void mqttSetCleanSession(bool cleanSession) override;
 
+    void mqttSetProtocolVersion(espMqttClientTypes::ProtocolVersion version) override;
+
     uint16_t mqttPublish(const char *topic, uint8_t qos, bool retain, const char *payload) override;
 
     uint16_t mqttPublish(const char *topic, uint8_t qos, bool retain, const uint8_t *payload, size_t length) override;
 
+
+    uint16_t mqttPublish(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) override;
+
+    uint16_t mqttPublishLatest(const char *topic, uint8_t qos, bool retain, const char *payload) override;
+
+    uint16_t mqttPublishLatest(const char *topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) override;
+
+    uint16_t mqttPublishLatest(const char *topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload) override;
+
     bool mqttConnected() const override;
 
+    size_t mqttOutboxBytes() override;
+
     void mqttSetServer(const char *host, uint16_t port) override;
 
     bool mqttConnect() override;
@@ -53,8 +66,12 @@ public:
 
     void mqttOnDisconnect(espMqttClientTypes::OnDisconnectCallback callback) override;
 
+    void mqttOnSubscribe(espMqttClientTypes::OnSubscribeCallback callback) override;
+
     uint16_t mqttSubscribe(const char *topic, uint8_t qos) override;
 
+    uint16_t mqttSubscribe(const espMqttClientTypes::SubscribeItem *list, size_t count) override;
+
     void disableMqtt() override;
 
 private:
@@ -0,0 +1,78 @@
+#!/usr/bin/env python3
+"""
+Merges the crowd count sketches of several blescanner nodes into one site-wide count.
+
+Each node publishes <prefix>/crowd/<minute|hour|day>/<all|near>/sketch as a retained hex string with
+every tenth set of estimates:
+version (1 byte), precision p (1 byte), 2^p HyperLogLog registers (1 byte each). A device seen by
+several nodes sets the same register on each of them, so the register-wise maximum counts it once.
+Only sketches of the same window and tier should be merged.
+
+Usage: crowd_merge.py <sketch or file>...   (reads one sketch per line from stdin without arguments)
+"""
+
+import math
+import os
+import sys
+
+SKETCH_VERSION = 1
+
+
+def parse_sketch(text):
+    data = bytes.fromhex(text.strip())
+    if len(data) < 2 or data[0] != SKETCH_VERSION:
+        raise ValueError("Unsupported sketch version")
+    precision = data[1]
+    registers = list(data[2:])
+    if len(registers) != 1 << precision:
+        raise ValueError("Expected %d registers, got %d" % (1 << precision, len(registers)))
+    return precision, registers
+
+
+def merge(sketches):
+    precisions = {precision for precision, _ in sketches}
+    if len(precisions) != 1:
+        raise ValueError("Sketches with different precision can't be merged")
+    registers = [max(values) for values in zip(*(registers for _, registers in sketches))]
+    return precisions.pop(), registers
+
+
+def estimate(registers):
+    """Same estimator as DistinctSketch::estimate() in the firmware."""
+    m = float(len(registers))
+    alpha = 0.7213 / (1.0 + 1.079 / m)
+    raw = alpha * m * m / sum(2.0 ** -r for r in registers)
+    zeros = registers.count(0)
+    if raw <= 2.5 * m and zeros > 0:
+        return m * math.log(m / zeros)
+    return raw
+
+
+def _read_sketches(arguments):
+    if not arguments:
+        return [line for line in sys.stdin if line.strip()]
+    texts = []
+    for argument in arguments:
+        if os.path.isfile(argument):
+            with open(argument) as f:
+                texts.extend(line for line in f if line.strip())
+        else:
+            texts.append(argument)
+    return texts
+
+
+def main():
+    texts = _read_sketches(sys.argv[1:])
+    if not texts:
+        print(__doc__)
+        return 1
+    sketches = [parse_sketch(text) for text in texts]
+    for i, (_, registers) in enumerate(sketches):
+        print("node %d: %d" % (i + 1, round(estimate(registers))))
+    _, merged = merge(sketches)
+    print("site: %d" % round(estimate(merged)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Generates DeviceClassTables.h from the CSV files in tools/device_classes.
+
+Each table is written as an array sorted by key, so DeviceClassifier can binary search it in flash.
+Vendor ids are the position in the sorted list of vendor names (0 = unknown). presence_decoder.py
+uses load_vendor_names() to map the ids in CBOR reports back to names.
+
+Usage: device_classes.py [output header]
+"""
+
+import csv
+import os
+import sys
+
+DATA_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), "device_classes")
+DEFAULT_OUTPUT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "DeviceClassTables.h")
+
+# Order matches enum class DeviceClass
+CLASSES = ["", "phone", "watch", "tag", "sensor", "tv", "audio", "computer", "peripheral"]
+MAX_VENDOR_LENGTH = 20
+
+TABLES = [
+    ("companyClasses", "company_ids.csv"),
+    ("serviceClasses", "service_uuids.csv"),
+    ("ouiClasses", "oui.csv"),
+]
+
+
+def _parse_key(text):
+    text = text.strip()
+    if ":" in text:
+        return int(text.replace(":", ""), 16)
+    return int(text, 16)
+
+
+def load_table(file_name):
+    rows = []
+    with open(os.path.join(DATA_DIR, file_name), newline="") as f:
+        for row in csv.reader(line for line in f if line.strip() and not line.startswith("#")):
+            key, vendor, device_class = (row + ["", ""])[:3]
+            vendor = vendor.strip()
+            device_class = device_class.strip()
+            if len(vendor) > MAX_VENDOR_LENGTH:
+                raise ValueError("%s: vendor name longer than %d characters: %s" % (file_name, MAX_VENDOR_LENGTH, vendor))
+            if device_class not in CLASSES:
+                raise ValueError("%s: unknown class %r" % (file_name, device_class))
+            rows.append((_parse_key(key), vendor, device_class))
+    rows.sort()
+    keys = [row[0] for row in rows]
+    if len(keys) != len(set(keys)):
+        raise ValueError("%s: duplicate keys" % file_name)
+    return rows
+
+
+def load_vendor_names():
+    vendors = set()
+    for _, file_name in TABLES:
+        vendors.update(vendor for _, vendor, _ in load_table(file_name) if vendor)
+    return [""] + sorted(vendors)
+
+
+def generate():
+    vendors = load_vendor_names()
+    vendor_ids = {name: i for i, name in enumerate(vendors)}
+
+    lines = [
+        "#pragma once",
+        "",
+        "// Generated by tools/device_classes.py from tools/device_classes/*.csv, don't edit.",
+        "// Only included by DeviceClassifier.cpp. const arrays stay in flash.",
+        "",
+        "static const char* const deviceVendorNames[] =",
+        "{",
+    ]
+    lines += ['    "%s",' % name for name in vendors]
+    lines += ["};", ""]
+
+    for array, file_name in TABLES:
+        lines += ["static const DeviceClassEntry %s[] =" % array, "{"]
+        for key, vendor, device_class in load_table(file_name):
+            lines.append("    { 0x%06X, %d, %d }, // %s %s" % (key, vendor_ids[vendor], CLASSES.index(device_class),
+                                                         vendor or "-", device_class or "-"))
+        lines += ["};", ""]
+
+    return "\n".join(lines)
+
+
+def main():
+    output = sys.argv[1] if len(sys.argv) > 1 else DEFAULT_OUTPUT
+    content = generate()
+    # Keep the timestamp if nothing changed, so the firmware isn't rebuilt
+    if os.path.exists(output):
+        with open(output) as f:
+            if f.read() == content:
+                return 0
+    with open(output, "w") as f:
+        f.write(content)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,48 @@
+// Minimal Arduino and FreeRTOS stand-ins for the host builds in tools/. millis() comes from the host
+// build of espMqttClient (Helpers.h).
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+typedef std::mutex* SemaphoreHandle_t;
+#define portMAX_DELAY 0xFFFFFFFF
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex()
+{
+    return new std::mutex();
+}
+
+inline int xSemaphoreTake(SemaphoreHandle_t mutex, uint32_t)
+{
+    mutex->lock();
+    return 1;
+}
+
+inline int xSemaphoreGive(SemaphoreHandle_t mutex)
+{
+    mutex->unlock();
+    return 1;
+}
+
+inline void vSemaphoreDelete(SemaphoreHandle_t mutex)
+{
+    delete mutex;
+}
+
+inline void delay(uint32_t ms)
+{
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+class String : public std::string
+{
+public:
+    String(const char* str = "")
+    : std::string(str)
+    {}
+};
@@ -0,0 +1,4 @@
+// Included by networkDevices/IPConfiguration.h, the host builds don't use preferences
+#pragma once
+
+#include <Arduino.h>
@@ -0,0 +1,213 @@
+#!/usr/bin/env python3
+"""
+Host side decoder for blescanner presence reports.
+
+Handles both report formats published on <prefix>/presence/devices[/<page>]:
+
+- CSV: one "address;name;rssi" line per device, "address;name;rssi;smoothed rssi;distance"
+  when an RSSI filter is configured, "...;distance;vendor;class" when classification is enabled,
+  "...;class;interval;jitter" when advertising intervals are reported
+- CBOR: indefinite array [version, report, record...],
+  version 1 record = [address, rssi, last seen, name?],
+  version 2 record = [address, rssi, last seen, smoothed rssi, distance in cm, name?],
+  version 3 record = [address, rssi, last seen, smoothed rssi, distance in cm, vendor id, class, name?],
+  version 4 record = [address, rssi, last seen, smoothed rssi, distance in cm, vendor id, class,
+                      interval in ms, jitter in ms, name?]
+
+Vendor ids index the vendor names generated from tools/device_classes, so the decoder has to
+come from the same revision as the firmware.
+
+CBOR records only carry a name when it's new or on every name refresh report, so a
+PresenceDecoder instance has to be kept per node to resolve names sent by reference.
+
+Answers to queries sent to <prefix>/presence/query ("<id>;mac|name|zone|seen;<argument>") arrive on
+<prefix>/presence/answers/<id>/<page> in the same formats, CBOR answers have report number 0 and
+always carry names. <prefix>/presence/answers/<id>/pages follows the last page.
+
+Usage as a script: presence_decoder.py <file> [csv|cbor]
+"""
+
+import struct
+import sys
+
+from device_classes import CLASSES, load_vendor_names
+
+CBOR_VERSIONS = (1, 2, 3, 4)
+VENDOR_NAMES = load_vendor_names()
+
+
+class Device:
+    __slots__ = ("address", "name", "rssi", "last_seen", "smoothed_rssi", "distance", "vendor", "device_class",
+                 "interval", "jitter")
+
+    def __init__(self, address, name, rssi, last_seen=None, smoothed_rssi=None, distance=None, vendor=None,
+                 device_class=None, interval=None, jitter=None):
+        self.address = address
+        self.name = name
+        self.rssi = rssi
+        self.last_seen = last_seen
+        self.smoothed_rssi = smoothed_rssi
+        self.distance = distance  # meters
+        self.vendor = vendor
+        self.device_class = device_class
+        self.interval = interval  # median ms between advertisements
+        self.jitter = jitter  # ms
+
+    def _key(self):
+        return (self.address, self.name, self.rssi, self.last_seen, self.smoothed_rssi, self.distance, self.vendor,
+                self.device_class, self.interval, self.jitter)
+
+    def __eq__(self, other):
+        return self._key() == other._key()
+
+    def __repr__(self):
+        return "Device(%s, %r, %r, %r, %r, %r, %r, %r, %r, %r)" % self._key()
+
+
+class _Break:
+    pass
+
+
+_BREAK = _Break()
+
+
+def _cbor_item(data, pos):
+    """Minimal CBOR decoder for the subset the firmware emits. Returns (item, new position)."""
+    initial = data[pos]
+    pos += 1
+    major = initial >> 5
+    info = initial & 0x1F
+
+    if initial == 0xFF:
+        return _BREAK, pos
+    if major == 7:
+        return {20: False, 21: True, 22: None, 23: None}.get(info), pos
+
+    if info < 24:
+        value = info
+    elif info == 24:
+        value = data[pos]
+        pos += 1
+    elif info == 25:
+        value = struct.unpack_from(">H", data, pos)[0]
+        pos += 2
+    elif info == 26:
+        value = struct.unpack_from(">I", data, pos)[0]
+        pos += 4
+    elif info == 27:
+        value = struct.unpack_from(">Q", data, pos)[0]
+        pos += 8
+    elif info == 31 and major == 4:
+        items = []
+        while True:
+            item, pos = _cbor_item(data, pos)
+            if item is _BREAK:
+                return items, pos
+            items.append(item)
+    else:
+        raise ValueError("Unsupported CBOR head 0x%02x" % initial)
+
+    if major == 0:
+        return value, pos
+    if major == 1:
+        return -1 - value, pos
+    if major == 2:
+        return bytes(data[pos:pos + value]), pos + value
+    if major == 3:
+        return bytes(data[pos:pos + value]).decode("utf-8", "replace"), pos + value
+    if major == 4:
+        items = []
+        for _ in range(value):
+            item, pos = _cbor_item(data, pos)
+            items.append(item)
+        return items, pos
+    raise ValueError("Unsupported CBOR major type %d" % major)
+
+
+def format_address(raw):
+    return ":".join("%02x" % b for b in raw)
+
+
+def decode_csv(payload):
+    devices = []
+    for line in payload.decode("utf-8", "replace").split("\n"):
+        # empty lines are padding, ";;" is the empty report
+        if not line or line == ";;":
+            continue
+        fields = line.split(";")
+        address, name, rssi = fields[:3]
+        device = Device(address, name, int(rssi) if rssi else None)
+        if len(fields) > 4:
+            device.smoothed_rssi = int(fields[3]) if fields[3] else None
+            device.distance = float(fields[4]) if fields[4] else None
+        if len(fields) > 6:
+            device.vendor = fields[5] or None
+            device.device_class = fields[6] or None
+        if len(fields) > 8:
+            device.interval = int(fields[7]) if fields[7] else None
+            device.jitter = int(fields[8]) if fields[8] else None
+        devices.append(device)
+    return devices
+
+
+class PresenceDecoder:
+    """Decodes reports of a single node, remembering names that were sent in earlier reports."""
+
+    def __init__(self):
+        self.names = {}
+        self.last_report = None
+
+    def decode_cbor(self, payload):
+        items, _ = _cbor_item(payload, 0)
+        if not isinstance(items, list) or len(items) < 2 or items[0] not in CBOR_VERSIONS:
+            raise ValueError("Not a presence report (version %r)" % (items[0] if items else None))
+        self.last_report = items[1]
+
+        devices = []
+        for record in items[2:]:
+            # byte strings are filler for records that were dropped after the page was measured
+            if not isinstance(record, list):
+                continue
+            address = format_address(record[0])
+            name_index = {1: 3, 2: 5, 3: 7}.get(items[0], 9)
+            if len(record) > name_index:
+                self.names[address] = record[name_index]
+            device = Device(address, self.names.get(address), record[1], record[2])
+            if items[0] >= 2:
+                device.smoothed_rssi = record[3]
+                device.distance = None if record[4] is None else record[4] / 100.0
+            if items[0] >= 3:
+                device.vendor = VENDOR_NAMES[record[5]] if 0 < record[5] < len(VENDOR_NAMES) else None
+                device.device_class = CLASSES[record[6]] if 0 < record[6] < len(CLASSES) else None
+            if items[0] >= 4 and record[7] != 0:
+                device.interval = record[7]
+                device.jitter = record[8]
+            devices.append(device)
+        return devices
+
+    def decode(self, payload):
+        if payload[:1] == b"\x9f":
+            return self.decode_cbor(payload)
+        return decode_csv(payload)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print(__doc__)
+        return 1
+    with open(sys.argv[1], "rb") as f:
+        payload = f.read()
+    decoder = PresenceDecoder()
+    if len(sys.argv) > 2:
+        devices = decoder.decode_cbor(payload) if sys.argv[2] == "cbor" else decode_csv(payload)
+    else:
+        devices = decoder.decode(payload)
+    for device in devices:
+        print(";".join("" if value is None else str(value) for value in
+                       (device.address, device.name, device.rssi, device.last_seen, device.smoothed_rssi,
+                        device.distance, device.vendor, device.device_class, device.interval, device.jitter)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
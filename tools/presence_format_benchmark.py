@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+"""
+Compares payload size and decode time of the CSV and CBOR presence formats.
+
+The encoders below mirror PresenceSerializer (without paging), so the sizes match what a node
+publishes. Usage: presence_format_benchmark.py [device count...]
+"""
+
+import random
+import struct
+import sys
+import time
+
+from device_classes import CLASSES
+from presence_decoder import PresenceDecoder, Device, decode_csv, VENDOR_NAMES
+
+NAMES = ["Tile", "Apple Watch", "iPhone", "Galaxy Buds2", "LYWSD03MMC", "ATC_8F3A21", "Mi Smart Band 6",
+         "Nuki_1A2B3C4D", "JBL Flip 5", "[TV] Samsung Q70 Series", "Forerunner 245", "ELK-BLEDOM"]
+
+
+def make_devices(count, seed=1):
+    rnd = random.Random(seed)
+    devices = []
+    for i in range(count):
+        address = ":".join("%02x" % rnd.randrange(256) for _ in range(6))
+        rssi = rnd.randrange(-100, -30)
+        devices.append(Device(address, rnd.choice(NAMES), rssi, rnd.randrange(0, 60), rssi + rnd.randrange(-3, 4),
+                              rnd.randrange(10, 2000) / 100.0, rnd.choice(VENDOR_NAMES[1:]), rnd.choice(CLASSES[1:]),
+                              rnd.randrange(20, 10000), rnd.randrange(0, 500)))
+    return devices
+
+
+def encode_csv(devices):
+    return "\n".join("%s;%s;%d;%d;%.2f;%s;%s;%d;%d" % (d.address, d.name, d.rssi, d.smoothed_rssi, d.distance, d.vendor,
+                                                     d.device_class, d.interval, d.jitter)
+                     for d in devices).encode()
+
+
+def _head(major, value):
+    if value < 24:
+        return bytes([major | value])
+    if value <= 0xFF:
+        return bytes([major | 24, value])
+    return bytes([major | 25]) + struct.pack(">H", value)
+
+
+def _int8(value):
+    return bytes([0x38, -1 - value]) if value < 0 else bytes([0x18, value])
+
+
+def encode_cbor(devices, report, with_names):
+    out = bytearray(b"\x9f\x04\x1a" + struct.pack(">I", report))
+    for d in devices:
+        out.append(0x80 | (10 if with_names else 9))
+        out += b"\x46" + bytes(int(x, 16) for x in d.address.split(":"))
+        out += _int8(d.rssi)
+        out += b"\x19" + struct.pack(">H", d.last_seen)
+        out += _int8(d.smoothed_rssi)
+        out += b"\x19" + struct.pack(">H", round(d.distance * 100))
+        out += bytes([0x18, VENDOR_NAMES.index(d.vendor), 0x18, CLASSES.index(d.device_class)])
+        out += b"\x19" + struct.pack(">H", d.interval) + b"\x19" + struct.pack(">H", d.jitter)
+        if with_names:
+            name = d.name.encode()
+            out += _head(0x60, len(name)) + name
+    out.append(0xFF)
+    return bytes(out)
+
+
+def timed(fn, repeat=200):
+    start = time.perf_counter()
+    for _ in range(repeat):
+        fn()
+    return (time.perf_counter() - start) / repeat * 1e6
+
+
+def main():
+    counts = [int(c) for c in sys.argv[1:]] or [10, 50, 200, 1000]
+    print("%8s %10s %14s %14s %8s %12s %12s" % ("devices", "csv bytes", "cbor names", "cbor by ref", "ratio",
+                                               "csv dec us", "cbor dec us"))
+    for count in counts:
+        devices = make_devices(count)
+        csv = encode_csv(devices)
+        keyframe = encode_cbor(devices, 30, True)
+        delta = encode_cbor(devices, 31, False)
+
+        # round trip check, also primes the name table for the by-reference report
+        decoder = PresenceDecoder()
+        # CSV doesn't carry the last seen time
+        without_last_seen = lambda ds: [(d.address, d.name, d.rssi, d.smoothed_rssi, d.distance, d.vendor,
+                                         d.device_class, d.interval, d.jitter) for d in ds]
+        assert without_last_seen(decode_csv(csv)) == without_last_seen(devices)
+        assert decoder.decode_cbor(keyframe) == devices
+        assert decoder.decode_cbor(delta) == devices
+
+        csv_us = timed(lambda: decode_csv(csv))
+        cbor_us = timed(lambda: decoder.decode_cbor(delta))
+        print("%8d %10d %14d %14d %7.1fx %12.1f %12.1f" % (count, len(csv), len(keyframe), len(delta),
+                                                        len(csv) / len(delta), csv_us, cbor_us))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,237 @@
+// Host build of PublishScheduler against a fake network device. Checks that publishing only queues,
+// the class order, the outbox high water mark, replacing queued values, the queue limit, the token
+// bucket and that a report larger than the presence queue gets through when its pages wait for room.
+//
+// g++ -std=gnu++17 -Ihost -I.. -I../lib/espMqttClient/src -o publish_scheduler_check publish_scheduler_check.cpp ../PublishScheduler.cpp ../lib/espMqttClient/src/SharedPayload.cpp -pthread && ./publish_scheduler_check
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+#include "PublishScheduler.h"
+
+// Records what the scheduler hands over, everything else does nothing
+class FakeDevice : public NetworkDevice
+{
+public:
+    FakeDevice()
+    : NetworkDevice(String("fake"), nullptr)
+    {}
+
+    std::vector<std::string> sent;
+    size_t outboxBytes = 0;
+    bool connected = true;
+
+    const String deviceName() const override { return String("fake"); }
+
+    void initialize() override {}
+    ReconnectStatus reconnect() override { return ReconnectStatus::Success; }
+    void reconfigure() override {}
+    void printError() override {}
+    bool supportsEncryption() override { return false; }
+
+    void update() override {}
+
+    bool isConnected() override { return connected; }
+    int8_t signalStrength() override { return 0; }
+
+    void mqttSetClientId(const char* clientId) override {}
+    void mqttSetCleanSession(bool cleanSession) override {}
+    void mqttSetProtocolVersion(espMqttClientTypes::ProtocolVersion version) override {}
+    uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, const char* payload) override { return 0; }
+    uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, const uint8_t* payload, size_t length) override { return 0; }
+    uint16_t mqttPublish(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) override
+    {
+        return record(topic, payload);
+    }
+    uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, const char* payload) override { return 0; }
+    uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, espMqttClientTypes::SharedPayload* payload) override { return 0; }
+    uint16_t mqttPublishLatest(const char* topic, uint8_t qos, bool retain, uint32_t messageExpiry, espMqttClientTypes::SharedPayload* payload) override
+    {
+        return record(topic, payload);
+    }
+    bool mqttConnected() const override { return connected; }
+    size_t mqttOutboxBytes() override { return outboxBytes; }
+    void mqttSetServer(const char* host, uint16_t port) override {}
+    bool mqttConnect() override { return true; }
+    bool mqttDisonnect(bool force) override { return true; }
+    void setWill(const char* topic, uint8_t qos, bool retain, const char* payload) override {}
+    void mqttSetCredentials(const char* username, const char* password) override {}
+    void mqttOnMessage(espMqttClientTypes::OnMessageCallback callback) override {}
+    void mqttOnConnect(espMqttClientTypes::OnConnectCallback callback) override {}
+    void mqttOnDisconnect(espMqttClientTypes::OnDisconnectCallback callback) override {}
+    void mqttOnSubscribe(espMqttClientTypes::OnSubscribeCallback callback) override {}
+    void disableMqtt() override {}
+
+    uint16_t mqttSubscribe(const char* topic, uint8_t qos) override { return 0; }
+    uint16_t mqttSubscribe(const espMqttClientTypes::SubscribeItem* list, size_t count) override { return 0; }
+
+private:
+    uint16_t record(const char* topic, espMqttClientTypes::SharedPayload* payload)
+    {
+        sent.push_back(std::string(topic) + "=" + std::string((const char*)payload->data(), payload->length()));
+        return sent.size();
+    }
+};
+
+static bool ok = true;
+
+static void check(bool condition, const char* description)
+{
+    if(!condition)
+    {
+        printf("failed: %s\n", description);
+        ok = false;
+    }
+}
+
+static void checkOrderAndOutbox()
+{
+    FakeDevice device;
+    PublishScheduler scheduler;
+    scheduler.setDevice(&device);
+    device.outboxBytes = publish_outbox_high_water;
+
+    scheduler.publish(PublishClass::Telemetry, "t/a", "1", true, true);
+    scheduler.publish(PublishClass::Telemetry, "t/a", "2", true, true);
+    scheduler.publish(PublishClass::Presence, "p/0", "page", true, true);
+    scheduler.publish(PublishClass::Control, "g/1", "1", true, false);
+    check(device.sent.empty(), "publish() only queues");
+
+    // Control messages don't wait for the outbox
+    scheduler.update();
+    check(device.sent.size() == 1 && device.sent[0] == "g/1=1", "control sent above the high water mark");
+
+    PublishClassStats stats = scheduler.stats(PublishClass::Telemetry);
+    check(stats.queuedMessages == 1 && stats.replaced == 1, "queued value replaced");
+
+    device.outboxBytes = 0;
+    scheduler.update();
+    check(device.sent.size() == 3 && device.sent[1] == "p/0=page" && device.sent[2] == "t/a=2", "presence before telemetry, latest value");
+
+    stats = scheduler.stats(PublishClass::Telemetry);
+    check(stats.sent == 1 && stats.queuedBytes == 0, "telemetry stats after sending");
+}
+
+static void checkDisconnected()
+{
+    FakeDevice device;
+    PublishScheduler scheduler;
+    scheduler.setDevice(&device);
+    device.connected = false;
+
+    scheduler.publish(PublishClass::Control, "g/1", "1", true, false);
+    scheduler.update();
+    check(device.sent.empty(), "nothing sent while disconnected");
+
+    device.connected = true;
+    scheduler.update();
+    check(device.sent.size() == 1, "queued message sent after connecting");
+}
+
+static void checkLimits()
+{
+    FakeDevice device;
+    PublishScheduler scheduler;
+    scheduler.setDevice(&device);
+
+    // Four messages fill the telemetry bucket
+    const size_t messageSize = publish_telemetry_burst / 4;
+    std::string payload(messageSize - 5 - strlen("t/0"), 'x');
+
+    for(int i = 0; i < 4; i++)
+    {
+        char topic[8];
+        snprintf(topic, sizeof(topic), "t/%d", i);
+        check(scheduler.publish(PublishClass::Telemetry, topic, payload.c_str(), true, false), "message fits the queue");
+    }
+
+    // Fill the queue up to its limit, the next message is dropped
+    size_t queued = 4;
+    while(queued * messageSize + messageSize <= publish_telemetry_max_queued)
+    {
+        scheduler.publish(PublishClass::Telemetry, "t/q", payload.c_str(), true, false);
+        ++queued;
+    }
+    check(!scheduler.publish(PublishClass::Telemetry, "t/q", payload.c_str(), true, false), "message over the queue limit dropped");
+    check(scheduler.stats(PublishClass::Telemetry).dropped == 1, "drop counted");
+
+    scheduler.update();
+    check(device.sent.size() == 4, "a full bucket sends its burst");
+
+    scheduler.publish(PublishClass::Telemetry, "t/4", payload.c_str(), true, false);
+    scheduler.update();
+    check(device.sent.size() == 4, "an empty bucket waits");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(messageSize * 1000 / publish_telemetry_rate + 10));
+    scheduler.update();
+    check(device.sent.size() == 5, "the refilled bucket sends one more message");
+}
+
+static void checkLargeReport()
+{
+    FakeDevice device;
+    PublishScheduler scheduler;
+    scheduler.setDevice(&device);
+
+    // The network task empties the queues while the presence task publishes the pages
+    std::atomic<bool> done(false);
+    std::thread networkTask([&]()
+    {
+        while(!done)
+        {
+            scheduler.update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    });
+
+    // Twice what the presence queue holds
+    const size_t pageSize = 1400;
+    const int pageCount = 2 * publish_presence_max_queued / pageSize;
+    std::string payload(pageSize, 'p');
+
+    int queued = 0;
+    for(int page = 0; page < pageCount; page++)
+    {
+        char topic[16];
+        snprintf(topic, sizeof(topic), "p/%d", page);
+        if(scheduler.publish(PublishClass::Presence, topic, payload.c_str(), true, true, 5000))
+        {
+            ++queued;
+        }
+    }
+
+    while(scheduler.stats(PublishClass::Presence).queuedMessages > 0)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    done = true;
+    networkTask.join();
+
+    check(queued == pageCount, "every page of a report larger than the queue queued");
+    check(scheduler.stats(PublishClass::Presence).dropped == 0, "no page dropped");
+
+    bool inOrder = device.sent.size() == (size_t)pageCount;
+    for(size_t page = 0; inOrder && page < device.sent.size(); page++)
+    {
+        inOrder = device.sent[page].compare(0, device.sent[page].find('='), "p/" + std::to_string(page)) == 0;
+    }
+    check(inOrder, "pages sent in order");
+}
+
+int main()
+{
+    checkOrderAndOutbox();
+    checkDisconnected();
+    checkLimits();
+    checkLargeReport();
+
+    if(!ok)
+    {
+        return 1;
+    }
+    printf("publish scheduler ok\n");
+    return 0;
+}
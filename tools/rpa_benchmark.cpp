@@ -0,0 +1,95 @@
+// Host build of RpaResolver with the software AES. Checks the AES and RPA test vectors, then measures
+// resolving with and without the cache.
+//
+// g++ -O2 -I.. -o rpa_benchmark rpa_benchmark.cpp ../RpaResolver.cpp && ./rpa_benchmark [keys] [addresses]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "RpaResolver.h"
+
+static bool checkVectors()
+{
+    bool ok = true;
+
+    // Bluetooth Core spec Vol 3 Part H Appendix D.7: IRK ec0234a3..., prand 708194, hash 0dfbaa
+    RpaResolver resolver;
+    if(resolver.loadKeys("ec0234a357c8ad05341010a60a397d9b") != 1)
+    {
+        printf("failed to load the sample IRK\n");
+        return false;
+    }
+    if(resolver.resolve(0x7081940dfbaaLL) != resolver.identityAddress(0))
+    {
+        printf("sample RPA not resolved\n");
+        ok = false;
+    }
+    if(resolver.resolve(0x7081940dfbabLL) != 0x7081940dfbabLL)
+    {
+        printf("modified RPA resolved\n");
+        ok = false;
+    }
+
+    // Malformed keys are skipped
+    RpaResolver parser;
+    int parsed = parser.loadKeys("00112233445566778899aabbccddeeff;0011, zz112233445566778899aabbccddeeff\n"
+                                 "FFEEDDCCBBAA99887766554433221100");
+    if(parsed != 2)
+    {
+        printf("parsed %d keys instead of 2\n", parsed);
+        ok = false;
+    }
+
+    return ok;
+}
+
+int main(int argc, char** argv)
+{
+    if(!checkVectors())
+    {
+        return 1;
+    }
+    printf("test vectors ok\n");
+
+    int keyCount = argc > 1 ? atoi(argv[1]) : rpa_max_irks;
+    int addressCount = argc > 2 ? atoi(argv[2]) : 100000;
+
+    std::mt19937_64 rng(1);
+    RpaResolver resolver;
+    for(int i = 0; i < keyCount; i++)
+    {
+        uint8_t irk[rpa_irk_length];
+        for(auto& b : irk)
+        {
+            b = rng();
+        }
+        resolver.addKey(irk);
+    }
+
+    // Unknown RPAs are the worst case, every key has to be tried
+    std::vector<long long> addresses;
+    for(int i = 0; i < addressCount; i++)
+    {
+        addresses.push_back((rng() & 0x3FFFFFFFFFFFLL) | 0x400000000000LL);
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for(long long address : addresses)
+    {
+        resolver.resolve(address);
+    }
+    double uncached = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    // A few phones advertising repeatedly, as seen by the scanner
+    start = std::chrono::steady_clock::now();
+    for(int i = 0; i < addressCount; i++)
+    {
+        resolver.resolve(addresses[i % 20]);
+    }
+    double cached = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+
+    printf("%d keys: %.3f us per new address, %.3f us per cached address\n", keyCount,
+           uncached / addressCount, cached / addressCount);
+    return 0;
+}